@@ -0,0 +1,547 @@
+#include "aarch64.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+A64Fixup* add_fixup(A64Code*, A64FixupKind, size_t);
+
+const char* cond_names[] = {
+  "eq", "ne", "hs", "lo", "mi", "pl", "vs", "vc",
+  "hi", "ls", "ge", "lt", "gt", "le", "al"
+};
+
+void a64_init(A64Code* code)
+{
+  code->count = 0;
+  code->capacity = 1024;
+  code->words = malloc(sizeof(uint32_t) * code->capacity);
+  code->label_capacity = 0;
+  code->label_pos = NULL;
+  code->fixup_count = 0;
+  code->fixup_capacity = 64;
+  code->fixups = malloc(sizeof(A64Fixup) * code->fixup_capacity);
+  if(!code->words || !code->fixups) {
+    perror("Error");
+    exit(1);
+  }
+}
+
+void a64_emit(A64Code* code, uint32_t word)
+{
+  if(code->count == code->capacity) {
+    code->capacity *= 2;
+    code->words = realloc(code->words, sizeof(uint32_t) * code->capacity);
+    if(!code->words) {
+      perror("Error");
+      exit(1);
+    }
+  }
+  code->words[code->count++] = word;
+}
+
+void a64_bind_label(A64Code* code, size_t tag)
+{
+  if(tag >= code->label_capacity) {
+    size_t new_capacity = code->label_capacity ? code->label_capacity : 64;
+    while(tag >= new_capacity) {
+      new_capacity *= 2;
+    }
+    code->label_pos = realloc(code->label_pos, sizeof(long) * new_capacity);
+    if(!code->label_pos) {
+      perror("Error");
+      exit(1);
+    }
+    for(size_t i = code->label_capacity; i < new_capacity; i++) {
+      code->label_pos[i] = -1;
+    }
+    code->label_capacity = new_capacity;
+  }
+  code->label_pos[tag] = code->count;
+}
+
+// Emits a branch whose offset is filled in once every label is bound
+void a64_emit_branch(A64Code* code, uint32_t word, A64FixupKind kind,
+                     size_t tag)
+{
+  add_fixup(code, kind, tag);
+  a64_emit(code, word);
+}
+
+// Emits a word holding the bytes from label tag forward to label base
+void a64_emit_offset(A64Code* code, size_t base, size_t tag)
+{
+  add_fixup(code, A64_FIXUP_OFFSET, tag)->base = base;
+  a64_emit(code, 0);
+}
+
+A64Fixup* add_fixup(A64Code* code, A64FixupKind kind, size_t tag)
+{
+  if(code->fixup_count == code->fixup_capacity) {
+    code->fixup_capacity *= 2;
+    code->fixups = realloc(code->fixups,
+                           sizeof(A64Fixup) * code->fixup_capacity);
+    if(!code->fixups) {
+      perror("Error");
+      exit(1);
+    }
+  }
+  A64Fixup* fixup = &code->fixups[code->fixup_count++];
+  fixup->index = code->count;
+  fixup->tag = tag;
+  fixup->base = 0;
+  fixup->kind = kind;
+  return fixup;
+}
+
+// Returns 0 on success, -1 if a label is missing or out of range.
+int a64_resolve_labels(A64Code* code)
+{
+  for(size_t i = 0; i < code->fixup_count; i++) {
+    A64Fixup* fixup = &code->fixups[i];
+    if(fixup->tag >= code->label_capacity
+       || code->label_pos[fixup->tag] < 0) {
+      printf("Error: undefined label .L%zu\n", fixup->tag);
+      return -1;
+    }
+    long delta = code->label_pos[fixup->tag] - (long)fixup->index;
+    switch(fixup->kind) {
+    case A64_FIXUP_B:
+      if(delta < -(1L << 25) || delta >= (1L << 25)) {
+        puts("Error: branch out of range");
+        return -1;
+      }
+      code->words[fixup->index] |= (uint32_t)delta & 0x3ffffff;
+      break;
+    case A64_FIXUP_BCOND:
+      if(delta < -(1L << 18) || delta >= (1L << 18)) {
+        puts("Error: conditional branch out of range");
+        return -1;
+      }
+      code->words[fixup->index] |= ((uint32_t)delta & 0x7ffff) << 5;
+      break;
+    case A64_FIXUP_OFFSET:
+      if(fixup->base >= code->label_capacity
+         || code->label_pos[fixup->base] < 0) {
+        printf("Error: undefined label .L%zu\n", fixup->base);
+        return -1;
+      }
+      delta = code->label_pos[fixup->base] - code->label_pos[fixup->tag];
+      code->words[fixup->index] = 4 * (uint32_t)delta;
+      break;
+    }
+  }
+  return 0;
+}
+
+void a64_free(A64Code* code)
+{
+  free(code->words);
+  free(code->label_pos);
+  free(code->fixups);
+  memset(code, 0, sizeof(A64Code));
+}
+
+const char* a64_cond_name(A64Cond cond)
+{
+  return cond_names[cond];
+}
+
+A64Cond a64_invert_cond(A64Cond cond)
+{
+  return cond ^ 1;
+}
+
+// The nzcv immediate of a ccmp that makes cond hold, or fail when holds
+// is 0
+int a64_cond_nzcv(A64Cond cond, int holds)
+{
+  for(int nzcv = 0; nzcv < 16; nzcv++) {
+    int n = nzcv >> 3 & 1;
+    int z = nzcv >> 2 & 1;
+    int c = nzcv >> 1 & 1;
+    int v = nzcv & 1;
+    int result = 1;
+    switch(cond & ~1) {
+    case A64_EQ:
+      result = z;
+      break;
+    case A64_HS:
+      result = c;
+      break;
+    case A64_MI:
+      result = n;
+      break;
+    case A64_VS:
+      result = v;
+      break;
+    case A64_HI:
+      result = c && !z;
+      break;
+    case A64_GE:
+      result = n == v;
+      break;
+    case A64_GT:
+      result = !z && n == v;
+      break;
+    }
+    if(cond & 1) {
+      result = !result;
+    }
+    if(result == holds) {
+      return nzcv;
+    }
+  }
+  return 0;
+}
+
+void a64_add_symbol(A64SymbolList* syms, const char* name, size_t offset)
+{
+  if(syms->count == syms->capacity) {
+    syms->capacity = syms->capacity ? 2 * syms->capacity : 4;
+    syms->symbols = realloc(syms->symbols,
+                            sizeof(A64Symbol) * syms->capacity);
+    if(!syms->symbols) {
+      perror("Error");
+      exit(1);
+    }
+  }
+  size_t len = strlen(name);
+  syms->symbols[syms->count].name = malloc(len + 1);
+  memcpy(syms->symbols[syms->count].name, name, len + 1);
+  syms->symbols[syms->count].offset = offset;
+  syms->count++;
+}
+
+void a64_free_symbols(A64SymbolList* syms)
+{
+  for(size_t i = 0; i < syms->count; i++) {
+    free(syms->symbols[i].name);
+  }
+  free(syms->symbols);
+  syms->symbols = NULL;
+  syms->count = 0;
+  syms->capacity = 0;
+}
+
+// sf selects the 64 bit form in all of these
+uint32_t a64_reg_op(A64RegOp op, int sf, int rd, int rn, int rm)
+{
+  return op | (uint32_t)sf << 31 | rm << 16 | rn << 5 | rd;
+}
+
+// rd = rn op (rm shift amount), for the add, sub and logical forms
+uint32_t a64_shifted_op(A64RegOp op, int sf, int rd, int rn, int rm,
+                        A64Shift shift, int amount)
+{
+  return a64_reg_op(op, sf, rd, rn, rm) | (uint32_t)shift << 22
+         | (amount & 63) << 10;
+}
+
+uint32_t a64_addsub_imm(int sf, int sub, int setflags, int rd, int rn,
+                        uint32_t imm12, int shift12)
+{
+  return 0x11000000 | (uint32_t)sf << 31 | sub << 30 | setflags << 29
+         | shift12 << 22 | (imm12 & 0xfff) << 10 | rn << 5 | rd;
+}
+
+uint32_t a64_movz(int sf, int rd, uint32_t imm16, int hw)
+{
+  return 0x52800000 | (uint32_t)sf << 31 | hw << 21 | (imm16 & 0xffff) << 5
+         | rd;
+}
+
+uint32_t a64_movn(int sf, int rd, uint32_t imm16, int hw)
+{
+  return 0x12800000 | (uint32_t)sf << 31 | hw << 21 | (imm16 & 0xffff) << 5
+         | rd;
+}
+
+uint32_t a64_movk(int sf, int rd, uint32_t imm16, int hw)
+{
+  return 0x72800000 | (uint32_t)sf << 31 | hw << 21 | (imm16 & 0xffff) << 5
+         | rd;
+}
+
+// madd rd, rn, rm, ra (rd = ra + rn*rm), or msub when sub is set
+uint32_t a64_madd(int sf, int sub, int rd, int rn, int rm, int ra)
+{
+  return 0x1B000000 | (uint32_t)sf << 31 | rm << 16 | sub << 15 | ra << 10
+         | rn << 5 | rd;
+}
+
+// smull or umull xd, wn, wm
+uint32_t a64_mul_long(int sign, int rd, int rn, int rm)
+{
+  return (sign ? 0x9B200000 : 0x9BA00000) | rm << 16 | A64_ZR << 10
+         | rn << 5 | rd;
+}
+
+// smulh or umulh xd, xn, xm
+uint32_t a64_mul_high(int sign, int rd, int rn, int rm)
+{
+  return (sign ? 0x9B400000 : 0x9BC00000) | rm << 16 | A64_ZR << 10
+         | rn << 5 | rd;
+}
+
+// sbfm or ubfm, which the immediate shifts are aliases of
+uint32_t a64_bitfield(int sf, int sign, int rd, int rn, int immr, int imms)
+{
+  return (sign ? 0x13000000 : 0x53000000) | (uint32_t)sf << 31 | sf << 22
+         | immr << 16 | imms << 10 | rn << 5 | rd;
+}
+
+uint32_t a64_csinc(int sf, int rd, int rn, int rm, A64Cond cond)
+{
+  return 0x1A800400 | (uint32_t)sf << 31 | rm << 16 | cond << 12 | rn << 5
+         | rd;
+}
+
+// and, orr or eor rd, rn, #imm from the register form's opcode, bits
+// being the N:immr:imms a64_bitmask_imm found. Register 31 is zr as rn.
+uint32_t a64_logical_imm(A64RegOp op, int sf, int rd, int rn, uint32_t bits)
+{
+  return (op & 0x60000000) | 0x12000000 | (uint32_t)sf << 31
+         | (bits & 0x1fff) << 10 | rn << 5 | rd;
+}
+
+// csel, csinc, csinv or csneg rd, rn, rm, cond
+uint32_t a64_cond_select(A64CondSelect op, int sf, int rd, int rn, int rm,
+                         A64Cond cond)
+{
+  return op | (uint32_t)sf << 31 | rm << 16 | cond << 12 | rn << 5 | rd;
+}
+
+// ccmp rn, #imm5, #nzcv, cond
+uint32_t a64_ccmp_imm(int sf, int rn, int imm5, int nzcv, A64Cond cond)
+{
+  return 0x7A400800 | (uint32_t)sf << 31 | (imm5 & 31) << 16 | cond << 12
+         | rn << 5 | (nzcv & 15);
+}
+
+// ccmp rn, rm, #nzcv, cond
+uint32_t a64_ccmp(int sf, int rn, int rm, int nzcv, A64Cond cond)
+{
+  return 0x7A400000 | (uint32_t)sf << 31 | rm << 16 | cond << 12 | rn << 5
+         | nzcv;
+}
+
+// size is log2 of the access width in bytes, imm12 is already scaled
+uint32_t a64_mem_uimm(int size, int load, int rt, int rn, uint32_t imm12)
+{
+  return 0x39000000 | (uint32_t)size << 30 | load << 22
+         | (imm12 & 0xfff) << 10 | rn << 5 | rt;
+}
+
+uint32_t a64_mem_unscaled(int size, int load, int rt, int rn, int simm9)
+{
+  return 0x38000000 | (uint32_t)size << 30 | load << 22
+         | ((uint32_t)simm9 & 0x1ff) << 12 | rn << 5 | rt;
+}
+
+// Zero extending ldr rt, [rn, rm, lsl #size]
+uint32_t a64_mem_index(int size, int rt, int rn, int rm)
+{
+  return 0x38606800 | (uint32_t)size << 30 | rm << 16 | (size > 0) << 12
+         | rn << 5 | rt;
+}
+
+// The label's address, patched like a conditional branch
+uint32_t a64_adr(int rd)
+{
+  return 0x10000000 | rd;
+}
+
+uint32_t a64_br(int rn)
+{
+  return 0xD61F0000 | rn << 5;
+}
+
+uint32_t a64_b(void)
+{
+  return 0x14000000;
+}
+
+uint32_t a64_bl(void)
+{
+  return 0x94000000;
+}
+
+uint32_t a64_bcond(A64Cond cond)
+{
+  return 0x54000000 | cond;
+}
+
+// cbnz when nonzero is set
+uint32_t a64_cbz(int sf, int nonzero, int rt)
+{
+  return 0x34000000 | (uint32_t)sf << 31 | nonzero << 24 | rt;
+}
+
+uint32_t a64_ret(void)
+{
+  return 0xD65F03C0;
+}
+
+uint32_t a64_svc(uint32_t imm)
+{
+  return 0xD4000001 | (imm & 0xffff) << 5;
+}
+
+// Shortest movz/movn + movk sequence for the value. Returns how many
+// parts were written, at most 4.
+int a64_mov_parts(int sf, uint64_t value, A64MovPart* parts)
+{
+  int chunks = sf ? 4 : 2;
+  if(!sf) {
+    value &= 0xffffffff;
+  }
+  int zero_chunks = 0;
+  int ones_chunks = 0;
+  for(int i = 0; i < chunks; i++) {
+    uint32_t chunk = (value >> (16 * i)) & 0xffff;
+    zero_chunks += chunk == 0;
+    ones_chunks += chunk == 0xffff;
+  }
+  int inverted = ones_chunks > zero_chunks;
+  uint32_t skip = inverted ? 0xffff : 0;
+  int count = 0;
+  for(int i = 0; i < chunks; i++) {
+    uint32_t chunk = (value >> (16 * i)) & 0xffff;
+    if(chunk == skip) {
+      continue;
+    }
+    if(!count) {
+      parts[count++] = (A64MovPart){inverted ? A64_MOVN : A64_MOVZ,
+                                    inverted ? ~chunk & 0xffff : chunk, i};
+    } else {
+      parts[count++] = (A64MovPart){A64_MOVK, chunk, i};
+    }
+  }
+  if(!count) {
+    parts[count++] = (A64MovPart){inverted ? A64_MOVN : A64_MOVZ, 0, 0};
+  }
+  return count;
+}
+
+// The N:immr:imms of a logical immediate: a run of ones rotated within
+// an element of 2, 4, ..., 64 bits, repeated to fill the register.
+// Returns 0 for values no such pattern makes, all zeros and ones among
+// them.
+int a64_bitmask_imm(int sf, uint64_t value, uint32_t* bits)
+{
+  if(!sf) {
+    value = (value & 0xffffffff) | value << 32;
+  }
+  if(!value || value == UINT64_MAX) {
+    return 0;
+  }
+  int size = 64;
+  while(size > 2) {
+    int half = size / 2;
+    uint64_t mask = ((uint64_t)1 << half) - 1;
+    if((value & mask) != (value >> half & mask)) {
+      break;
+    }
+    size = half;
+  }
+  uint64_t mask = size == 64 ? UINT64_MAX : ((uint64_t)1 << size) - 1;
+  uint64_t element = value & mask;
+  int ones = 0;
+  for(int i = 0; i < size; i++) {
+    ones += element >> i & 1;
+  }
+  uint64_t run = ((uint64_t)1 << ones) - 1;
+  for(int r = 0; r < size; r++) {
+    uint64_t rotated = r ? (element >> r | element << (size - r)) & mask
+                         : element;
+    if(rotated == run) {
+      *bits = (size == 64) << 12 | ((size - r) % size) << 6
+              | ((~(2 * size - 1) & 0x3f) | (ones - 1));
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Whether orr rd, zr, #value beats the movz/movn and movk sequence
+int a64_mov_bitmask(int sf, uint64_t value, uint32_t* bits)
+{
+  A64MovPart parts[4];
+  return a64_mov_parts(sf, value, parts) > 1
+         && a64_bitmask_imm(sf, value, bits);
+}
+
+void a64_mov_imm(A64Code* code, int sf, int rd, uint64_t value)
+{
+  A64MovPart parts[4];
+  uint32_t bits;
+  if(a64_mov_bitmask(sf, value, &bits)) {
+    a64_emit(code, a64_logical_imm(A64_ORR, sf, rd, A64_ZR, bits));
+    return;
+  }
+  int count = a64_mov_parts(sf, value, parts);
+  for(int i = 0; i < count; i++) {
+    switch(parts[i].kind) {
+    case A64_MOVZ:
+      a64_emit(code, a64_movz(sf, rd, parts[i].imm16, parts[i].hw));
+      break;
+    case A64_MOVN:
+      a64_emit(code, a64_movn(sf, rd, parts[i].imm16, parts[i].hw));
+      break;
+    case A64_MOVK:
+      a64_emit(code, a64_movk(sf, rd, parts[i].imm16, parts[i].hw));
+      break;
+    }
+  }
+}
+
+// Whether the offset fits the scaled unsigned form, otherwise ldur/stur
+int a64_scaled_offset(int size, long offset)
+{
+  return offset >= 0 && !(offset & ((1 << size) - 1))
+         && (offset >> size) < 4096;
+}
+
+// ldr/str rt, [sp, offset]. Returns -1 if no single instruction fits.
+int a64_stack_access(A64Code* code, int size, int load, int rt, long offset)
+{
+  if(a64_scaled_offset(size, offset)) {
+    a64_emit(code, a64_mem_uimm(size, load, rt, A64_SP, offset >> size));
+    return 0;
+  }
+  if(offset >= -256 && offset < 256) {
+    a64_emit(code, a64_mem_unscaled(size, load, rt, A64_SP, offset));
+    return 0;
+  }
+  return -1;
+}
+
+// Whether one add or sub, flipped for a negative imm, takes the
+// immediate: 12 bits, optionally shifted left by 12
+int a64_addsub_fits(long imm)
+{
+  unsigned long magnitude = imm < 0 ? -(unsigned long)imm : (unsigned long)imm;
+  return magnitude < 4096 || (!(magnitude & 0xfff) && magnitude < (1L << 24));
+}
+
+// add/sub rd, rn, #imm with up to a 24 bit immediate. Register 31 is sp.
+int a64_add_imm(A64Code* code, int sf, int sub, int rd, int rn, long imm)
+{
+  if(imm < 0) {
+    sub = !sub;
+    imm = -imm;
+  }
+  if(imm >= (1L << 24)) {
+    return -1;
+  }
+  if(imm >> 12) {
+    a64_emit(code, a64_addsub_imm(sf, sub, 0, rd, rn, imm >> 12, 1));
+    if(imm & 0xfff) {
+      a64_emit(code, a64_addsub_imm(sf, sub, 0, rd, rd, imm & 0xfff, 0));
+    }
+  } else {
+    a64_emit(code, a64_addsub_imm(sf, sub, 0, rd, rn, imm, 0));
+  }
+  return 0;
+}
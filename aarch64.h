@@ -0,0 +1,147 @@
+#ifndef AARCH64_H_
+#define AARCH64_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define A64_SP 31
+#define A64_ZR 31
+
+typedef enum A64Cond_e {
+  A64_EQ = 0, A64_NE, A64_HS, A64_LO, A64_MI, A64_PL, A64_VS, A64_VC,
+  A64_HI, A64_LS, A64_GE, A64_LT, A64_GT, A64_LE, A64_AL
+} A64Cond;
+
+// Opcode bits for the register forms, ored together with the operands
+typedef enum A64RegOp_e {
+  A64_AND  = 0x0A000000,
+  A64_ORR  = 0x2A000000,
+  A64_ORN  = 0x2A200000,
+  A64_EOR  = 0x4A000000,
+  A64_ANDS = 0x6A000000,
+  A64_ADD  = 0x0B000000,
+  A64_ADDS = 0x2B000000,
+  A64_SUB  = 0x4B000000,
+  A64_SUBS = 0x6B000000,
+  A64_UDIV = 0x1AC00800,
+  A64_SDIV = 0x1AC00C00,
+  A64_LSLV = 0x1AC02000,
+  A64_LSRV = 0x1AC02400,
+  A64_ASRV = 0x1AC02800
+} A64RegOp;
+
+// Shift applied to the last operand of a shifted register add or sub
+typedef enum A64Shift_e {
+  A64_LSL = 0, A64_LSR, A64_ASR
+} A64Shift;
+
+// Conditional selects, rd = cond ? rn : rm, rm + 1, ~rm or -rm
+typedef enum A64CondSelect_e {
+  A64_CSEL  = 0x1A800000,
+  A64_CSINC = 0x1A800400,
+  A64_CSINV = 0x5A800000,
+  A64_CSNEG = 0x5A800400
+} A64CondSelect;
+
+// One instruction of a constant materialization, writing imm16 << 16*hw
+typedef enum A64MovKind_e {
+  A64_MOVZ,
+  A64_MOVN, // imm16 is already inverted
+  A64_MOVK
+} A64MovKind;
+
+typedef struct A64MovPart_s {
+  A64MovKind kind;
+  uint32_t imm16;
+  int hw;
+} A64MovPart;
+
+typedef enum A64FixupKind_e {
+  A64_FIXUP_B,     // imm26 at bit 0
+  A64_FIXUP_BCOND, // imm19 at bit 5 (b.cond, cbz, cbnz, adr)
+  A64_FIXUP_OFFSET // A data word, bytes from tag forward to base
+} A64FixupKind;
+
+typedef struct A64Fixup_s {
+  size_t index;
+  size_t tag;
+  size_t base; // A64_FIXUP_OFFSET only
+  A64FixupKind kind;
+} A64Fixup;
+
+// Machine code for one .text section. Branch targets are the generator's
+// numeric tags and get patched in a64_resolve_labels.
+typedef struct A64Code_s {
+  uint32_t* words;
+  size_t count;
+  size_t capacity;
+  long* label_pos;
+  size_t label_capacity;
+  A64Fixup* fixups;
+  size_t fixup_count;
+  size_t fixup_capacity;
+} A64Code;
+
+typedef struct A64Symbol_s {
+  char* name;
+  size_t offset; // Byte offset into .text
+} A64Symbol;
+
+typedef struct A64SymbolList_s {
+  A64Symbol* symbols;
+  size_t count;
+  size_t capacity;
+} A64SymbolList;
+
+void a64_init(A64Code*);
+void a64_emit(A64Code*, uint32_t);
+void a64_bind_label(A64Code*, size_t);
+void a64_emit_branch(A64Code*, uint32_t, A64FixupKind, size_t);
+void a64_emit_offset(A64Code*, size_t, size_t);
+int a64_resolve_labels(A64Code*);
+void a64_free(A64Code*);
+
+void a64_add_symbol(A64SymbolList*, const char*, size_t);
+void a64_free_symbols(A64SymbolList*);
+
+const char* a64_cond_name(A64Cond);
+A64Cond a64_invert_cond(A64Cond);
+int a64_cond_nzcv(A64Cond, int);
+
+uint32_t a64_reg_op(A64RegOp, int, int, int, int);
+uint32_t a64_shifted_op(A64RegOp, int, int, int, int, A64Shift, int);
+uint32_t a64_addsub_imm(int, int, int, int, int, uint32_t, int);
+uint32_t a64_movz(int, int, uint32_t, int);
+uint32_t a64_movn(int, int, uint32_t, int);
+uint32_t a64_movk(int, int, uint32_t, int);
+uint32_t a64_madd(int, int, int, int, int, int);
+uint32_t a64_mul_long(int, int, int, int);
+uint32_t a64_mul_high(int, int, int, int);
+uint32_t a64_bitfield(int, int, int, int, int, int);
+uint32_t a64_csinc(int, int, int, int, A64Cond);
+uint32_t a64_cond_select(A64CondSelect, int, int, int, int, A64Cond);
+uint32_t a64_ccmp(int, int, int, int, A64Cond);
+uint32_t a64_ccmp_imm(int, int, int, int, A64Cond);
+uint32_t a64_logical_imm(A64RegOp, int, int, int, uint32_t);
+uint32_t a64_mem_uimm(int, int, int, int, uint32_t);
+uint32_t a64_mem_unscaled(int, int, int, int, int);
+uint32_t a64_mem_index(int, int, int, int);
+uint32_t a64_adr(int);
+uint32_t a64_br(int);
+uint32_t a64_b(void);
+uint32_t a64_bl(void);
+uint32_t a64_bcond(A64Cond);
+uint32_t a64_cbz(int, int, int);
+uint32_t a64_ret(void);
+uint32_t a64_svc(uint32_t);
+
+int a64_mov_parts(int, uint64_t, A64MovPart*);
+int a64_bitmask_imm(int, uint64_t, uint32_t*);
+int a64_mov_bitmask(int, uint64_t, uint32_t*);
+void a64_mov_imm(A64Code*, int, int, uint64_t);
+int a64_addsub_fits(long);
+int a64_scaled_offset(int, long);
+int a64_stack_access(A64Code*, int, int, int, long);
+int a64_add_imm(A64Code*, int, int, int, int, long);
+
+#endif
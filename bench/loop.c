@@ -0,0 +1,18 @@
+int main() {
+  int sum = 0;
+  int i = 0;
+  while(i < 3000) {
+    int j = 0;
+    while(j < 1000) {
+      sum = sum + (i * j) % 7;
+      if(sum & 1) {
+        sum = sum ^ j;
+      } else {
+        sum = sum - (j >> 2);
+      }
+      j = j + 1;
+    }
+    i = i + 1;
+  }
+  return sum & 255;
+}
@@ -0,0 +1,750 @@
+#include "bytecode.h"
+#include "generator.h"
+#include "parser.h"
+#include "summary.h"
+#include "symbol.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Register 0 gets every statement's value, deeper operands count up
+#define MAX_BC_REG 255
+
+// A node still to be compiled, or the code that follows its operands
+typedef struct BcWork_s {
+  ExpressionNode* exp;
+  int emit;
+  int phase;
+  int reg;
+  int tag0;
+  int tag1;
+  long offset; // Frame offset of the variable written
+} BcWork;
+
+// Per-function state of the compiler
+typedef struct BcBuilder_s {
+  BcFunction* bf;
+  FunctionSummary* summary;
+  SymbolTable* top_st;
+  long stack_offset;
+  int tag_counter;
+  int continue_tag;
+  int break_tag;
+  long* label_pc;     // Tag -> instruction
+  size_t label_capacity;
+  size_t* fixups;     // Instructions whose imm is still a tag
+  size_t fixup_count;
+  size_t fixup_capacity;
+  BcWork* work;
+  size_t work_count;
+  size_t work_capacity;
+} BcBuilder;
+
+void compile_function(FunctionNode*, BcFunction*);
+void compile_block(BcBuilder*, BlockNode*, int);
+void compile_declaration(BcBuilder*, DeclarationNode*);
+void compile_statement(BcBuilder*, StatementNode*, int);
+void compile_condition_jump(BcBuilder*, ExpressionNode*, BcOp, int);
+void compile_switch(BcBuilder*, StatementNode*, int);
+void compile_expression(BcBuilder*, int, ExpressionNode*);
+void expand_expression(BcBuilder*, BcWork*);
+void emit_expression_step(BcBuilder*, BcWork*);
+void emit_literal(BcBuilder*, int, int, long);
+void emit_store(BcBuilder*, int, int, long);
+size_t bc_emit(BcBuilder*, BcOp, int, int, int, long);
+void bc_jump(BcBuilder*, BcOp, int, int);
+void bc_label(BcBuilder*, size_t);
+void resolve_tags(BcBuilder*);
+void push_bc_work(BcBuilder*, BcWork);
+long find_frame_offset(BcBuilder*, char*);
+void check_bc_reg(int);
+
+const BcOp bc_binary_ops[] = {
+  [ADD_BINEXP] = BC_ADD_W, [SUB_BINEXP] = BC_SUB_W, [MUL_BINEXP] = BC_MUL_W,
+  [BITAND_BINEXP] = BC_AND_W, [BITOR_BINEXP] = BC_OR_W,
+  [BITXOR_BINEXP] = BC_XOR_W, [LSHIFT_BINEXP] = BC_SHL_W,
+  [RSHIFT_BINEXP] = BC_SAR_W, [EQ_BINEXP] = BC_EQ_W, [NEQ_BINEXP] = BC_NE_W,
+  [GT_BINEXP] = BC_GT_W, [GEQ_BINEXP] = BC_GE_W, [LT_BINEXP] = BC_LT_W,
+  [LEQ_BINEXP] = BC_LE_W, [PLUSEQ_EXP] = BC_ADD_W, [MINUSEQ_EXP] = BC_SUB_W,
+  [TIMESEQ_EXP] = BC_MUL_W, [ANDEQ_EXP] = BC_AND_W, [OREQ_EXP] = BC_OR_W,
+  [XOREQ_EXP] = BC_XOR_W, [LSHEQ_EXP] = BC_SHL_W, [RSHEQ_EXP] = BC_SAR_W
+};
+
+// Indexed by access size
+const BcOp bc_load_ops[] = {
+  [1] = BC_LOAD8, [2] = BC_LOAD16, [4] = BC_LOAD32, [8] = BC_LOAD64
+};
+
+const BcOp bc_store_ops[] = {
+  [1] = BC_STORE8, [2] = BC_STORE16, [4] = BC_STORE32, [8] = BC_STORE64
+};
+
+BcProgram compile_bytecode(ProgramNode prgm)
+{
+  BcProgram bc = {NULL, prgm.function_count, NULL};
+  bc.functions = calloc(prgm.function_count, sizeof(BcFunction));
+  if(!bc.functions) {
+    perror("Error");
+    exit(1);
+  }
+  for(size_t i = 0; i < prgm.function_count; i++) {
+    compile_function(prgm.functions[i], &bc.functions[i]);
+    if(prgm.functions[i] == prgm.main) {
+      bc.main = &bc.functions[i];
+    }
+  }
+  return bc;
+}
+
+void free_bytecode(BcProgram* bc)
+{
+  for(size_t i = 0; i < bc->count; i++) {
+    BcFunction* bf = &bc->functions[i];
+    for(size_t s = 0; s < bf->switch_count; s++) {
+      free(bf->switches[s].vals);
+      free(bf->switches[s].targets);
+    }
+    free(bf->switches);
+    free(bf->consts);
+    free(bf->code);
+  }
+  free(bc->functions);
+  memset(bc, 0, sizeof(BcProgram));
+}
+
+// Mirrors write_function_assembly: same frame layout, same labels
+void compile_function(FunctionNode* func, BcFunction* bf)
+{
+  BcBuilder b;
+  memset(&b, 0, sizeof(BcBuilder));
+  b.bf = bf;
+  bf->name = func->name;
+  bf->reg_count = 1;
+  b.summary = summarize_function(func, &b.tag_counter);
+  b.stack_offset = b.summary->locals_size;
+  if(b.stack_offset % 16) {
+    b.stack_offset += 16 - b.stack_offset % 16;
+  }
+  bf->frame_size = b.stack_offset;
+  int ret_tag = b.tag_counter++;
+  b.continue_tag = -1;
+  b.break_tag = -1;
+  compile_block(&b, func->body, ret_tag);
+  bc_label(&b, ret_tag);
+  bc_emit(&b, BC_RET, 0, 0, 0, 0);
+  resolve_tags(&b);
+  delete_function_summary(b.summary);
+  free(b.label_pc);
+  free(b.fixups);
+  free(b.work);
+}
+
+void compile_block(BcBuilder* b, BlockNode* block, int ret_tag)
+{
+  SymbolTable* block_st = malloc(sizeof(SymbolTable));
+  block_st->top = NULL;
+  block_st->next = b->top_st;
+  b->top_st = block_st;
+  push_constructed_symbol(NULL, 0, block_st);
+  for(size_t i = 0; i < block->count; i++) {
+    BlockItem* item = block->body[i];
+    if(item->type == STATEMENT_ITEM) {
+      compile_statement(b, item->stmt, ret_tag);
+    } else {
+      compile_declaration(b, item->decl);
+    }
+  }
+  b->top_st = block_st->next;
+  delete_symbol_table(block_st);
+}
+
+void compile_declaration(BcBuilder* b, DeclarationNode* decl)
+{
+  if(find_symbol(decl->var_name, b->top_st).name) {
+    puts("Error: duplicate declaration of variable:");
+    puts(decl->var_name);
+    exit(1);
+  }
+  push_constructed_symbol(decl->var_name,
+                          find_slot_offset(b->summary, decl), b->top_st);
+  if(decl->assignment_expression) {
+    compile_expression(b, 0, decl->assignment_expression);
+  }
+}
+
+void compile_statement(BcBuilder* b, StatementNode* stmt, int ret_tag)
+{
+  int last_continue_tag = b->continue_tag;
+  int last_break_tag = b->break_tag;
+  int tag0;
+  int tag1;
+  int tag2;
+  size_t label;
+  SymbolTable* for_st;
+  switch(stmt->type) {
+  case RETURN_STATEMENT:
+    compile_expression(b, 0, stmt->expression);
+    bc_jump(b, BC_JMP, 0, ret_tag);
+    break;
+  case CONDITIONAL:
+    tag0 = b->tag_counter++;
+    tag1 = stmt->else_stmt ? b->tag_counter++ : -1;
+    compile_expression(b, 0, stmt->condition);
+    compile_condition_jump(b, stmt->condition, BC_JZ_W, tag0);
+    compile_statement(b, stmt->if_stmt, ret_tag);
+    if(stmt->else_stmt) {
+      bc_jump(b, BC_JMP, 0, tag1);
+    }
+    bc_label(b, tag0);
+    if(stmt->else_stmt) {
+      compile_statement(b, stmt->else_stmt, ret_tag);
+      bc_label(b, tag1);
+    }
+    break;
+  case WHILE_LOOP:
+    tag0 = b->tag_counter++;
+    tag1 = b->tag_counter++;
+    b->continue_tag = tag0;
+    b->break_tag = tag1;
+    compile_expression(b, 0, stmt->loop_condition);
+    compile_condition_jump(b, stmt->loop_condition, BC_JZ_W, tag1);
+    bc_label(b, tag0);
+    compile_statement(b, stmt->loop_stmt, ret_tag);
+    compile_expression(b, 0, stmt->loop_condition);
+    compile_condition_jump(b, stmt->loop_condition, BC_JNZ_W, tag0);
+    bc_label(b, tag1);
+    break;
+  case DO_LOOP:
+    tag0 = b->tag_counter++;
+    tag1 = b->tag_counter++;
+    b->continue_tag = tag0;
+    b->break_tag = tag1;
+    bc_label(b, tag0);
+    compile_statement(b, stmt->loop_stmt, ret_tag);
+    compile_expression(b, 0, stmt->loop_condition);
+    compile_condition_jump(b, stmt->loop_condition, BC_JNZ_W, tag0);
+    bc_label(b, tag1);
+    break;
+  case FOR_LOOP:
+  case FORDECL_LOOP:
+    tag0 = b->tag_counter++;
+    tag1 = b->tag_counter++;
+    tag2 = b->tag_counter++;
+    b->continue_tag = tag2;
+    b->break_tag = tag1;
+    for_st = NULL;
+    if(stmt->type == FORDECL_LOOP) {
+      for_st = malloc(sizeof(SymbolTable));
+      for_st->top = NULL;
+      for_st->next = b->top_st;
+      b->top_st = for_st;
+      push_constructed_symbol(NULL, 0, for_st);
+      compile_declaration(b, stmt->init_decl);
+    } else {
+      compile_expression(b, 0, stmt->init_exp);
+    }
+    bc_label(b, tag0);
+    if(stmt->loop_condition->type != EMPTY_EXP) {
+      compile_expression(b, 0, stmt->loop_condition);
+      compile_condition_jump(b, stmt->loop_condition, BC_JZ_W, tag1);
+    }
+    compile_statement(b, stmt->loop_stmt, ret_tag);
+    bc_label(b, tag2);
+    compile_expression(b, 0, stmt->post_exp);
+    bc_jump(b, BC_JMP, 0, tag0);
+    bc_label(b, tag1);
+    if(for_st) {
+      b->top_st = for_st->next;
+      delete_symbol_table(for_st);
+    }
+    break;
+  case CONTINUE_STATEMENT:
+    if(b->continue_tag < 0) {
+      puts("Error: continue not in loop.");
+      exit(1);
+    }
+    bc_jump(b, BC_JMP, 0, b->continue_tag);
+    break;
+  case BREAK_STATEMENT:
+    if(b->break_tag < 0) {
+      puts("Error: break not in loop.");
+      exit(1);
+    }
+    bc_jump(b, BC_JMP, 0, b->break_tag);
+    break;
+  case BLOCK_STATEMENT:
+    compile_block(b, stmt->block, ret_tag);
+    break;
+  case SWITCH_STATEMENT:
+    tag0 = b->tag_counter++;
+    b->break_tag = tag0;
+    compile_expression(b, 0, stmt->switch_exp);
+    compile_switch(b, stmt, tag0);
+    compile_block(b, stmt->switch_block, ret_tag);
+    bc_label(b, tag0);
+    break;
+  case CASE_STATEMENT:
+  case DEFAULT_STATEMENT:
+    bc_label(b, find_case_tag(b->summary, stmt));
+    break;
+  case GOTO_STATEMENT:
+    if(!find_label_tag(b->summary, stmt->label_name, &label)) {
+      puts("Error: Could not find label for goto");
+      puts(stmt->label_name);
+      exit(1);
+    }
+    bc_jump(b, BC_JMP, 0, label);
+    break;
+  case LABEL:
+    find_label_tag(b->summary, stmt->label_name, &label);
+    bc_label(b, label);
+    break;
+  case EXPRESSION:
+    compile_expression(b, 0, stmt->expression);
+    break;
+  default:
+    break;
+  }
+  // continue and break only change inside the loop or switch
+  b->continue_tag = last_continue_tag;
+  b->break_tag = last_break_tag;
+}
+
+// Tests register 0 at the width of the condition's type
+void compile_condition_jump(BcBuilder* b, ExpressionNode* cond, BcOp op,
+                            int tag)
+{
+  bc_jump(b, op + is_wide_type(cond->value_type), 0, tag);
+}
+
+// The table keeps source order, which is also the order the native code
+// compares in. Targets are tags until resolve_tags.
+void compile_switch(BcBuilder* b, StatementNode* stmt, int break_tag)
+{
+  BcFunction* bf = b->bf;
+  SwitchSummary* sw = find_switch_summary(b->summary, stmt);
+  if(bf->switch_count == bf->switch_capacity) {
+    bf->switch_capacity = bf->switch_capacity ? 2 * bf->switch_capacity : 4;
+    bf->switches = realloc(bf->switches,
+                           sizeof(BcSwitch) * bf->switch_capacity);
+    if(!bf->switches) {
+      perror("Error");
+      exit(1);
+    }
+  }
+  BcSwitch* table = &bf->switches[bf->switch_count];
+  table->count = sw->case_count;
+  table->vals = malloc(sizeof(long) * (sw->case_count + 1));
+  table->targets = malloc(sizeof(uint32_t) * (sw->case_count + 1));
+  if(!table->vals || !table->targets) {
+    perror("Error");
+    exit(1);
+  }
+  for(size_t i = 0; i < sw->case_count; i++) {
+    table->vals[i] = sw->cases[i].val;
+    table->targets[i] = sw->cases[i].tag;
+  }
+  table->default_target = sw->has_default ? sw->default_tag : (size_t)break_tag;
+  bc_emit(b, BC_SWITCH, 0, 0, 0, bf->switch_count++);
+}
+
+// Same evaluation order and registers as flatten_expression, with an
+// explicit work stack so deep nesting costs no C stack
+void compile_expression(BcBuilder* b, int reg, ExpressionNode* root)
+{
+  push_bc_work(b, (BcWork){.exp = root, .reg = reg});
+  while(b->work_count) {
+    BcWork work = b->work[--b->work_count];
+    if(work.emit) {
+      emit_expression_step(b, &work);
+    } else {
+      expand_expression(b, &work);
+    }
+  }
+}
+
+void expand_expression(BcBuilder* b, BcWork* work)
+{
+  ExpressionNode* exp = work->exp;
+  int reg = work->reg;
+  BcWork step = {.exp = exp, .emit = 1, .reg = reg};
+  switch(exp->type) {
+  case CHAR_VALUE:
+  case UCHAR_VALUE:
+  case SHORT_VALUE:
+  case USHORT_VALUE:
+  case INT_VALUE:
+  case UINT_VALUE:
+  case LONG_VALUE:
+  case ULONG_VALUE:
+  case LONGLONG_VALUE:
+  case ULONGLONG_VALUE:
+  case VAR_EXP:
+    if(exp->type == VAR_EXP) {
+      step.offset = find_frame_offset(b, exp->var_name);
+    }
+    emit_expression_step(b, &step);
+    break;
+  case NEGATE:
+  case BITWISE_COMP:
+  case LOG_NOT:
+    push_bc_work(b, step);
+    push_bc_work(b, (BcWork){.exp = exp->unary_operand, .reg = reg});
+    break;
+  case ADD_BINEXP:
+  case SUB_BINEXP:
+  case MUL_BINEXP:
+  case DIV_BINEXP:
+  case MOD_BINEXP:
+  case EQ_BINEXP:
+  case NEQ_BINEXP:
+  case GT_BINEXP:
+  case GEQ_BINEXP:
+  case LT_BINEXP:
+  case LEQ_BINEXP:
+  case BITAND_BINEXP:
+  case BITOR_BINEXP:
+  case BITXOR_BINEXP:
+  case LSHIFT_BINEXP:
+  case RSHIFT_BINEXP:
+    check_bc_reg(reg + (exp->type == MOD_BINEXP ? 2 : 1));
+    push_bc_work(b, step);
+    push_bc_work(b, (BcWork){.exp = exp->right_operand, .reg = reg + 1});
+    push_bc_work(b, (BcWork){.exp = exp->left_operand, .reg = reg});
+    break;
+  case AND_BINEXP:
+  case OR_BINEXP:
+    step.tag0 = b->tag_counter++;
+    step.tag1 = b->tag_counter++;
+    push_bc_work(b, step);
+    push_bc_work(b, (BcWork){.exp = exp->right_operand, .reg = reg});
+    step.phase = 1;
+    push_bc_work(b, step);
+    push_bc_work(b, (BcWork){.exp = exp->left_operand, .reg = reg});
+    break;
+  case ASSIGN_EXP:
+    step.offset = find_frame_offset(b, exp->left_operand->var_name);
+    push_bc_work(b, step);
+    push_bc_work(b, (BcWork){.exp = exp->right_operand, .reg = reg});
+    break;
+  case PLUSEQ_EXP:
+  case MINUSEQ_EXP:
+  case TIMESEQ_EXP:
+  case DIVEQ_EXP:
+  case MODEQ_EXP:
+  case LSHEQ_EXP:
+  case RSHEQ_EXP:
+  case ANDEQ_EXP:
+  case OREQ_EXP:
+  case XOREQ_EXP:
+    step.offset = find_frame_offset(b, exp->left_operand->var_name);
+    check_bc_reg(reg + (exp->type == MODEQ_EXP ? 2 : 1));
+    push_bc_work(b, step);
+    push_bc_work(b, (BcWork){.exp = exp->left_operand, .reg = reg});
+    push_bc_work(b, (BcWork){.exp = exp->right_operand, .reg = reg + 1});
+    break;
+  case PREINC_EXP:
+  case PREDEC_EXP:
+  case POSTINC_EXP:
+  case POSTDEC_EXP:
+    step.offset = find_frame_offset(b, exp->left_operand->var_name);
+    check_bc_reg(reg + 1);
+    push_bc_work(b, step);
+    push_bc_work(b, (BcWork){.exp = exp->left_operand, .reg = reg});
+    break;
+  case COMMA_EXP:
+    push_bc_work(b, (BcWork){.exp = exp->right_operand, .reg = reg});
+    push_bc_work(b, (BcWork){.exp = exp->left_operand, .reg = reg});
+    break;
+  case COND_EXP:
+    step.tag0 = b->tag_counter++;
+    step.tag1 = b->tag_counter++;
+    push_bc_work(b, step);
+    push_bc_work(b, (BcWork){.exp = exp->else_exp, .reg = reg});
+    step.phase = 2;
+    push_bc_work(b, step);
+    push_bc_work(b, (BcWork){.exp = exp->if_exp, .reg = reg});
+    step.phase = 1;
+    push_bc_work(b, step);
+    push_bc_work(b, (BcWork){.exp = exp->condition, .reg = reg});
+    break;
+  default:
+    break;
+  }
+}
+
+// Widths and sizes come from the node's type the way write_expression_step
+// takes them, so every intermediate value matches the native code's
+void emit_expression_step(BcBuilder* b, BcWork* step)
+{
+  ExpressionNode* exp = step->exp;
+  int reg = step->reg;
+  int sf = is_wide_type(exp->value_type);
+  int size = access_size_for_type(exp->value_type, sf);
+  BcOp div_op = exp->value_type.signed_ ? BC_SDIV_W : BC_UDIV_W;
+  switch(exp->type) {
+  case CHAR_VALUE:
+    emit_literal(b, 0, reg, exp->char_value);
+    break;
+  case UCHAR_VALUE:
+    emit_literal(b, 0, reg, exp->uchar_value);
+    break;
+  case SHORT_VALUE:
+    emit_literal(b, 0, reg, exp->short_value);
+    break;
+  case USHORT_VALUE:
+    emit_literal(b, 0, reg, exp->ushort_value);
+    break;
+  case INT_VALUE:
+    emit_literal(b, 0, reg, exp->int_value);
+    break;
+  case UINT_VALUE:
+    emit_literal(b, 0, reg, exp->uint_value);
+    break;
+  case LONG_VALUE:
+  case ULONG_VALUE:
+  case LONGLONG_VALUE:
+  case ULONGLONG_VALUE:
+    emit_literal(b, 1, reg,
+                 exp->type == LONG_VALUE ? exp->long_value
+                 : exp->type == ULONG_VALUE ? (long)exp->ulong_value
+                 : exp->type == LONGLONG_VALUE ? (long)exp->longlong_value
+                 : (long)exp->ulonglong_value);
+    break;
+  case VAR_EXP:
+    bc_emit(b, bc_load_ops[size], reg, 0, 0, step->offset);
+    break;
+  case NEGATE:
+    bc_emit(b, BC_NEG_W + sf, reg, reg, 0, 0);
+    break;
+  case BITWISE_COMP:
+    bc_emit(b, BC_NOT_W + sf, reg, reg, 0, 0);
+    break;
+  case LOG_NOT:
+    bc_emit(b, BC_ISZERO_W + sf, reg, reg, 0, 0);
+    break;
+  case ADD_BINEXP:
+  case SUB_BINEXP:
+  case MUL_BINEXP:
+  case EQ_BINEXP:
+  case NEQ_BINEXP:
+  case GT_BINEXP:
+  case GEQ_BINEXP:
+  case LT_BINEXP:
+  case LEQ_BINEXP:
+  case BITAND_BINEXP:
+  case BITOR_BINEXP:
+  case BITXOR_BINEXP:
+  case LSHIFT_BINEXP:
+  case RSHIFT_BINEXP:
+    bc_emit(b, bc_binary_ops[exp->type] + sf, reg, reg, reg + 1, 0);
+    break;
+  case DIV_BINEXP:
+    bc_emit(b, div_op + sf, reg, reg, reg + 1, 0);
+    break;
+  case MOD_BINEXP:
+    bc_emit(b, div_op + sf, reg + 2, reg, reg + 1, 0);
+    bc_emit(b, BC_MSUB_W + sf, reg, reg + 1, reg + 2, 0);
+    break;
+  case AND_BINEXP:
+  case OR_BINEXP:
+    // Both operands jump to tag0 on the value that decides the result
+    bc_jump(b, (exp->type == AND_BINEXP ? BC_JZ_W : BC_JNZ_W) + sf, reg,
+            step->tag0);
+    if(step->phase == 1) {
+      break;
+    }
+    emit_literal(b, sf, reg, exp->type == AND_BINEXP);
+    bc_jump(b, BC_JMP, 0, step->tag1);
+    bc_label(b, step->tag0);
+    emit_literal(b, sf, reg, exp->type != AND_BINEXP);
+    bc_label(b, step->tag1);
+    break;
+  case ASSIGN_EXP:
+    emit_store(b, variable_access_size(exp->left_operand), reg,
+               step->offset);
+    break;
+  case PLUSEQ_EXP:
+  case MINUSEQ_EXP:
+  case TIMESEQ_EXP:
+  case LSHEQ_EXP:
+  case RSHEQ_EXP:
+  case ANDEQ_EXP:
+  case OREQ_EXP:
+  case XOREQ_EXP:
+  case DIVEQ_EXP:
+  case MODEQ_EXP:
+    if(exp->type == DIVEQ_EXP) {
+      bc_emit(b, div_op + sf, reg, reg, reg + 1, 0);
+    } else if(exp->type == MODEQ_EXP) {
+      bc_emit(b, div_op + sf, reg + 2, reg, reg + 1, 0);
+      bc_emit(b, BC_MSUB_W + sf, reg, reg + 1, reg + 2, 0);
+    } else {
+      bc_emit(b, bc_binary_ops[exp->type] + sf, reg, reg, reg + 1, 0);
+    }
+    emit_store(b, variable_access_size(exp->left_operand), reg,
+               step->offset);
+    break;
+  case PREINC_EXP:
+  case PREDEC_EXP:
+    bc_emit(b, BC_ADDI_W + sf, reg, reg, 0,
+            exp->type == PREINC_EXP ? 1 : -1);
+    emit_store(b, size, reg, step->offset);
+    break;
+  case POSTINC_EXP:
+  case POSTDEC_EXP:
+    bc_emit(b, BC_ADDI_W + sf, reg + 1, reg, 0,
+            exp->type == POSTINC_EXP ? 1 : -1);
+    emit_store(b, size, reg + 1, step->offset);
+    break;
+  case COND_EXP:
+    if(step->phase == 1) {
+      bc_jump(b, BC_JZ_W + sf, reg, step->tag0);
+    } else if(step->phase == 2) {
+      bc_jump(b, BC_JMP, 0, step->tag1);
+      bc_label(b, step->tag0);
+    } else {
+      bc_label(b, step->tag1);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+// 32 bit literals keep their low half, like a mov to a w register
+void emit_literal(BcBuilder* b, int sf, int reg, long value)
+{
+  if(!sf) {
+    bc_emit(b, BC_MOV_W, reg, 0, 0, (int32_t)(uint32_t)value);
+    return;
+  }
+  if(value >= INT32_MIN && value <= INT32_MAX) {
+    bc_emit(b, BC_MOV_X, reg, 0, 0, value);
+    return;
+  }
+  BcFunction* bf = b->bf;
+  if(bf->const_count == bf->const_capacity) {
+    bf->const_capacity = bf->const_capacity ? 2 * bf->const_capacity : 16;
+    bf->consts = realloc(bf->consts, sizeof(long) * bf->const_capacity);
+    if(!bf->consts) {
+      perror("Error");
+      exit(1);
+    }
+  }
+  bf->consts[bf->const_count] = value;
+  bc_emit(b, BC_CONST, reg, 0, 0, bf->const_count++);
+}
+
+void emit_store(BcBuilder* b, int size, int reg, long offset)
+{
+  bc_emit(b, bc_store_ops[size], reg, 0, 0, offset);
+}
+
+size_t bc_emit(BcBuilder* b, BcOp op, int a, int rb, int rc, long imm)
+{
+  BcFunction* bf = b->bf;
+  if(bf->count == bf->capacity) {
+    bf->capacity = bf->capacity ? 2 * bf->capacity : 256;
+    bf->code = realloc(bf->code, sizeof(BcInsn) * bf->capacity);
+    if(!bf->code) {
+      perror("Error");
+      exit(1);
+    }
+  }
+  int highest = a > rb ? a : rb;
+  highest = highest > rc ? highest : rc;
+  if(highest >= bf->reg_count) {
+    bf->reg_count = highest + 1;
+  }
+  bf->code[bf->count] = (BcInsn){op, a, rb, rc, imm};
+  return bf->count++;
+}
+
+// imm holds the tag until resolve_tags
+void bc_jump(BcBuilder* b, BcOp op, int reg, int tag)
+{
+  size_t at = bc_emit(b, op, reg, 0, 0, tag);
+  if(b->fixup_count == b->fixup_capacity) {
+    b->fixup_capacity = b->fixup_capacity ? 2 * b->fixup_capacity : 64;
+    b->fixups = realloc(b->fixups, sizeof(size_t) * b->fixup_capacity);
+    if(!b->fixups) {
+      perror("Error");
+      exit(1);
+    }
+  }
+  b->fixups[b->fixup_count++] = at;
+}
+
+void bc_label(BcBuilder* b, size_t tag)
+{
+  if(tag >= b->label_capacity) {
+    size_t new_capacity = b->label_capacity ? b->label_capacity : 64;
+    while(tag >= new_capacity) {
+      new_capacity *= 2;
+    }
+    b->label_pc = realloc(b->label_pc, sizeof(long) * new_capacity);
+    if(!b->label_pc) {
+      perror("Error");
+      exit(1);
+    }
+    for(size_t i = b->label_capacity; i < new_capacity; i++) {
+      b->label_pc[i] = -1;
+    }
+    b->label_capacity = new_capacity;
+  }
+  b->label_pc[tag] = b->bf->count;
+}
+
+void resolve_tags(BcBuilder* b)
+{
+  BcFunction* bf = b->bf;
+  for(size_t i = 0; i < b->fixup_count; i++) {
+    BcInsn* insn = &bf->code[b->fixups[i]];
+    insn->imm = b->label_pc[insn->imm];
+  }
+  for(size_t s = 0; s < bf->switch_count; s++) {
+    BcSwitch* table = &bf->switches[s];
+    for(size_t i = 0; i < table->count; i++) {
+      table->targets[i] = b->label_pc[table->targets[i]];
+    }
+    table->default_target = b->label_pc[table->default_target];
+  }
+}
+
+void push_bc_work(BcBuilder* b, BcWork work)
+{
+  if(b->work_count == b->work_capacity) {
+    b->work_capacity = b->work_capacity ? 2 * b->work_capacity : 64;
+    b->work = realloc(b->work, sizeof(BcWork) * b->work_capacity);
+    if(!b->work) {
+      perror("Error");
+      exit(1);
+    }
+  }
+  b->work[b->work_count++] = work;
+}
+
+// Byte offset of the variable from the bottom of the frame
+long find_frame_offset(BcBuilder* b, char* name)
+{
+  for(SymbolTable* st = b->top_st; st; st = st->next) {
+    Symbol sym = find_symbol(name, st);
+    if(sym.name) {
+      return b->stack_offset - sym.offset;
+    }
+  }
+  puts("Error: Symbol not found:");
+  puts(name);
+  exit(1);
+}
+
+void check_bc_reg(int reg)
+{
+  if(reg > MAX_BC_REG) {
+    puts("Error: expression too deep for the bytecode registers");
+    exit(1);
+  }
+}
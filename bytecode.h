@@ -0,0 +1,117 @@
+#ifndef BYTECODE_H_
+#define BYTECODE_H_
+
+#include "parser.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Register bytecode for vm.c, compiled straight from the syntax tree.
+// Registers are numbered the way the generator numbers them and hold 64
+// bits. _W operations work on the low 32 and zero the rest, like a w
+// register, so a program computes the same values here as on AArch64.
+typedef enum BcOp_e {
+  BC_MOV_W,   // a = imm
+  BC_MOV_X,
+  BC_CONST,   // a = consts[imm], for literals that need 64 bits
+  BC_NEG_W,   // a = op b
+  BC_NEG_X,
+  BC_NOT_W,
+  BC_NOT_X,
+  BC_ISZERO_W,
+  BC_ISZERO_X,
+  BC_ADD_W,   // a = b op c
+  BC_ADD_X,
+  BC_SUB_W,
+  BC_SUB_X,
+  BC_MUL_W,
+  BC_MUL_X,
+  BC_SDIV_W,
+  BC_SDIV_X,
+  BC_UDIV_W,
+  BC_UDIV_X,
+  BC_AND_W,
+  BC_AND_X,
+  BC_OR_W,
+  BC_OR_X,
+  BC_XOR_W,
+  BC_XOR_X,
+  BC_SHL_W,
+  BC_SHL_X,
+  BC_SAR_W,
+  BC_SAR_X,
+  BC_EQ_W,    // a = b cmp c ? 1 : 0, signed
+  BC_EQ_X,
+  BC_NE_W,
+  BC_NE_X,
+  BC_GT_W,
+  BC_GT_X,
+  BC_GE_W,
+  BC_GE_X,
+  BC_LT_W,
+  BC_LT_X,
+  BC_LE_W,
+  BC_LE_X,
+  BC_MSUB_W,  // a = a - b * c
+  BC_MSUB_X,
+  BC_ADDI_W,  // a = b + imm
+  BC_ADDI_X,
+  BC_LOAD8,   // a = frame[imm], zero extended
+  BC_LOAD16,
+  BC_LOAD32,
+  BC_LOAD64,
+  BC_STORE8,  // frame[imm] = a
+  BC_STORE16,
+  BC_STORE32,
+  BC_STORE64,
+  BC_JMP,     // imm is the target instruction
+  BC_JZ_W,    // Jump if a is zero
+  BC_JZ_X,
+  BC_JNZ_W,
+  BC_JNZ_X,
+  BC_SWITCH,  // Jump on a through switches[imm]
+  BC_RET,     // Return register 0
+  BC_OP_COUNT
+} BcOp;
+
+typedef struct BcInsn_s {
+  uint8_t op;
+  uint8_t a;
+  uint8_t b;
+  uint8_t c;
+  int32_t imm;
+} BcInsn;
+
+// Case values in source order, compared against all 64 bits
+typedef struct BcSwitch_s {
+  long* vals;
+  uint32_t* targets;
+  size_t count;
+  uint32_t default_target;
+} BcSwitch;
+
+typedef struct BcFunction_s {
+  char* name;
+  BcInsn* code;
+  size_t count;
+  size_t capacity;
+  long* consts;
+  size_t const_count;
+  size_t const_capacity;
+  BcSwitch* switches;
+  size_t switch_count;
+  size_t switch_capacity;
+  size_t frame_size; // Bytes of locals, laid out as on the stack
+  int reg_count;
+} BcFunction;
+
+typedef struct BcProgram_s {
+  BcFunction* functions; // In source order
+  size_t count;
+  BcFunction* main;
+} BcProgram;
+
+BcProgram compile_bytecode(ProgramNode);
+void free_bytecode(BcProgram*);
+
+#endif
@@ -5,33 +5,107 @@
 #include "pprint.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
 void usage(void);
 
 int main(int argc, char** argv)
 {
-  if(argc != 2) {
+  char* filename = NULL;
+  CompileOptions opts = {ASSEMBLY_OUTPUT, NULL, 0, 0, 0, 1,
+                          AARCH64_APPLE_TARGET, {0, 0}};
+  timespec_get(&opts.started, TIME_UTC);
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "-c") == 0) {
+      opts.output_kind = OBJECT_OUTPUT;
+    } else if(strcmp(argv[i], "-static") == 0) {
+      opts.output_kind = EXECUTABLE_OUTPUT;
+    } else if(strcmp(argv[i], "-run") == 0) {
+      opts.output_kind = RUN_OUTPUT;
+    } else if(strcmp(argv[i], "-vm") == 0) {
+      opts.output_kind = VM_OUTPUT;
+    } else if(strcmp(argv[i], "-pipe") == 0) {
+      opts.pipe = 1;
+    } else if(strcmp(argv[i], "-stats") == 0) {
+      opts.stats = 1;
+    } else if(argv[i][0] == '-' && argv[i][1] == 'O') {
+      opts.opt_level = argv[i][2] ? atoi(argv[i] + 2) : 1;
+    } else if(argv[i][0] == '-' && argv[i][1] == 'j' && argv[i][2]) {
+      opts.threads = atoi(argv[i] + 2);
+    } else if(strcmp(argv[i], "-target") == 0 && i + 1 < argc
+              && strcmp(argv[i+1], "aarch64-linux") == 0) {
+      opts.target = AARCH64_LINUX_TARGET;
+      i++;
+    } else if(strcmp(argv[i], "-target") == 0 && i + 1 < argc
+              && strcmp(argv[i+1], "x86_64-linux") == 0) {
+      opts.target = X86_64_LINUX_TARGET;
+      i++;
+    } else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      opts.output = argv[++i];
+    } else if(argv[i][0] == '-' || filename) {
+      usage();
+      exit(1);
+    } else {
+      filename = argv[i];
+    }
+  }
+  // Only AArch64 is encoded to files directly, x86-64 goes through as.
+  // -run encodes x86-64 and -vm compiles to bytecode, neither writes.
+  int run = opts.output_kind == RUN_OUTPUT || opts.output_kind == VM_OUTPUT;
+  if(!filename || (opts.pipe && opts.output_kind == EXECUTABLE_OUTPUT)
+     || (opts.target == X86_64_LINUX_TARGET && !run
+         && opts.output_kind != ASSEMBLY_OUTPUT)
+     || (run && (opts.pipe || opts.output
+                 || opts.target == AARCH64_LINUX_TARGET))) {
     usage();
     exit(1);
   }
-
-  char* filename = argv[1];
+  if(opts.output_kind == RUN_OUTPUT) {
+    opts.target = X86_64_LINUX_TARGET;
+  }
+  // Keep stdout clean when the output goes there or the program runs
+  int quiet = run || (opts.output && !strcmp(opts.output, "-"));
 
   TokenList* lexemes = lex(filename);
 
-  print_lexemes(lexemes);
+  if(!quiet) {
+    print_lexemes(lexemes);
+  }
 
   ProgramNode program = parse(lexemes);
 
-  pretty_print(program);
-
-  generate_assembly(program, filename);
+  if(!quiet) {
+    pretty_print(program);
+  }
 
-  return 0;
+  return generate(program, filename, &opts);
 }
 
 void usage()
 {
   puts("C Compiler\n----------\n\n");
-  puts("Only call with one argument,\n the filename of c file to compile.");
+  puts("Usage: compiler [-c | -static | -pipe | -run | -vm] [-O<n>] [-j<n>]"
+       " [-target name] [-o output] file.c\n");
+  puts("Compiles file.c to AArch64 assembly in file.s.");
+  puts("  -c         Encode the program directly and write an ELF64 object");
+  puts("  -static    Write a static Linux executable, no as or ld needed");
+  puts("  -pipe      Stream the assembly into the system as to get an object");
+  puts("  -run       Compile for x86-64 into memory, run main and exit with");
+  puts("             its result, -stats also reports the startup latency");
+  puts("  -vm        Run main in the bytecode interpreter instead, on any");
+  puts("             host, -stats also reports instructions per second");
+  puts("  -o output  Write to output instead, - for stdout");
+  puts("  -O1        Optimize, -O0 (default) turns it off. Peephole rules");
+  puts("             and duplicated epilogues, and for AArch64 also locals");
+  puts("             in registers, shrink-wrapping, selects for ?: and if,");
+  puts("             switch lookup tables, strength-reduced multiply and");
+  puts("             divide by constants, and immediate operands");
+  puts("  -stats     Print what the optimizer did to stderr");
+  puts("  -j<n>      Generate functions on n threads, output is the same");
+  puts("  -target aarch64-linux");
+  puts("             Write GNU as syntax and ELF symbol names");
+  puts("  -target x86_64-linux");
+  puts("             Write x86-64 GNU assembly, -pipe assembles it");
 }
@@ -0,0 +1,218 @@
+#include "elfwriter.h"
+#include "emitter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EHDR_SIZE 64
+#define PHDR_SIZE 56
+#define SHDR_SIZE 64
+#define SYM_SIZE 24
+
+#define EM_AARCH64 183
+#define ET_REL 1
+#define ET_EXEC 2
+
+#define PT_LOAD 1
+#define PF_X 1
+#define PF_R 4
+#define LOAD_ADDRESS 0x400000
+#define PAGE_ALIGN 0x10000
+
+#define SHT_PROGBITS 1
+#define SHT_SYMTAB 2
+#define SHT_STRTAB 3
+#define SHF_ALLOC 2
+#define SHF_EXECINSTR 4
+
+#define STB_LOCAL 0
+#define STB_GLOBAL 1
+#define STT_FUNC 2
+#define STT_SECTION 3
+
+typedef enum SectionIndex_e {
+  NULL_SECTION = 0,
+  TEXT_SECTION,
+  NOTE_SECTION,
+  SYMTAB_SECTION,
+  STRTAB_SECTION,
+  SHSTRTAB_SECTION,
+  SECTION_COUNT
+} SectionIndex;
+
+void put_u8(Emitter*, uint8_t);
+void put_u16(Emitter*, uint16_t);
+void put_u32(Emitter*, uint32_t);
+void put_u64(Emitter*, uint64_t);
+void pad_to(Emitter*, size_t);
+void put_section_header(Emitter*, uint32_t, uint32_t, uint64_t, uint64_t,
+                        uint64_t, uint32_t, uint32_t, uint64_t, uint64_t);
+void put_elf_header(Emitter*, uint16_t, uint64_t, uint64_t, uint64_t,
+                    uint16_t, uint16_t, uint16_t);
+
+const char shstrtab[] = "\0.text\0.note.GNU-stack\0.symtab\0.strtab\0.shstrtab";
+
+// Emits the code as the .text section of an ELF64 relocatable object
+// with every symbol as a global function.
+void emit_elf_object(Emitter* out, A64Code* code, A64SymbolList* syms)
+{
+  size_t text_size = code->count * 4;
+
+  // String table for symbol names
+  Emitter strtab;
+  emitter_init(&strtab);
+  emit_char(&strtab, '\0');
+
+  size_t text_off = EHDR_SIZE;
+  size_t symtab_off = (text_off + text_size + 7) & ~(size_t)7;
+  size_t n_syms = 2 + syms->count;
+  size_t strtab_off = symtab_off + n_syms * SYM_SIZE;
+
+  // Build the symbol table before laying out the string tables
+  Emitter symtab;
+  emitter_init(&symtab);
+  for(int i = 0; i < SYM_SIZE; i++) {
+    put_u8(&symtab, 0);
+  }
+  put_u32(&symtab, 0); // .text section symbol
+  put_u8(&symtab, STB_LOCAL << 4 | STT_SECTION);
+  put_u8(&symtab, 0);
+  put_u16(&symtab, TEXT_SECTION);
+  put_u64(&symtab, 0);
+  put_u64(&symtab, 0);
+  for(size_t i = 0; i < syms->count; i++) {
+    size_t end = i + 1 < syms->count ? syms->symbols[i+1].offset : text_size;
+    put_u32(&symtab, strtab.len);
+    emit_bytes(&strtab, syms->symbols[i].name,
+               strlen(syms->symbols[i].name) + 1);
+    put_u8(&symtab, STB_GLOBAL << 4 | STT_FUNC);
+    put_u8(&symtab, 0);
+    put_u16(&symtab, TEXT_SECTION);
+    put_u64(&symtab, syms->symbols[i].offset);
+    put_u64(&symtab, end - syms->symbols[i].offset);
+  }
+  size_t shstrtab_off = strtab_off + strtab.len;
+  size_t shdr_off = (shstrtab_off + sizeof(shstrtab) + 7) & ~(size_t)7;
+
+  put_elf_header(out, ET_REL, 0, 0, shdr_off, 0, SECTION_COUNT,
+                 SHSTRTAB_SECTION);
+
+  for(size_t i = 0; i < code->count; i++) {
+    put_u32(out, code->words[i]);
+  }
+  pad_to(out, symtab_off);
+  emit_bytes(out, symtab.buf, symtab.len);
+  emit_bytes(out, strtab.buf, strtab.len);
+  emit_bytes(out, shstrtab, sizeof(shstrtab));
+  pad_to(out, shdr_off);
+
+  // Section headers, names are offsets into shstrtab
+  put_section_header(out, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  put_section_header(out, 1, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR,
+                     text_off, text_size, 0, 0, 4, 0);
+  put_section_header(out, 7, SHT_PROGBITS, 0, text_off + text_size, 0,
+                     0, 0, 1, 0);
+  put_section_header(out, 23, SHT_SYMTAB, 0, symtab_off, symtab.len,
+                     STRTAB_SECTION, 2, 8, SYM_SIZE);
+  put_section_header(out, 31, SHT_STRTAB, 0, strtab_off, strtab.len,
+                     0, 0, 1, 0);
+  put_section_header(out, 39, SHT_STRTAB, 0, shstrtab_off,
+                     sizeof(shstrtab), 0, 0, 1, 0);
+
+  emitter_free(&symtab);
+  emitter_free(&strtab);
+}
+
+// Emits a static executable with the code in a single read/execute
+// segment. entry is a byte offset into the code.
+void emit_elf_executable(Emitter* out, A64Code* code, size_t entry)
+{
+  size_t text_off = EHDR_SIZE + PHDR_SIZE;
+  size_t file_size = text_off + code->count * 4;
+
+  put_elf_header(out, ET_EXEC, LOAD_ADDRESS + text_off + entry, EHDR_SIZE,
+                 0, 1, 0, 0);
+
+  // The one segment maps the whole file, headers included
+  put_u32(out, PT_LOAD);
+  put_u32(out, PF_R | PF_X);
+  put_u64(out, 0);
+  put_u64(out, LOAD_ADDRESS);
+  put_u64(out, LOAD_ADDRESS);
+  put_u64(out, file_size);
+  put_u64(out, file_size);
+  put_u64(out, PAGE_ALIGN);
+
+  for(size_t i = 0; i < code->count; i++) {
+    put_u32(out, code->words[i]);
+  }
+}
+
+void put_elf_header(Emitter* out, uint16_t type, uint64_t entry,
+                    uint64_t phoff, uint64_t shoff, uint16_t phnum,
+                    uint16_t shnum, uint16_t shstrndx)
+{
+  const char ident[16] = {0x7f, 'E', 'L', 'F', 2, 1, 1, 0};
+  emit_bytes(out, ident, 16);
+  put_u16(out, type);
+  put_u16(out, EM_AARCH64);
+  put_u32(out, 1);
+  put_u64(out, entry);
+  put_u64(out, phoff);
+  put_u64(out, shoff);
+  put_u32(out, 0);
+  put_u16(out, EHDR_SIZE);
+  put_u16(out, phnum ? PHDR_SIZE : 0);
+  put_u16(out, phnum);
+  put_u16(out, shnum ? SHDR_SIZE : 0);
+  put_u16(out, shnum);
+  put_u16(out, shstrndx);
+}
+
+void put_section_header(Emitter* out, uint32_t name, uint32_t type,
+                        uint64_t flags, uint64_t offset, uint64_t size,
+                        uint32_t link, uint32_t info, uint64_t align,
+                        uint64_t entsize)
+{
+  put_u32(out, name);
+  put_u32(out, type);
+  put_u64(out, flags);
+  put_u64(out, 0); // sh_addr
+  put_u64(out, offset);
+  put_u64(out, size);
+  put_u32(out, link);
+  put_u32(out, info);
+  put_u64(out, align);
+  put_u64(out, entsize);
+}
+
+void put_u8(Emitter* out, uint8_t val)
+{
+  emit_char(out, (char)val);
+}
+
+void put_u16(Emitter* out, uint16_t val)
+{
+  put_u8(out, val & 0xff);
+  put_u8(out, val >> 8);
+}
+
+void put_u32(Emitter* out, uint32_t val)
+{
+  put_u16(out, val & 0xffff);
+  put_u16(out, val >> 16);
+}
+
+void put_u64(Emitter* out, uint64_t val)
+{
+  put_u32(out, val & 0xffffffff);
+  put_u32(out, val >> 32);
+}
+
+void pad_to(Emitter* out, size_t offset)
+{
+  while(out->len < offset) {
+    put_u8(out, 0);
+  }
+}
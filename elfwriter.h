@@ -0,0 +1,10 @@
+#ifndef ELFWRITER_H_
+#define ELFWRITER_H_
+
+#include "aarch64.h"
+#include "emitter.h"
+
+void emit_elf_object(Emitter*, A64Code*, A64SymbolList*);
+void emit_elf_executable(Emitter*, A64Code*, size_t);
+
+#endif
@@ -0,0 +1,116 @@
+#include "emitter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void emitter_reserve(Emitter*, size_t);
+
+void emitter_init(Emitter* em)
+{
+  em->len = 0;
+  em->capacity = 1 << 16;
+  em->buf = malloc(em->capacity);
+  if(!em->buf) {
+    perror("Error");
+    exit(1);
+  }
+}
+
+void emitter_reserve(Emitter* em, size_t n)
+{
+  if(em->len + n <= em->capacity) {
+    return ;
+  }
+  while(em->len + n > em->capacity) {
+    em->capacity *= 2;
+  }
+  em->buf = realloc(em->buf, em->capacity);
+  if(!em->buf) {
+    perror("Error");
+    exit(1);
+  }
+}
+
+void emit_bytes(Emitter* em, const char* bytes, size_t n)
+{
+  emitter_reserve(em, n);
+  memcpy(em->buf + em->len, bytes, n);
+  em->len += n;
+}
+
+void emit_str(Emitter* em, const char* str)
+{
+  emit_bytes(em, str, strlen(str));
+}
+
+void emit_char(Emitter* em, char c)
+{
+  emitter_reserve(em, 1);
+  em->buf[em->len++] = c;
+}
+
+void emit_ulong(Emitter* em, unsigned long val)
+{
+  char digits[24];
+  int n = 0;
+  do {
+    digits[n++] = '0' + val % 10;
+    val /= 10;
+  } while(val);
+  emitter_reserve(em, n);
+  while(n) {
+    em->buf[em->len++] = digits[--n];
+  }
+}
+
+void emit_long(Emitter* em, long val)
+{
+  if(val < 0) {
+    emit_char(em, '-');
+    // Negate as unsigned so LONG_MIN does not overflow
+    emit_ulong(em, -(unsigned long)val);
+  } else {
+    emit_ulong(em, val);
+  }
+}
+
+// Registers are always < 100, so this skips the general conversion
+void emit_reg(Emitter* em, char prefix, int reg)
+{
+  emitter_reserve(em, 3);
+  em->buf[em->len++] = prefix;
+  if(reg >= 10) {
+    em->buf[em->len++] = '0' + reg / 10;
+  }
+  em->buf[em->len++] = '0' + reg % 10;
+}
+
+void emit_label_ref(Emitter* em, size_t tag)
+{
+  emit_bytes(em, ".L", 2);
+  emit_ulong(em, tag);
+}
+
+// Returns 0 on success, -1 (with errno set) if the write failed.
+int emitter_write(Emitter* em, int fd)
+{
+  size_t done = 0;
+  while(done < em->len) {
+    ssize_t n = write(fd, em->buf + done, em->len - done);
+    if(n < 0) {
+      return -1;
+    }
+    done += n;
+  }
+  return 0;
+}
+
+void emitter_free(Emitter* em)
+{
+  free(em->buf);
+  em->buf = NULL;
+  em->len = 0;
+  em->capacity = 0;
+}
@@ -0,0 +1,25 @@
+#ifndef EMITTER_H_
+#define EMITTER_H_
+
+#include <stddef.h>
+
+// Growable in-memory output buffer. Everything is formatted by hand
+// and the whole buffer is written out in one go at the end.
+typedef struct Emitter_s {
+  char* buf;
+  size_t len;
+  size_t capacity;
+} Emitter;
+
+void emitter_init(Emitter*);
+void emit_str(Emitter*, const char*);
+void emit_bytes(Emitter*, const char*, size_t);
+void emit_char(Emitter*, char);
+void emit_long(Emitter*, long);
+void emit_ulong(Emitter*, unsigned long);
+void emit_reg(Emitter*, char, int);
+void emit_label_ref(Emitter*, size_t);
+int emitter_write(Emitter*, int);
+void emitter_free(Emitter*);
+
+#endif
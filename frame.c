@@ -0,0 +1,274 @@
+#include "frame.h"
+#include "mir.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// The AArch64 callee saved registers regalloc.c saves in the prologue
+#define FIRST_SAVED_REG 19
+#define LAST_SAVED_REG 28
+
+// Longest epilogue copied over a branch to it, ret included. Four is a
+// frame with two saved registers: three more instructions per return
+// in exchange for a taken branch.
+#define MAX_DUPLICATED_EPILOGUE 4
+
+// A branch out of the frameless region to code that needs the frame
+typedef struct ExitStub_s {
+  long target;
+  long tag;
+} ExitStub;
+
+size_t* find_labels(MirFunction*);
+size_t epilogue_length(MirFunction*, size_t);
+size_t duplicated_length(MirFunction*, size_t*, size_t);
+int needs_frame(MirFunction*, size_t);
+int is_frame_insn(MirInsn*);
+int touches_frame(MirInsn*);
+void start_rewrite(MirFunction*, size_t);
+
+// Sets the frame up after the straight run of code at the start that
+// doesn't use it. Branches from there to a return skip the frame, and
+// branches elsewhere get the prologue on the way.
+void shrink_wrap(MirFunction* mf, int* tag_counter, FrameStats* stats)
+{
+  stats->functions++;
+  size_t first = 0;
+  while(first < mf->count && mf->insns[first].op == MIR_NOP) {
+    first++;
+  }
+  size_t start = first;
+  while(start < mf->count && is_frame_insn(&mf->insns[start])) {
+    start++;
+  }
+  if(start == first) {
+    stats->frameless++;
+    return;
+  }
+  size_t* labels = find_labels(mf);
+  size_t end = start;
+  while(end < mf->count && !needs_frame(mf, end)) {
+    end++;
+  }
+  int skips = 0;
+  for(size_t i = start; i < end; i++) {
+    MirInsn* insn = &mf->insns[i];
+    skips |= mir_is_branch(insn) && labels[insn->imm] >= end
+             && epilogue_length(mf, labels[insn->imm]);
+  }
+  if(!skips) {
+    free(labels);
+    return;
+  }
+  stats->wrapped++;
+  MirFunction old = *mf;
+  size_t prologue = start - first;
+  ExitStub* stubs = malloc(sizeof(ExitStub) * (end - start + 1));
+  if(!stubs) {
+    perror("Error");
+    exit(1);
+  }
+  size_t stub_count = 0;
+  long bare_ret = (*tag_counter)++;
+  start_rewrite(mf, old.count + 2 + (end - start) * (prologue + 2));
+  for(size_t i = start; i < end; i++) {
+    MirInsn insn = old.insns[i];
+    if(mir_is_branch(&insn) && labels[insn.imm] >= end) {
+      if(epilogue_length(&old, labels[insn.imm])) {
+        insn.imm = bare_ret;
+      } else {
+        stubs[stub_count] = (ExitStub){insn.imm, (*tag_counter)++};
+        insn.imm = stubs[stub_count++].tag;
+      }
+    }
+    *mir_append(mf, insn.op, insn.sf) = insn;
+  }
+  for(size_t i = first; i < old.count; i++) {
+    if(i < start || i >= end) {
+      *mir_append(mf, old.insns[i].op, old.insns[i].sf) = old.insns[i];
+    }
+  }
+  mir_label(mf, bare_ret);
+  mir_append(mf, MIR_RET, 0);
+  for(size_t s = 0; s < stub_count; s++) {
+    mir_label(mf, stubs[s].tag);
+    for(size_t i = first; i < start; i++) {
+      *mir_append(mf, old.insns[i].op, old.insns[i].sf) = old.insns[i];
+    }
+    mir_branch(mf, MIR_B, A64_AL, stubs[s].target);
+  }
+  free(stubs);
+  free(labels);
+  free(old.insns);
+}
+
+// An unconditional branch to a short epilogue becomes a copy of it
+void duplicate_epilogues(MirFunction* mf, FrameStats* stats)
+{
+  size_t* labels = find_labels(mf);
+  size_t copies = 0;
+  for(size_t i = 0; i < mf->count; i++) {
+    copies += duplicated_length(mf, labels, i);
+  }
+  if(!copies) {
+    free(labels);
+    return;
+  }
+  MirFunction old = *mf;
+  start_rewrite(mf, old.count + copies);
+  for(size_t i = 0; i < old.count; i++) {
+    MirInsn* insn = &old.insns[i];
+    size_t length = duplicated_length(&old, labels, i);
+    if(!length) {
+      *mir_append(mf, insn->op, insn->sf) = *insn;
+      continue;
+    }
+    stats->duplicated++;
+    for(size_t j = labels[insn->imm] + 1; length; j++) {
+      if(old.insns[j].op != MIR_NOP && old.insns[j].op != MIR_LABEL) {
+        *mir_append(mf, old.insns[j].op, old.insns[j].sf) = old.insns[j];
+        length--;
+      }
+    }
+  }
+  free(labels);
+  free(old.insns);
+}
+
+void print_frame_stats(FrameStats* stats)
+{
+  fprintf(stderr, "frame: %zu of %zu functions frameless, %zu shrink-wrapped"
+          ", %zu epilogues duplicated\n", stats->frameless,
+          stats->functions, stats->wrapped, stats->duplicated);
+}
+
+// Index of every label by tag, mf->count for tags not in the function
+size_t* find_labels(MirFunction* mf)
+{
+  size_t max_tag = 0;
+  for(size_t i = 0; i < mf->count; i++) {
+    MirInsn* insn = &mf->insns[i];
+    if((insn->op == MIR_LABEL || mir_is_branch(insn))
+       && (size_t)insn->imm > max_tag) {
+      max_tag = insn->imm;
+    }
+  }
+  size_t* labels = malloc(sizeof(size_t) * (max_tag + 1));
+  if(!labels) {
+    perror("Error");
+    exit(1);
+  }
+  for(size_t t = 0; t <= max_tag; t++) {
+    labels[t] = mf->count;
+  }
+  for(size_t i = 0; i < mf->count; i++) {
+    if(mf->insns[i].op == MIR_LABEL) {
+      labels[mf->insns[i].imm] = i;
+    }
+  }
+  return labels;
+}
+
+// Instructions from the label at index to the ret, ret included, when
+// all they do is tear the frame down
+size_t epilogue_length(MirFunction* mf, size_t index)
+{
+  size_t length = 0;
+  for(size_t i = index + 1; i < mf->count; i++) {
+    MirInsn* insn = &mf->insns[i];
+    if(insn->op == MIR_NOP || insn->op == MIR_LABEL) {
+      continue;
+    }
+    if(insn->op == MIR_RET) {
+      return length + 1;
+    }
+    if(!is_frame_insn(insn) || insn->op == MIR_SUB_IMM
+       || insn->op == MIR_STR) {
+      return 0;
+    }
+    length++;
+  }
+  return 0;
+}
+
+// What copying the epilogue over the instruction at index costs, 0 when
+// it isn't a branch to one or the epilogue follows anyway
+size_t duplicated_length(MirFunction* mf, size_t* labels, size_t index)
+{
+  MirInsn* insn = &mf->insns[index];
+  if(insn->op != MIR_B) {
+    return 0;
+  }
+  size_t next = index + 1;
+  while(next < mf->count && mf->insns[next].op == MIR_NOP) {
+    next++;
+  }
+  if(next == labels[insn->imm]) {
+    return 0;
+  }
+  size_t length = epilogue_length(mf, labels[insn->imm]);
+  return length <= MAX_DUPLICATED_EPILOGUE ? length : 0;
+}
+
+// Labels that a later branch jumps back to end the frameless region, as
+// the frame would be set up again on the way round. So does an indirect
+// branch, which could go anywhere.
+int needs_frame(MirFunction* mf, size_t index)
+{
+  MirInsn* insn = &mf->insns[index];
+  if(insn->op == MIR_RET || insn->op == MIR_BR || touches_frame(insn)) {
+    return 1;
+  }
+  if(insn->op != MIR_LABEL) {
+    return 0;
+  }
+  for(size_t i = index + 1; i < mf->count; i++) {
+    if(mir_is_branch(&mf->insns[i]) && mf->insns[i].imm == insn->imm) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Moves sp, or saves or restores a callee saved register
+int is_frame_insn(MirInsn* insn)
+{
+  switch(insn->op) {
+  case MIR_ADD_IMM:
+  case MIR_SUB_IMM:
+    return insn->rd == 31 && insn->rn == 31;
+  case MIR_LDR:
+  case MIR_STR:
+    return insn->rd >= FIRST_SAVED_REG && insn->rd <= LAST_SAVED_REG;
+  default:
+    return 0;
+  }
+}
+
+int touches_frame(MirInsn* insn)
+{
+  if(insn->op == MIR_LDR || insn->op == MIR_STR) {
+    return 1;
+  }
+  if(mir_reads(insn, 31) || mir_writes(insn, 31)) {
+    return 1;
+  }
+  for(int r = FIRST_SAVED_REG; r <= LAST_SAVED_REG; r++) {
+    if(mir_reads(insn, r) || mir_writes(insn, r)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Gives mf a new empty array, the caller keeps the old one
+void start_rewrite(MirFunction* mf, size_t capacity)
+{
+  mf->capacity = capacity ? capacity : 1;
+  mf->count = 0;
+  mf->insns = malloc(sizeof(MirInsn) * mf->capacity);
+  if(!mf->insns) {
+    perror("Error");
+    exit(1);
+  }
+}
@@ -0,0 +1,17 @@
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#include "mir.h"
+
+typedef struct FrameStats_s {
+  size_t functions;
+  size_t frameless;  // Functions with no stack frame at all
+  size_t wrapped;    // Functions with a path that skips the frame
+  size_t duplicated; // Branches to a return replaced by its epilogue
+} FrameStats;
+
+void shrink_wrap(MirFunction*, int*, FrameStats*);
+void duplicate_epilogues(MirFunction*, FrameStats*);
+void print_frame_stats(FrameStats*);
+
+#endif
@@ -1,10 +1,36 @@
 #include "generator.h"
 #include "parser.h"
 #include "symbol.h"
+#include "summary.h"
+#include "emitter.h"
+#include "aarch64.h"
+#include "mir.h"
+#include "peephole.h"
+#include "regalloc.h"
+#include "frame.h"
+#include "switches.h"
+#include "strength.h"
+#include "elfwriter.h"
+#include "x86_64.h"
+#include "jit.h"
+#include "bytecode.h"
+#include "vm.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#define SYS_EXIT 93 // Linux AArch64 syscall number
+#define LAST_TEMP_REG 18 // x19 and up are left for regalloc.c
+#define MAX_CCMP_CHAIN 4 // Comparisons a cmp/ccmp sequence evaluates
+#define MAX_SELECT_COST 6 // Instructions a select may run that a branch
+                          // would have skipped
+#define MAX_SELECT_ITEMS 4
 
 typedef enum Register_t {
   X0,  X1,  X2,  X3,  X4,  X5,  X6,  X7,
@@ -13,941 +39,2414 @@ typedef enum Register_t {
   X24, X25, X26, X27, X28, X29, X30, X31
 } Register;
 
-typedef struct CaseLabelTableNode_s {
-  int def;
-  long val;
-  size_t tag;
-  struct CaseLabelTableNode_s* next;
-} CaseLabelTableNode;
-
-typedef struct CaseLabelTable_s {
-  CaseLabelTableNode* first;
-  struct CaseLabelTable_s* parent;
-} CaseLabelTable;
-
-void write_ast_assembly(ProgramNode, FILE*);
-void write_block_assembly(BlockNode*, FILE*, int);
-void write_declaration_assembly(DeclarationNode*, FILE*);
-void write_statement_assembly(StatementNode*, FILE*, int);
-void write_expression_assembly(Register, ExpressionNode*, FILE*);
-void write_switch_case_table(StatementNode*, FILE*);
+// One piece of an expression's code. Operators with control flow between
+// their operands (&&, || and ?:) get a step per phase.
+typedef struct ExpStep_s {
+  uint8_t type; // ExpressionType
+  uint8_t phase;
+  uint8_t reg;
+  uint8_t sf;
+  uint8_t size;
+  uint8_t signed_;
+  uint8_t swapped; // Right operand in reg, left in reg+1
+  uint8_t cond;    // A64Cond of a SELECT_STEP or comparing IMMEDIATE_STEP
+  uint8_t op;      // MirOp of an IMMEDIATE_STEP
+  uint8_t rn;      // Operands of COMPARE_STEP and SELECT_STEP, register
+  uint8_t rm;      // 31 is zero
+  int tag0;
+  int tag1;
+  long imm; // Literal value or stack offset
+} ExpStep;
+
+// Steps past the expression types, for the temporaries below reg when a
+// subexpression needs more registers than remain above it
+enum {
+  SPILL_STEP = EMPTY_EXP + 1, // Store x0 .. x<reg-1> from imm up
+  RELOAD_STEP,                // Move x0 to x<reg> and load them back
+  COMPARE_STEP,               // Set the flags for rn - rm
+  SELECT_STEP,                // MirOp imm of rn and rm into reg
+  MUL_CONSTANT_STEP,          // reg op imm with shifts, adds and a
+  DIV_CONSTANT_STEP,          // multiply high in place of the multiply
+  MOD_CONSTANT_STEP,          // or divide
+  IMMEDIATE_STEP              // reg = reg op imm, or cmp and cset cond
+};
+
+typedef enum SelectIdiom_e {
+  PLAIN_SELECT,
+  MINMAX_SELECT, // a < b ? a : b and the like
+  ABS_SELECT     // x < 0 ? -x : x and the like
+} SelectIdiom;
+
+// A ?: whose arms are cheap enough to both run, then pick one with a
+// conditional select. Items are evaluated into reg, reg+1, ... and the
+// operands are item indexes, or A64_ZR for zero.
+typedef struct SelectPlan_s {
+  ExpressionNode* items[MAX_SELECT_ITEMS];
+  int item_count;
+  int compare_sf;
+  int compare_rn;
+  int compare_rm;
+  A64Cond cond;
+  MirOp op; // rd = cond ? rn : op(rm)
+  int rn;
+  int rm;
+  SelectIdiom idiom;
+} SelectPlan;
+
+typedef struct SelectStats_s {
+  size_t selects; // Branches replaced
+  size_t minmax;
+  size_t abs;
+} SelectStats;
+
+// A node still to be flattened, or a finished step when exp is NULL
+typedef struct ExpWork_s {
+  ExpressionNode* exp;
+  ExpStep step;
+} ExpWork;
+
+// A condition still to be branched on, or a label to place when cond is
+// NULL
+typedef struct CondWork_s {
+  ExpressionNode* cond;
+  int on_true;
+  int tag;
+} CondWork;
+
+// Everything the walkers change while generating one function, so
+// functions can be generated on separate threads
+typedef struct FunctionCodegen_s {
+  FunctionNode* func;
+  MirFunction mf;
+  FunctionSummary* summary;
+  SymbolTable* top_st;
+  int stack_offset;
+  int tag_counter; // Labels count from 0 until the functions are joined
+  int continue_tag;
+  int break_tag;
+  int spill_used;  // Bytes of spill slots above the locals in use
+  int spill_size;  // The most ever used
+  ExpStep* exp_steps;
+  size_t exp_step_count;
+  size_t exp_step_capacity;
+  ExpWork* exp_work;
+  size_t exp_work_count;
+  size_t exp_work_capacity;
+  CondWork* cond_work;
+  size_t cond_work_count;
+  size_t cond_work_capacity;
+  SwitchTables switch_tables;
+  PeepholeStats peephole_stats;
+  RegAllocStats regalloc_stats;
+  FrameStats frame_stats;
+  SelectStats select_stats;
+  SwitchStats switch_stats;
+  StrengthStats strength_stats;
+} FunctionCodegen;
+
+// Functions first, first + stride, ... of the program
+typedef struct CodegenWorker_s {
+  FunctionCodegen* functions;
+  size_t count;
+  size_t first;
+  size_t stride;
+} CodegenWorker;
+
+void generate_object(ProgramNode, Emitter*);
+void generate_executable(ProgramNode, Emitter*);
+int run_program(ProgramNode);
+int run_bytecode(ProgramNode);
+long elapsed_us(struct timespec*);
+char* output_filename(const char*, OutputKind, const char*);
+void write_output(Emitter*, const char*, int);
+void pipe_to_assembler(Emitter*, const char*);
+void encode_program(ProgramNode, A64Code*, A64SymbolList*);
+void build_assembly(ProgramNode, Emitter*);
+FunctionCodegen* generate_functions(ProgramNode);
+void* codegen_worker(void*);
+void free_functions(FunctionCodegen*, size_t);
+void write_function_assembly(FunctionCodegen*);
+void write_block_assembly(BlockNode*, FunctionCodegen*, int);
+void write_declaration_assembly(DeclarationNode*, FunctionCodegen*);
+void write_statement_assembly(StatementNode*, FunctionCodegen*, int);
+void write_expression_assembly(Register, ExpressionNode*, FunctionCodegen*);
+void write_condition_branch(ExpressionNode*, int, int, FunctionCodegen*);
+void write_flags_branch(ExpressionNode*, int, int, FunctionCodegen*);
+int write_compare_chain(ExpressionNode*, int, int, FunctionCodegen*);
+int is_leaf_operand(ExpressionNode*);
+int write_select_statement(StatementNode*, FunctionCodegen*);
+ExpressionNode* single_assignment(StatementNode*);
+int plan_select(ExpressionNode*, SelectPlan*);
+MirOp select_modifier(ExpressionNode*, int, ExpressionNode**);
+int select_item(SelectPlan*, ExpressionNode*, int);
+int same_leaf(ExpressionNode*, ExpressionNode*);
+int literal_value(ExpressionNode*, long*);
+int within_cost(ExpressionNode*, int*);
+void print_select_stats(SelectStats*);
+void push_cond_work(FunctionCodegen*, ExpressionNode*, int, int);
+void write_switch_dispatch(StatementNode*, int, FunctionCodegen*);
+int write_switch_lookup(StatementNode*, int, int, FunctionCodegen*);
+int switch_case_value(BlockNode*, size_t*, ExpressionNode**, int*,
+                      uint32_t*);
+int is_case_label(BlockItem*);
+int constant_bits(ExpressionNode*, uint32_t*);
+void number_expression(FunctionCodegen*, ExpressionNode*);
+int register_need(ExpressionNode*);
+int binary_register_need(ExpressionNode*);
+int swappable_operands(ExpressionNode*);
+int has_side_effects(ExpressionNode*);
+int constant_operand_step(FunctionCodegen*, ExpressionNode*, ExpStep*);
+ExpressionNode* immediate_operand_step(ExpressionNode*, ExpStep*);
+int literal_operand(ExpressionNode*, long*);
+size_t expression_operands(ExpressionNode*, ExpressionNode**);
+void flatten_expression(FunctionCodegen*, Register, ExpressionNode*);
+void write_expression_step(ExpStep*, MirFunction*);
+void append_exp_step(FunctionCodegen*, ExpStep*);
+void push_exp_step(FunctionCodegen*, ExpStep*);
+void push_exp_work(FunctionCodegen*, ExpressionNode*, Register);
 void check_next_reg(Register);
-int count_local_vars(BlockNode*);
-void construct_label_table(SymbolTable*, BlockNode*);
-size_t get_symbol_offset(char*, FILE*);
-char reg_prefix_for_type(Type type);
-char suffix_for_type(Type type);
-int type_size(Type type);
-
-int tag_counter = 0;
-
-SymbolTable* main_st;
-SymbolTable* top_st;
-SymbolTable* labels;
-CaseLabelTable* curr_switch_table;
-
-int func_stack_offset;
-
-char* assembly_filename;
-
-void generate_assembly(ProgramNode prgm, const char* filename)
-{
-  unsigned long len = strlen(filename);
-  assembly_filename = calloc(len+1, sizeof(char));
-  strncpy(assembly_filename, filename, len);
-  assembly_filename[len-1] = 's';
-  labels = NULL;
-  
-  FILE* as_file = fopen(assembly_filename, "w");
-  if(!as_file) {
+size_t get_symbol_offset(FunctionCodegen*, char*);
+int is_wide_type(Type type);
+int access_size_for_type(Type type, int sf);
+int variable_access_size(ExpressionNode*);
+
+extern char** environ;
+
+CompileOptions* compile_opts;
+PeepholeStats peephole_stats;
+RegAllocStats regalloc_stats;
+FrameStats frame_stats;
+SelectStats select_stats;
+SwitchStats switch_stats;
+StrengthStats strength_stats;
+
+const MirOp binary_ops[] = {
+  [ADD_BINEXP] = MIR_ADD, [SUB_BINEXP] = MIR_SUB, [MUL_BINEXP] = MIR_MUL,
+  [BITAND_BINEXP] = MIR_AND, [BITOR_BINEXP] = MIR_ORR,
+  [BITXOR_BINEXP] = MIR_EOR, [LSHIFT_BINEXP] = MIR_LSL,
+  [RSHIFT_BINEXP] = MIR_ASR, [PLUSEQ_EXP] = MIR_ADD,
+  [MINUSEQ_EXP] = MIR_SUB, [TIMESEQ_EXP] = MIR_MUL, [ANDEQ_EXP] = MIR_AND,
+  [OREQ_EXP] = MIR_ORR, [XOREQ_EXP] = MIR_EOR, [LSHEQ_EXP] = MIR_LSL,
+  [RSHEQ_EXP] = MIR_ASR
+};
+
+const A64Cond compare_conds[] = {
+  [EQ_BINEXP] = A64_EQ, [NEQ_BINEXP] = A64_NE, [GT_BINEXP] = A64_GT,
+  [GEQ_BINEXP] = A64_GE, [LT_BINEXP] = A64_LT, [LEQ_BINEXP] = A64_LE
+};
+
+// The same comparisons with the operands the other way round
+const A64Cond reversed_conds[] = {
+  [EQ_BINEXP] = A64_EQ, [NEQ_BINEXP] = A64_NE, [GT_BINEXP] = A64_LT,
+  [GEQ_BINEXP] = A64_LE, [LT_BINEXP] = A64_GT, [LEQ_BINEXP] = A64_GE
+};
+
+// Forms taking the right operand as an immediate. The generator picks
+// between add and sub by the sign, and compares with MIR_CMP_IMM.
+const MirOp immediate_ops[] = {
+  [BITAND_BINEXP] = MIR_AND_IMM, [BITOR_BINEXP] = MIR_ORR_IMM,
+  [BITXOR_BINEXP] = MIR_EOR_IMM, [LSHIFT_BINEXP] = MIR_LSL_IMM,
+  [RSHIFT_BINEXP] = MIR_ASR_IMM, [ANDEQ_EXP] = MIR_AND_IMM,
+  [OREQ_EXP] = MIR_ORR_IMM, [XOREQ_EXP] = MIR_EOR_IMM,
+  [LSHEQ_EXP] = MIR_LSL_IMM, [RSHEQ_EXP] = MIR_ASR_IMM
+};
+
+int generate(ProgramNode prgm, const char* filename, CompileOptions* opts)
+{
+  compile_opts = opts;
+  if(opts->output_kind == RUN_OUTPUT) {
+    return run_program(prgm);
+  }
+  if(opts->output_kind == VM_OUTPUT) {
+    return run_bytecode(prgm);
+  }
+  OutputKind kind = opts->pipe ? OBJECT_OUTPUT : opts->output_kind;
+  char* output = output_filename(filename, kind, opts->output);
+  Emitter out;
+  emitter_init(&out);
+  int mode = 0644;
+
+  if(opts->pipe) {
+    build_assembly(prgm, &out);
+    pipe_to_assembler(&out, strcmp(output, "-") ? output : "/dev/stdout");
+  } else {
+    switch(kind) {
+    case ASSEMBLY_OUTPUT:
+      build_assembly(prgm, &out);
+      break;
+    case OBJECT_OUTPUT:
+      generate_object(prgm, &out);
+      break;
+    case EXECUTABLE_OUTPUT:
+      generate_executable(prgm, &out);
+      mode = 0755;
+      break;
+    case RUN_OUTPUT:
+    case VM_OUTPUT:
+      break;
+    }
+    // Nothing touches the disk until the whole program has been generated
+    write_output(&out, output, mode);
+  }
+  emitter_free(&out);
+  free(output);
+  if(opts->stats && opts->opt_level >= 1) {
+    print_peephole_stats(&peephole_stats);
+    print_regalloc_stats(&regalloc_stats);
+    print_frame_stats(&frame_stats);
+    print_select_stats(&select_stats);
+    print_switch_stats(&switch_stats);
+    print_strength_stats(&strength_stats);
+  }
+  return 0;
+}
+
+void generate_object(ProgramNode prgm, Emitter* out)
+{
+  A64Code code;
+  A64SymbolList syms;
+  a64_init(&code);
+  encode_program(prgm, &code, &syms);
+  emit_elf_object(out, &code, &syms);
+  a64_free_symbols(&syms);
+  a64_free(&code);
+}
+
+// Static executable: a _start stub followed directly by the program.
+// The stub calls main and hands its return value to the exit syscall.
+void generate_executable(ProgramNode prgm, Emitter* out)
+{
+  A64Code code;
+  A64SymbolList syms;
+  a64_init(&code);
+  a64_emit(&code, a64_bl()); // Patched once main has been placed
+  a64_emit(&code, a64_movz(1, 8, SYS_EXIT, 0));
+  a64_emit(&code, a64_svc(0));
+  encode_program(prgm, &code, &syms);
+  size_t main_index = 0;
+  while(main_index < syms.count
+        && strcmp(syms.symbols[main_index].name, "main")) {
+    main_index++;
+  }
+  if(main_index == syms.count) {
+    puts("Error: no main function");
+    exit(1);
+  }
+  code.words[0] |= syms.symbols[main_index].offset / 4;
+  emit_elf_executable(out, &code, 0);
+  a64_free_symbols(&syms);
+  a64_free(&code);
+}
+
+// Encodes the program for x86-64 into executable memory and calls main
+// without going through as, ld or a new process
+int run_program(ProgramNode prgm)
+{
+  FunctionCodegen* fcs = generate_functions(prgm);
+  X86Code code;
+  x86_init(&code);
+  long main_offset = -1;
+  for(size_t i = 0; i < prgm.function_count; i++) {
+    if(!strcmp(fcs[i].mf.name, "main")) {
+      main_offset = code.count;
+    }
+    x86_encode(&fcs[i].mf, &code);
+  }
+  free_functions(fcs, prgm.function_count);
+  if(x86_resolve_labels(&code)) {
+    exit(1);
+  }
+  if(main_offset < 0) {
+    puts("Error: no main function");
+    exit(1);
+  }
+  uint8_t* mem = jit_load(code.bytes, code.count);
+  if(compile_opts->stats) {
+    if(compile_opts->opt_level >= 1) {
+      print_peephole_stats(&peephole_stats);
+    }
+    fprintf(stderr, "jit: %ld us from start to main, %zu bytes\n",
+            elapsed_us(&compile_opts->started), code.count);
+  }
+  struct timespec started;
+  timespec_get(&started, TIME_UTC);
+  int result = jit_call(mem + main_offset);
+  if(compile_opts->stats) {
+    fprintf(stderr, "jit: main ran for %ld us\n", elapsed_us(&started));
+  }
+  jit_unload(mem, code.count);
+  x86_free(&code);
+  return result;
+}
+
+// Compiles the program to bytecode and interprets main, on any host
+int run_bytecode(ProgramNode prgm)
+{
+  BcProgram bc = compile_bytecode(prgm);
+  if(!bc.main) {
+    puts("Error: no main function");
+    exit(1);
+  }
+  if(compile_opts->stats) {
+    size_t insns = 0;
+    for(size_t i = 0; i < bc.count; i++) {
+      insns += bc.functions[i].count;
+    }
+    fprintf(stderr, "vm: %ld us from start to main, %zu instructions\n",
+            elapsed_us(&compile_opts->started), insns);
+  }
+  VmStats stats = {0};
+  struct timespec started;
+  timespec_get(&started, TIME_UTC);
+  int result = vm_run(bc.main, &stats);
+  if(compile_opts->stats) {
+    long us = elapsed_us(&started);
+    fprintf(stderr, "vm: main ran for %ld us, %zu instructions"
+            " (%.1f M/s)\n", us, stats.executed,
+            us ? (double)stats.executed / us : 0.0);
+  }
+  free_bytecode(&bc);
+  return result;
+}
+
+long elapsed_us(struct timespec* since)
+{
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return (now.tv_sec - since->tv_sec) * 1000000
+         + (now.tv_nsec - since->tv_nsec) / 1000;
+}
+
+// Appends the machine code for the program to code
+void encode_program(ProgramNode prgm, A64Code* code, A64SymbolList* syms)
+{
+  FunctionCodegen* fcs = generate_functions(prgm);
+  syms->symbols = NULL;
+  syms->count = 0;
+  syms->capacity = 0;
+  for(size_t i = 0; i < prgm.function_count; i++) {
+    a64_add_symbol(syms, fcs[i].mf.name, code->count * 4);
+    if(mir_encode(&fcs[i].mf, code)) {
+      exit(1);
+    }
+  }
+  free_functions(fcs, prgm.function_count);
+  if(a64_resolve_labels(code)) {
+    exit(1);
+  }
+}
+
+// Without -o the output is named after the source file: foo.c becomes
+// foo.s, foo.o or foo
+char* output_filename(const char* filename, OutputKind kind,
+                      const char* output)
+{
+  if(output) {
+    filename = output;
+  }
+  size_t len = strlen(filename);
+  char* out = calloc(len + sizeof("a.out"), sizeof(char));
+  if(!out) {
+    perror("Error");
+    exit(1);
+  }
+  memcpy(out, filename, len);
+  if(output) {
+    return out;
+  }
+  int has_ext = len > 2 && filename[len-2] == '.';
+  if(kind == EXECUTABLE_OUTPUT) {
+    if(has_ext) {
+      out[len-2] = '\0';
+    } else {
+      strcpy(out, "a.out");
+    }
+  } else {
+    if(!has_ext) {
+      out[len] = '.';
+      len += 2;
+    }
+    out[len-1] = kind == OBJECT_OUTPUT ? 'o' : 's';
+  }
+  return out;
+}
+
+// "-" writes to stdout
+void write_output(Emitter* em, const char* path, int mode)
+{
+  int fd = STDOUT_FILENO;
+  if(strcmp(path, "-")) {
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, mode);
+  }
+  if(fd < 0 || emitter_write(em, fd) < 0) {
+    perror("Error");
+    exit(1);
+  }
+  if(fd != STDOUT_FILENO) {
+    close(fd);
+  }
+}
+
+// Streams the assembly into the stdin of the system assembler
+void pipe_to_assembler(Emitter* em, const char* object_filename)
+{
+  int fds[2];
+  if(pipe(fds) < 0) {
+    perror("Error");
+    exit(1);
+  }
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+  posix_spawn_file_actions_addclose(&actions, fds[0]);
+  posix_spawn_file_actions_addclose(&actions, fds[1]);
+  char* argv[] = {"as", "-o", (char*)object_filename, NULL};
+  pid_t pid;
+  int err = posix_spawnp(&pid, "as", &actions, NULL, argv, environ);
+  posix_spawn_file_actions_destroy(&actions);
+  close(fds[0]);
+  if(err) {
+    printf("Error: cannot run as: %s\n", strerror(err));
+    exit(1);
+  }
+  int write_failed = emitter_write(em, fds[1]) < 0;
+  close(fds[1]);
+  int status;
+  if(waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)
+     || WEXITSTATUS(status) || write_failed) {
+    puts("Error: assembler failed");
+    exit(1);
+  }
+}
+
+void build_assembly(ProgramNode prgm, Emitter* em)
+{
+  FunctionCodegen* fcs = generate_functions(prgm);
+  if(compile_opts->target == X86_64_LINUX_TARGET) {
+    emit_str(em, ".text\n");
+    for(size_t i = 0; i < prgm.function_count; i++) {
+      x86_print(&fcs[i].mf, em);
+    }
+    // No executable stack
+    emit_str(em, ".section .note.GNU-stack,\"\",@progbits\n");
+    free_functions(fcs, prgm.function_count);
+    return;
+  }
+  if(compile_opts->target == AARCH64_LINUX_TARGET) {
+    emit_str(em, ".text\n");
+    emit_str(em, ".align 2\n");
+    for(size_t i = 0; i < prgm.function_count; i++) {
+      mir_print(&fcs[i].mf, em, GNU_SYNTAX);
+    }
+    emit_str(em, ".section .note.GNU-stack,\"\",%progbits\n");
+    free_functions(fcs, prgm.function_count);
+    return;
+  }
+  for(size_t i = 0; i < prgm.function_count; i++) {
+    emit_str(em, ".global _");
+    emit_str(em, fcs[i].mf.name);
+    emit_char(em, '\n');
+  }
+  emit_str(em, ".align 2\n");
+  for(size_t i = 0; i < prgm.function_count; i++) {
+    mir_print(&fcs[i].mf, em, APPLE_SYNTAX);
+  }
+  free_functions(fcs, prgm.function_count);
+}
+
+// Selects instructions for every function. Functions share no state
+// while they are generated, so -j<n> spreads them over n threads. Labels
+// are renumbered afterwards in source order, which makes the output the
+// same whatever the thread count.
+FunctionCodegen* generate_functions(ProgramNode prgm)
+{
+  size_t count = prgm.function_count;
+  FunctionCodegen* fcs = calloc(count ? count : 1, sizeof(FunctionCodegen));
+  if(!fcs) {
     perror("Error");
     exit(1);
   }
+  for(size_t i = 0; i < count; i++) {
+    fcs[i].func = prgm.functions[i];
+  }
+  size_t threads = compile_opts->threads > 1 ? compile_opts->threads : 1;
+  if(threads > count) {
+    threads = count;
+  }
+  if(threads <= 1) {
+    CodegenWorker worker = {fcs, count, 0, 1};
+    codegen_worker(&worker);
+  } else {
+    pthread_t* ids = malloc(sizeof(pthread_t) * threads);
+    CodegenWorker* workers = malloc(sizeof(CodegenWorker) * threads);
+    if(!ids || !workers) {
+      perror("Error");
+      exit(1);
+    }
+    for(size_t t = 0; t < threads; t++) {
+      workers[t] = (CodegenWorker){fcs, count, t, threads};
+      int err = pthread_create(&ids[t], NULL, codegen_worker, &workers[t]);
+      if(err) {
+        printf("Error: cannot start thread: %s\n", strerror(err));
+        exit(1);
+      }
+    }
+    for(size_t t = 0; t < threads; t++) {
+      pthread_join(ids[t], NULL);
+    }
+    free(ids);
+    free(workers);
+  }
+  int tag_base = 0;
+  for(size_t i = 0; i < count; i++) {
+    mir_rebase_labels(&fcs[i].mf, tag_base);
+    tag_base += fcs[i].tag_counter;
+    for(int r = 0; r < PEEPHOLE_RULE_COUNT; r++) {
+      peephole_stats.hits[r] += fcs[i].peephole_stats.hits[r];
+    }
+    peephole_stats.insns_before += fcs[i].peephole_stats.insns_before;
+    peephole_stats.insns_after += fcs[i].peephole_stats.insns_after;
+    regalloc_stats.locals += fcs[i].regalloc_stats.locals;
+    regalloc_stats.promoted += fcs[i].regalloc_stats.promoted;
+    regalloc_stats.spilled += fcs[i].regalloc_stats.spilled;
+    frame_stats.functions += fcs[i].frame_stats.functions;
+    frame_stats.frameless += fcs[i].frame_stats.frameless;
+    frame_stats.wrapped += fcs[i].frame_stats.wrapped;
+    frame_stats.duplicated += fcs[i].frame_stats.duplicated;
+    select_stats.selects += fcs[i].select_stats.selects;
+    select_stats.minmax += fcs[i].select_stats.minmax;
+    select_stats.abs += fcs[i].select_stats.abs;
+    switch_stats.switches += fcs[i].switch_stats.switches;
+    switch_stats.lookups += fcs[i].switch_stats.lookups;
+    switch_stats.tables += fcs[i].switch_stats.tables;
+    switch_stats.bit_tests += fcs[i].switch_stats.bit_tests;
+    switch_stats.trees += fcs[i].switch_stats.trees;
+    strength_stats.multiplies += fcs[i].strength_stats.multiplies;
+    strength_stats.divisions += fcs[i].strength_stats.divisions;
+    strength_stats.remainders += fcs[i].strength_stats.remainders;
+  }
+  return fcs;
+}
+
+void* codegen_worker(void* arg)
+{
+  CodegenWorker* worker = arg;
+  for(size_t i = worker->first; i < worker->count; i += worker->stride) {
+    write_function_assembly(&worker->functions[i]);
+  }
+  return NULL;
+}
+
+void free_functions(FunctionCodegen* fcs, size_t count)
+{
+  for(size_t i = 0; i < count; i++) {
+    mir_free(&fcs[i].mf);
+  }
+  free(fcs);
+}
+
+// Selects instructions for one function into fc->mf
+void write_function_assembly(FunctionCodegen* fc)
+{
+  MirFunction* mf = &fc->mf;
+  fc->summary = summarize_function(fc->func, &fc->tag_counter);
+  mir_init(mf, fc->func->name);
+  fc->stack_offset = fc->summary->locals_size;
+  if(fc->stack_offset % 16) {
+    fc->stack_offset += (16 - fc->stack_offset % 16);
+  }
+  mir_rri(mf, MIR_SUB_IMM, 1, X31, X31, fc->stack_offset);
+  int ret_tag = fc->tag_counter++;
+  fc->top_st = NULL;
+  fc->continue_tag = -1;
+  fc->break_tag = -1;
+  write_block_assembly(fc->func->body, fc, ret_tag);
+  // Spill slots are only known now, the prologue grows to fit them
+  int frame_size = fc->stack_offset + (fc->spill_size + 15) / 16 * 16;
+  mf->insns[0].imm = frame_size;
+  if(!frame_size) {
+    mf->insns[0].op = MIR_NOP;
+  }
+  mir_label(mf, ret_tag);
+  if(frame_size) {
+    mir_rri(mf, MIR_ADD_IMM, 1, X31, X31, frame_size);
+  }
+  mir_append(mf, MIR_RET, 0);
+  delete_function_summary(fc->summary);
+  fc->summary = NULL;
+  free(fc->exp_steps);
+  free(fc->exp_work);
+  free(fc->cond_work);
+  if(compile_opts->opt_level >= 1) {
+    peephole_optimize(mf, compile_opts->target != X86_64_LINUX_TARGET,
+                      &fc->peephole_stats);
+  }
+  // Locals go in x19-x28, which x86-64 only has as red zone slots. Its
+  // temporaries past the mapped registers live below rsp too, so the
+  // frame can't move either.
+  if(compile_opts->opt_level >= 1
+     && compile_opts->target != X86_64_LINUX_TARGET) {
+    allocate_registers(mf, &fc->regalloc_stats);
+    peephole_after_regalloc(mf, &fc->peephole_stats);
+    shrink_wrap(mf, &fc->tag_counter, &fc->frame_stats);
+  }
+  if(compile_opts->opt_level >= 1) {
+    duplicate_epilogues(mf, &fc->frame_stats);
+  }
+  append_switch_tables(mf, &fc->switch_tables);
+}
 
-  fputs(".global _main\n", as_file);
-  fputs(".align 2\n", as_file);
+void write_block_assembly(BlockNode* block, FunctionCodegen* fc, int ret_tag)
+{
+  SymbolTable* block_st = malloc(sizeof(SymbolTable));
+  block_st->top = NULL;
+  block_st->next = fc->top_st;
+  fc->top_st = block_st;
+  // Why am I doing this?
+  push_constructed_symbol(NULL, 0, block_st);
+  for(unsigned int i = 0; i < block->count; i++) {
+    BlockItem* item = block->body[i];
+    if(item->type == STATEMENT_ITEM) {
+      write_statement_assembly(item->stmt, fc, ret_tag);
+    } else {
+      write_declaration_assembly(item->decl, fc);
+    }
+  }
+  fc->top_st = block_st->next;
+  delete_symbol_table(block_st);
+}
 
+void write_declaration_assembly(DeclarationNode* decl, FunctionCodegen* fc)
+{
+  if(find_symbol(decl->var_name, fc->top_st).name) {
+    puts("Error: duplicate declaration of variable:");
+    puts(decl->var_name);
+    exit(1);
+  }
+  push_constructed_symbol(decl->var_name,
+                          find_slot_offset(fc->summary, decl), fc->top_st);
+  if(decl->assignment_expression) {
+    write_expression_assembly(X0, decl->assignment_expression, fc);
+  }
+}
 
-  write_ast_assembly(prgm, as_file);
+void write_statement_assembly(StatementNode* stmt, FunctionCodegen* fc,
+                              int ret_tag)
+{
+  MirFunction* mf = &fc->mf;
+  int last_continue_tag; 
+  int last_break_tag; 
+  int tag0;
+  int tag1;
+  int tag2;
+  size_t label;
+  switch(stmt->type) {
+  case RETURN_STATEMENT:
+    write_expression_assembly(X0, stmt->expression, fc); 
+    mir_branch(mf, MIR_B, A64_AL, ret_tag);
+    break;
+  case CONDITIONAL:
+    if(write_select_statement(stmt, fc)) {
+      break;
+    }
+    tag0 = fc->tag_counter++;
+    if(stmt->else_stmt) {
+      tag1 = fc->tag_counter++;
+    }
+    write_condition_branch(stmt->condition, 0, tag0, fc);
+    write_statement_assembly(stmt->if_stmt, fc, ret_tag);
+    if(stmt->else_stmt){
+      mir_branch(mf, MIR_B, A64_AL, tag1);
+    }
+    mir_label(mf, tag0);
+    if(stmt->else_stmt) {
+      write_statement_assembly(stmt->else_stmt, fc, ret_tag);
+      mir_label(mf, tag1);
+    }
+    break;
+  case WHILE_LOOP:
+    tag0 = fc->tag_counter++;
+    tag1 = fc->tag_counter++;
+    last_continue_tag = fc->continue_tag;
+    last_break_tag = fc->break_tag;
+    fc->continue_tag = tag0;
+    fc->break_tag = tag1;
+    write_condition_branch(stmt->loop_condition, 0, tag1, fc);
+    mir_label(mf, tag0);
+    write_statement_assembly(stmt->loop_stmt, fc, ret_tag);
+    write_condition_branch(stmt->loop_condition, 1, tag0, fc);
+    mir_label(mf, tag1);
+    fc->continue_tag = last_continue_tag;
+    fc->break_tag = last_break_tag;
+    break;
+  case DO_LOOP:
+    tag0 = fc->tag_counter++;
+    tag1 = fc->tag_counter++;
+    last_continue_tag = fc->continue_tag;
+    last_break_tag = fc->break_tag;
+    fc->continue_tag = tag0;
+    fc->break_tag = tag1;
+    mir_label(mf, tag0);
+    write_statement_assembly(stmt->loop_stmt, fc, ret_tag);
+    write_condition_branch(stmt->loop_condition, 1, tag0, fc);
+    mir_label(mf, tag1);
+    fc->continue_tag = last_continue_tag;
+    fc->break_tag = last_break_tag;
+    break;
+  case FOR_LOOP:
+    tag0 = fc->tag_counter++;
+    tag1 = fc->tag_counter++;
+    tag2 = fc->tag_counter++;
+    last_continue_tag = fc->continue_tag;
+    last_break_tag = fc->break_tag;
+    fc->continue_tag = tag2;
+    fc->break_tag = tag1;
+    write_expression_assembly(X0, stmt->init_exp, fc);
+    mir_label(mf, tag0);
+    if(stmt->loop_condition->type != EMPTY_EXP) {
+      write_condition_branch(stmt->loop_condition, 0, tag1, fc);
+    }
+    write_statement_assembly(stmt->loop_stmt, fc, ret_tag);
+    mir_label(mf, tag2);
+    write_expression_assembly(X0, stmt->post_exp, fc);
+    mir_branch(mf, MIR_B, A64_AL, tag0);
+    mir_label(mf, tag1);
+    fc->continue_tag = last_continue_tag;
+    fc->break_tag = last_break_tag;
+    break;
+  case FORDECL_LOOP:
+    tag0 = fc->tag_counter++;
+    tag1 = fc->tag_counter++;
+    tag2 = fc->tag_counter++;
+    last_continue_tag = fc->continue_tag;
+    last_break_tag = fc->break_tag;
+    fc->continue_tag = tag2;
+    fc->break_tag = tag1;
+    SymbolTable* for_st = malloc(sizeof(SymbolTable));
+    for_st->top = NULL;
+    for_st->next = fc->top_st;
+    fc->top_st = for_st;
+    push_constructed_symbol(NULL, 0, for_st);
+    write_declaration_assembly(stmt->init_decl, fc);
+    mir_label(mf, tag0);
+    if(stmt->loop_condition->type != EMPTY_EXP) {
+      write_condition_branch(stmt->loop_condition, 0, tag1, fc);
+    }
+    write_statement_assembly(stmt->loop_stmt, fc, ret_tag);
+    mir_label(mf, tag2);
+    write_expression_assembly(X0, stmt->post_exp, fc);
+    mir_branch(mf, MIR_B, A64_AL, tag0);
+    mir_label(mf, tag1);
+    fc->top_st = for_st->next;
+    delete_symbol_table(for_st);
+    fc->continue_tag = last_continue_tag;
+    fc->break_tag = last_break_tag;
+    break;
+  case CONTINUE_STATEMENT:
+    if(fc->continue_tag < 0) {
+      puts("Error: continue not in loop.");
+      exit(1);  
+    }
+    mir_branch(mf, MIR_B, A64_AL, fc->continue_tag);
+    break;
+  case BREAK_STATEMENT:
+    if(fc->break_tag < 0) {
+      puts("Error: break not in loop.");
+      exit(1);
+    }
+    mir_branch(mf, MIR_B, A64_AL, fc->break_tag);
+    break;
+  case BLOCK_STATEMENT:
+    write_block_assembly(stmt->block, fc, ret_tag);
+    break;
+  case SWITCH_STATEMENT:
+    tag0 = fc->tag_counter++;
+    last_break_tag = fc->break_tag;
+    fc->break_tag = tag0;
+    write_expression_assembly(X0, stmt->switch_exp, fc);
+    if(!write_switch_lookup(stmt, tag0, ret_tag, fc)) {
+      write_switch_dispatch(stmt, tag0, fc);
+      write_block_assembly(stmt->switch_block, fc, ret_tag);
+    }
+    mir_label(mf, tag0);
+    fc->break_tag = last_break_tag;
+    break;
+  case CASE_STATEMENT:
+  case DEFAULT_STATEMENT:
+    mir_label(mf, find_case_tag(fc->summary, stmt));
+    break;
+  case GOTO_STATEMENT:
+    if(!find_label_tag(fc->summary, stmt->label_name, &label)) {
+      puts("Error: Could not find label for goto");
+      puts(stmt->label_name);
+      exit(1);
+    }
+    mir_branch(mf, MIR_B, A64_AL, label);
+    break;
+  case LABEL:
+    find_label_tag(fc->summary, stmt->label_name, &label);
+    mir_label(mf, label);
+    break;
+  case EXPRESSION:
+    write_expression_assembly(X0, stmt->expression, fc);
+    break;
+  default:
+    break;
+  }
+}
 
-  fclose(as_file);
+// A case label straight after another shares its code, so each case
+// goes to the first label of its run. Bit tests then see one target
+// where the source has several labels.
+void write_switch_dispatch(StatementNode* switch_stmt, int break_tag,
+                           FunctionCodegen* fc)
+{
+  SwitchSummary* sw = find_switch_summary(fc->summary, switch_stmt);
+  BlockNode* block = switch_stmt->switch_block;
+  // The switch's own tags span lo..hi, so remap is indexed by tag - lo
+  size_t lo = sw->has_default ? sw->default_tag : SIZE_MAX;
+  size_t hi = sw->has_default ? sw->default_tag : 0;
+  for(size_t c = 0; c < sw->case_count; c++) {
+    lo = sw->cases[c].tag < lo ? sw->cases[c].tag : lo;
+    hi = sw->cases[c].tag > hi ? sw->cases[c].tag : hi;
+  }
+  size_t span = lo <= hi ? hi - lo + 1 : 1;
+  CaseLabel* cases = malloc(sizeof(CaseLabel) * (sw->case_count + 1));
+  size_t* remap = malloc(sizeof(size_t) * span);
+  if(!cases || !remap) {
+    perror("Error");
+    exit(1);
+  }
+  for(size_t t = 0; t < span; t++) {
+    remap[t] = lo + t;
+  }
+  size_t run = SIZE_MAX;
+  for(size_t i = 0; i < block->count; i++) {
+    BlockItem* item = block->body[i];
+    if(item->type != STATEMENT_ITEM
+       || (item->stmt->type != CASE_STATEMENT
+           && item->stmt->type != DEFAULT_STATEMENT)) {
+      run = SIZE_MAX;
+      continue;
+    }
+    size_t tag = find_case_tag(fc->summary, item->stmt);
+    if(run == SIZE_MAX) {
+      run = tag;
+    }
+    remap[tag - lo] = run;
+  }
+  size_t default_tag = sw->has_default ? remap[sw->default_tag - lo]
+                                       : (size_t)break_tag;
+  for(size_t c = 0; c < sw->case_count; c++) {
+    cases[c].val = sw->cases[c].val;
+    cases[c].tag = remap[sw->cases[c].tag - lo];
+  }
+  // Jump tables need adr and br, which x86-64 has no lowering for
+  SwitchTables* tables = &fc->switch_tables;
+  if(compile_opts->target == X86_64_LINUX_TARGET) {
+    tables = NULL;
+  }
+  lower_switch(&fc->mf, cases, sw->case_count, default_tag, &fc->tag_counter,
+               tables, &fc->switch_stats);
+  free(cases);
+  free(remap);
 }
 
-void write_ast_assembly(ProgramNode prgm, FILE* as_file)
+// A switch whose cases each only assign a constant to one variable, or
+// only return a constant, loads the value from a table instead. There is
+// no code for the cases at all, just a path for default.
+int write_switch_lookup(StatementNode* switch_stmt, int break_tag,
+                        int ret_tag, FunctionCodegen* fc)
 {
-  if(prgm.main) {
-    fputs("_main:\n", as_file);
-    func_stack_offset = count_local_vars(prgm.main->body);
-    if(func_stack_offset % 16) {
-      func_stack_offset += (16 - func_stack_offset % 16);
+  if(compile_opts->opt_level < 1
+     || compile_opts->target == X86_64_LINUX_TARGET) {
+    return 0;
+  }
+  MirFunction* mf = &fc->mf;
+  SwitchSummary* sw = find_switch_summary(fc->summary, switch_stmt);
+  BlockNode* block = switch_stmt->switch_block;
+  CaseValue* cases = malloc(sizeof(CaseValue) * (sw->case_count + 1));
+  if(!cases) {
+    perror("Error");
+    exit(1);
+  }
+  ExpressionNode* var = NULL;
+  int returns = -1;
+  int has_default = 0;
+  uint32_t fill = 0;
+  size_t count = 0;
+  size_t i = 0;
+  while(i < block->count) {
+    size_t first = i;
+    while(i < block->count && is_case_label(block->body[i])) {
+      i++;
+    }
+    size_t end = i;
+    ExpressionNode* assigned = NULL;
+    uint32_t bits;
+    if(end == first || end == block->count
+       || !switch_case_value(block, &i, &assigned, &returns, &bits)
+       || (var && strcmp(var->var_name, assigned->var_name))) {
+      free(cases);
+      return 0;
+    }
+    var = assigned;
+    for(size_t j = first; j < end; j++) {
+      StatementNode* label = block->body[j]->stmt;
+      if(label->type == DEFAULT_STATEMENT) {
+        has_default = 1;
+        fill = bits;
+      } else {
+        cases[count++] = (CaseValue){label->val, bits};
+      }
+    }
+  }
+  // Labels in nested statements would be missed
+  if(count != sw->case_count || has_default != sw->has_default
+     || !plan_lookup(cases, count, has_default)) {
+    free(cases);
+    return 0;
+  }
+  int miss = has_default ? fc->tag_counter++ : break_tag;
+  lower_switch_lookup(mf, cases, count, fill, miss, &fc->tag_counter,
+                      &fc->switch_tables, &fc->switch_stats);
+  for(int path = 0; path <= has_default; path++) {
+    if(path) {
+      if(!returns) {
+        mir_branch(mf, MIR_B, A64_AL, break_tag);
+      }
+      mir_label(mf, miss);
+      mir_mov_imm(mf, 0, 4, X0, (int32_t)fill);
+    }
+    if(returns) {
+      mir_branch(mf, MIR_B, A64_AL, ret_tag);
+    } else {
+      int size = variable_access_size(var);
+      mir_stack(mf, MIR_STR, size == 8, size, X0,
+                get_symbol_offset(fc, var->var_name));
+    }
+  }
+  free(cases);
+  return 1;
+}
+
+// The statement after a run of case labels at *index, moving past it and
+// the break that ends it. It must be var = constant, or return constant
+// when *returns is 1, and *returns is set by the first case it is -1 for.
+// A break is optional at the end of the switch and after a return.
+int switch_case_value(BlockNode* block, size_t* index, ExpressionNode** var,
+                      int* returns, uint32_t* bits)
+{
+  BlockItem* item = block->body[*index];
+  if(item->type != STATEMENT_ITEM) {
+    return 0;
+  }
+  StatementNode* stmt = item->stmt;
+  ExpressionNode* value = NULL;
+  int is_return = stmt->type == RETURN_STATEMENT;
+  if(is_return) {
+    value = stmt->expression;
+  } else if(stmt->type == EXPRESSION && stmt->expression->type == ASSIGN_EXP
+            && stmt->expression->left_operand->type == VAR_EXP) {
+    *var = stmt->expression->left_operand;
+    value = stmt->expression->right_operand;
+  }
+  if(!value || (*returns >= 0 && *returns != is_return)
+     || !constant_bits(value, bits)) {
+    return 0;
+  }
+  *returns = is_return;
+  (*index)++;
+  if(*index == block->count) {
+    return 1;
+  }
+  item = block->body[*index];
+  if(item->type == STATEMENT_ITEM && item->stmt->type == BREAK_STATEMENT) {
+    (*index)++;
+    return 1;
+  }
+  return is_return;
+}
+
+int is_case_label(BlockItem* item)
+{
+  return item->type == STATEMENT_ITEM
+         && (item->stmt->type == CASE_STATEMENT
+             || item->stmt->type == DEFAULT_STATEMENT);
+}
+
+// What a literal, or a negated one, leaves in its register, when that
+// fits a w register
+int constant_bits(ExpressionNode* exp, uint32_t* bits)
+{
+  int negate = exp->type == NEGATE;
+  long value;
+  if(negate) {
+    exp = exp->unary_operand;
+  }
+  if(!literal_value(exp, &value)) {
+    return 0;
+  }
+  int wide = exp->type == LONG_VALUE || exp->type == ULONG_VALUE
+             || exp->type == LONGLONG_VALUE || exp->type == ULONGLONG_VALUE;
+  unsigned long reg = wide ? (unsigned long)value : (uint32_t)value;
+  if(negate) {
+    reg = wide ? -reg : (uint32_t)-reg;
+  }
+  if(reg > UINT32_MAX) {
+    return 0;
+  }
+  *bits = reg;
+  return 1;
+}
+
+// Expressions are flattened into an array of steps in evaluation order
+// and emitted by a loop, so deep nesting costs no C stack
+void write_expression_assembly(Register reg, ExpressionNode* exp,
+                               FunctionCodegen* fc)
+{
+  number_expression(fc, exp);
+  flatten_expression(fc, reg, exp);
+  for(size_t i = 0; i < fc->exp_step_count; i++) {
+    write_expression_step(&fc->exp_steps[i], &fc->mf);
+  }
+}
+
+// Branches to tag when cond is nonzero, or when it is zero if on_true is
+// 0. && and || branch straight to where their operands decide they go,
+// and the rest test the flags they set where they can.
+void write_condition_branch(ExpressionNode* root, int root_on_true,
+                            int root_tag, FunctionCodegen* fc)
+{
+  fc->cond_work_count = 0;
+  push_cond_work(fc, root, root_on_true, root_tag);
+  while(fc->cond_work_count) {
+    CondWork work = fc->cond_work[--fc->cond_work_count];
+    ExpressionNode* cond = work.cond;
+    if(!cond) {
+      mir_label(&fc->mf, work.tag);
+      continue;
+    }
+    while(cond->type == LOG_NOT) {
+      cond = cond->unary_operand;
+      work.on_true = !work.on_true;
+    }
+    if(cond->type != AND_BINEXP && cond->type != OR_BINEXP) {
+      write_flags_branch(cond, work.on_true, work.tag, fc);
+      continue;
+    }
+    if(write_compare_chain(cond, work.on_true, work.tag, fc)) {
+      continue;
+    }
+    // The left operand decides the result when it is 0 for && and 1 for
+    // ||. When that isn't where the branch goes, it skips the right.
+    int decides = cond->type == OR_BINEXP;
+    if(work.on_true == decides) {
+      push_cond_work(fc, cond->right_operand, work.on_true, work.tag);
+      push_cond_work(fc, cond->left_operand, work.on_true, work.tag);
+    } else {
+      int skip = fc->tag_counter++;
+      push_cond_work(fc, NULL, 0, skip);
+      push_cond_work(fc, cond->right_operand, work.on_true, work.tag);
+      push_cond_work(fc, cond->left_operand, decides, skip);
+    }
+  }
+}
+
+// Comparisons and additions and subtractions branch on the flags they
+// set rather than making a 0 or 1 to test
+void write_flags_branch(ExpressionNode* cond, int on_true, int tag,
+                        FunctionCodegen* fc)
+{
+  MirFunction* mf = &fc->mf;
+  A64Cond test;
+  switch(cond->type) {
+  case EQ_BINEXP:
+  case NEQ_BINEXP:
+  case GT_BINEXP:
+  case GEQ_BINEXP:
+  case LT_BINEXP:
+  case LEQ_BINEXP:
+    test = compare_conds[cond->type];
+    break;
+  case ADD_BINEXP:
+  case SUB_BINEXP:
+    test = A64_NE;
+    break;
+  default:
+    write_expression_assembly(X0, cond, fc);
+    mir_cbz(mf, on_true ? MIR_CBNZ : MIR_CBZ,
+            is_wide_type(cond->value_type), X0, tag);
+    return;
+  }
+  // The operator's own step comes last, everything before it leaves the
+  // operands in x0 and x1
+  number_expression(fc, cond);
+  flatten_expression(fc, X0, cond);
+  ExpStep* root = &fc->exp_steps[--fc->exp_step_count];
+  assert((root->type == cond->type || root->type == IMMEDIATE_STEP)
+         && root->reg == X0);
+  for(size_t i = 0; i < fc->exp_step_count; i++) {
+    write_expression_step(&fc->exp_steps[i], mf);
+  }
+  int left = root->swapped;
+  int right = !root->swapped;
+  if(root->type == IMMEDIATE_STEP) {
+    // x + c and x - c are zero when x is -c and c
+    if(root->op == MIR_CMP_IMM) {
+      test = root->cond;
+    }
+    mir_cmp_imm(mf, root->sf, X0,
+                root->op == MIR_ADD_IMM ? -root->imm : root->imm);
+  } else if(cond->type == ADD_BINEXP) {
+    mir_rrr(mf, MIR_CMN, root->sf, A64_ZR, left, right);
+  } else {
+    mir_cmp(mf, root->sf, left, right);
+  }
+  mir_branch(mf, MIR_BCOND, on_true ? test : a64_invert_cond(test), tag);
+}
+
+// a < b && c == d && ... as cmp, then a ccmp per comparison that only
+// compares while the result is still undecided and otherwise sets flags
+// that keep it, and one branch. Only for comparisons of variables and
+// literals, which are cheap and safe to evaluate when the branches
+// would have skipped them. Returns 0 for anything else.
+int write_compare_chain(ExpressionNode* cond, int on_true, int tag,
+                        FunctionCodegen* fc)
+{
+  if(compile_opts->target == X86_64_LINUX_TARGET) {
+    return 0;
+  }
+  ExpressionNode* compares[MAX_CCMP_CHAIN];
+  size_t count = 0;
+  ExpressionNode* node = cond;
+  while(node->type == cond->type && count < MAX_CCMP_CHAIN) {
+    compares[count++] = node->right_operand;
+    node = node->left_operand;
+  }
+  if(node->type == cond->type || count == MAX_CCMP_CHAIN) {
+    return 0;
+  }
+  compares[count++] = node;
+  for(size_t i = 0; i < count; i++) {
+    ExpressionNode* compare = compares[i];
+    if(compare->type < EQ_BINEXP || compare->type > LEQ_BINEXP
+       || !is_leaf_operand(compare->left_operand)
+       || !is_leaf_operand(compare->right_operand)) {
+      return 0;
+    }
+  }
+  // Leftmost first. For && a comparison is only made when the one
+  // before it held, for || when it failed. A literal is the immediate
+  // when it fits, 12 bits for cmp and 5 for ccmp.
+  MirFunction* mf = &fc->mf;
+  int is_and = cond->type == AND_BINEXP;
+  A64Cond test = A64_AL;
+  long value;
+  for(size_t i = count; i-- > 0;) {
+    ExpressionNode* compare = compares[i];
+    ExpressionNode* left = compare->left_operand;
+    ExpressionNode* right = compare->right_operand;
+    int sf = is_wide_type(compare->value_type);
+    A64Cond next = compare_conds[compare->type];
+    if(compile_opts->opt_level >= 1 && !literal_value(right, &value)
+       && literal_value(left, &value)) {
+      left = compare->right_operand;
+      right = compare->left_operand;
+      next = reversed_conds[compare->type];
+    }
+    if(compile_opts->opt_level >= 1 && literal_value(right, &value)
+       && !(sf && value < 0 && !is_wide_type(right->value_type))) {
+      value = sf ? value : (int32_t)(uint32_t)value;
+      if(test == A64_AL ? a64_addsub_fits(value)
+                        : value >= 0 && value < 32) {
+        write_expression_assembly(X0, left, fc);
+        if(test == A64_AL) {
+          mir_cmp_imm(mf, sf, X0, value);
+        } else {
+          mir_ccmp_imm(mf, sf, X0, value, a64_cond_nzcv(next, !is_and),
+                       is_and ? test : a64_invert_cond(test));
+        }
+        test = next;
+        continue;
+      }
+    }
+    write_expression_assembly(X0, left, fc);
+    write_expression_assembly(X1, right, fc);
+    if(test == A64_AL) {
+      mir_cmp(mf, sf, X0, X1);
+    } else {
+      mir_ccmp(mf, sf, X0, X1, a64_cond_nzcv(next, !is_and),
+               is_and ? test : a64_invert_cond(test));
+    }
+    test = next;
+  }
+  mir_branch(mf, MIR_BCOND, on_true ? test : a64_invert_cond(test), tag);
+  return 1;
+}
+
+// Loaded without touching the flags or anything else
+int is_leaf_operand(ExpressionNode* exp)
+{
+  switch(exp->type) {
+  case CHAR_VALUE:
+  case UCHAR_VALUE:
+  case SHORT_VALUE:
+  case USHORT_VALUE:
+  case INT_VALUE:
+  case UINT_VALUE:
+  case LONG_VALUE:
+  case ULONG_VALUE:
+  case LONGLONG_VALUE:
+  case ULONGLONG_VALUE:
+  case VAR_EXP:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+// if(c) x = a; else x = b; and if(c) x = a; as x = c ? a : b and
+// x = c ? a : x, when that ?: becomes a select. Returns 0 otherwise.
+int write_select_statement(StatementNode* stmt, FunctionCodegen* fc)
+{
+  ExpressionNode* assign = single_assignment(stmt->if_stmt);
+  if(!assign) {
+    return 0;
+  }
+  ExpressionNode* else_value = assign->left_operand;
+  if(stmt->else_stmt) {
+    ExpressionNode* other = single_assignment(stmt->else_stmt);
+    if(!other || strcmp(other->left_operand->var_name,
+                        assign->left_operand->var_name)) {
+      return 0;
+    }
+    else_value = other->right_operand;
+  }
+  ExpressionNode select = {.type = COND_EXP};
+  select.value_type = assign->left_operand->value_type;
+  select.condition = stmt->condition;
+  select.if_exp = assign->right_operand;
+  select.else_exp = else_value;
+  ExpressionNode root = *assign;
+  root.right_operand = &select;
+  SelectPlan plan;
+  number_expression(fc, &root);
+  if(!plan_select(&select, &plan)) {
+    return 0;
+  }
+  write_expression_assembly(X0, &root, fc);
+  return 1;
+}
+
+// The assignment to a variable that is all the statement does, or NULL
+ExpressionNode* single_assignment(StatementNode* stmt)
+{
+  while(stmt->type == BLOCK_STATEMENT && stmt->block->count == 1
+        && stmt->block->body[0]->type == STATEMENT_ITEM) {
+    stmt = stmt->block->body[0]->stmt;
+  }
+  if(stmt->type != EXPRESSION || stmt->expression->type != ASSIGN_EXP) {
+    return NULL;
+  }
+  return stmt->expression;
+}
+
+// Decides whether the ?: becomes a select and how. The comparison's
+// operands come first so arms that repeat them, as in min, max and abs,
+// reuse their registers, and a +1, ~ or - on an arm folds into csinc,
+// csinv or csneg. Only AArch64 has the instructions.
+int plan_select(ExpressionNode* exp, SelectPlan* plan)
+{
+  if(compile_opts->opt_level < 1
+     || compile_opts->target == X86_64_LINUX_TARGET
+     || exp->condition->side_effects || exp->if_exp->side_effects
+     || exp->else_exp->side_effects) {
+    return 0;
+  }
+  *plan = (SelectPlan){.item_count = 0};
+  ExpressionNode* cond = exp->condition;
+  int inverted = 0;
+  while(cond->type == LOG_NOT) {
+    cond = cond->unary_operand;
+    inverted = !inverted;
+  }
+  if(cond->type == AND_BINEXP || cond->type == OR_BINEXP) {
+    return 0;
+  }
+  if(cond->type >= EQ_BINEXP && cond->type <= LEQ_BINEXP) {
+    plan->compare_rn = select_item(plan, cond->left_operand, 0);
+    plan->compare_rm = select_item(plan, cond->right_operand, 1);
+    plan->cond = compare_conds[cond->type];
+  } else {
+    plan->compare_rn = select_item(plan, cond, 0);
+    plan->compare_rm = A64_ZR;
+    plan->cond = A64_NE;
+  }
+  plan->compare_sf = is_wide_type(cond->value_type);
+  if(inverted) {
+    plan->cond = a64_invert_cond(plan->cond);
+  }
+  int compare_items = plan->item_count;
+  // Only the else operand of a select can take a modifier
+  int sf = is_wide_type(exp->value_type);
+  ExpressionNode* if_base;
+  ExpressionNode* else_base;
+  MirOp if_op = select_modifier(exp->if_exp, sf, &if_base);
+  MirOp else_op = select_modifier(exp->else_exp, sf, &else_base);
+  if(if_op != MIR_CSEL && else_op == MIR_CSEL) {
+    plan->cond = a64_invert_cond(plan->cond);
+    plan->op = if_op;
+    plan->rn = select_item(plan, exp->else_exp, 1);
+    plan->rm = select_item(plan, if_base, 1);
+  } else {
+    plan->op = else_op;
+    plan->rn = select_item(plan, exp->if_exp, 1);
+    plan->rm = select_item(plan, else_base, 1);
+  }
+  int budget = MAX_SELECT_COST;
+  for(int i = compare_items; i < plan->item_count; i++) {
+    if(!within_cost(plan->items[i], &budget)) {
+      return 0;
+    }
+  }
+  int rn = plan->compare_rn;
+  int rm = plan->compare_rm;
+  if(plan->op == MIR_CSEL && rm != A64_ZR
+     && ((plan->rn == rn && plan->rm == rm)
+         || (plan->rn == rm && plan->rm == rn))) {
+    plan->idiom = MINMAX_SELECT;
+  } else if(plan->op == MIR_CSNEG && rm == A64_ZR && plan->rn == rn
+            && plan->rm == rn) {
+    plan->idiom = ABS_SELECT;
+  }
+  return 1;
+}
+
+// The operand under an arm of x + 1, ~x or -x, and the select that
+// applies it, or the arm itself and csel. NULL stands for zero.
+MirOp select_modifier(ExpressionNode* arm, int sf, ExpressionNode** base)
+{
+  long value;
+  *base = arm;
+  if(literal_value(arm, &value) && value == 1) {
+    *base = NULL;
+    return MIR_CSINC;
+  }
+  // The operation has to happen at the width of the select
+  if(is_wide_type(arm->value_type) != sf) {
+    return MIR_CSEL;
+  }
+  switch(arm->type) {
+  case ADD_BINEXP:
+    if(literal_value(arm->right_operand, &value) && value == 1) {
+      *base = arm->left_operand;
+      return MIR_CSINC;
+    }
+    if(literal_value(arm->left_operand, &value) && value == 1) {
+      *base = arm->right_operand;
+      return MIR_CSINC;
+    }
+    return MIR_CSEL;
+  case BITWISE_COMP:
+    *base = arm->unary_operand;
+    return MIR_CSINV;
+  case NEGATE:
+    *base = arm->unary_operand;
+    return MIR_CSNEG;
+  default:
+    return MIR_CSEL;
+  }
+}
+
+// The item holding exp's value, added if no earlier one does. Zero is
+// the zero register where zero_ok.
+int select_item(SelectPlan* plan, ExpressionNode* exp, int zero_ok)
+{
+  long value;
+  if(!exp || (zero_ok && literal_value(exp, &value) && !value)) {
+    return A64_ZR;
+  }
+  for(int i = 0; i < plan->item_count; i++) {
+    if(same_leaf(plan->items[i], exp)) {
+      return i;
+    }
+  }
+  assert(plan->item_count < MAX_SELECT_ITEMS);
+  plan->items[plan->item_count] = exp;
+  return plan->item_count++;
+}
+
+// Whether both are the same variable or literal
+int same_leaf(ExpressionNode* a, ExpressionNode* b)
+{
+  long x;
+  long y;
+  if(a == b) {
+    return 1;
+  }
+  if(a->type == VAR_EXP && b->type == VAR_EXP) {
+    return !strcmp(a->var_name, b->var_name);
+  }
+  return a->type == b->type && literal_value(a, &x) && literal_value(b, &y)
+         && x == y;
+}
+
+int literal_value(ExpressionNode* exp, long* value)
+{
+  switch(exp->type) {
+  case CHAR_VALUE:
+    *value = exp->char_value;
+    return 1;
+  case UCHAR_VALUE:
+    *value = exp->uchar_value;
+    return 1;
+  case SHORT_VALUE:
+    *value = exp->short_value;
+    return 1;
+  case USHORT_VALUE:
+    *value = exp->ushort_value;
+    return 1;
+  case INT_VALUE:
+    *value = exp->int_value;
+    return 1;
+  case UINT_VALUE:
+    *value = exp->uint_value;
+    return 1;
+  case LONG_VALUE:
+    *value = exp->long_value;
+    return 1;
+  case ULONG_VALUE:
+    *value = exp->ulong_value;
+    return 1;
+  case LONGLONG_VALUE:
+    *value = exp->longlong_value;
+    return 1;
+  case ULONGLONG_VALUE:
+    *value = exp->ulonglong_value;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+// Takes about an instruction per operator and operand off the budget.
+// Anything slow or with control flow of its own is over it. Only
+// recurses as deep as the budget.
+int within_cost(ExpressionNode* exp, int* budget)
+{
+  ExpressionNode* operands[3];
+  switch(exp->type) {
+  case DIV_BINEXP:
+  case MOD_BINEXP:
+  case AND_BINEXP:
+  case OR_BINEXP:
+  case COND_EXP:
+    return 0;
+  case EQ_BINEXP:
+  case NEQ_BINEXP:
+  case GT_BINEXP:
+  case GEQ_BINEXP:
+  case LT_BINEXP:
+  case LEQ_BINEXP:
+  case LOG_NOT:
+    *budget -= 2;
+    break;
+  default:
+    *budget -= 1;
+    break;
+  }
+  if(*budget < 0) {
+    return 0;
+  }
+  size_t count = expression_operands(exp, operands);
+  for(size_t i = 0; i < count; i++) {
+    if(!within_cost(operands[i], budget)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void print_select_stats(SelectStats* stats)
+{
+  fprintf(stderr, "select: %zu branches replaced, %zu min/max, %zu abs\n",
+          stats->selects, stats->minmax, stats->abs);
+}
+
+// Sethi-Ullman numbering, children before parents. A node stays on the
+// work stack with phase set while its operands are numbered above it.
+void number_expression(FunctionCodegen* fc, ExpressionNode* root)
+{
+  ExpressionNode* operands[3];
+  fc->exp_work_count = 0;
+  push_exp_work(fc, root, X0);
+  while(fc->exp_work_count) {
+    ExpWork* work = &fc->exp_work[fc->exp_work_count-1];
+    ExpressionNode* exp = work->exp;
+    if(work->step.phase) {
+      exp->reg_need = register_need(exp);
+      exp->side_effects = has_side_effects(exp);
+      fc->exp_work_count--;
+      continue;
+    }
+    work->step.phase = 1;
+    size_t count = expression_operands(exp, operands);
+    for(size_t i = 0; i < count; i++) {
+      push_exp_work(fc, operands[i], X0);
+    }
+  }
+}
+
+// How many registers from the one a node is evaluated into its code
+// uses, given the order flatten_expression picks
+int register_need(ExpressionNode* exp)
+{
+  int need = 1;
+  ExpressionNode* operands[3];
+  size_t count = expression_operands(exp, operands);
+  for(size_t i = 0; i < count; i++) {
+    if(operands[i]->reg_need > need) {
+      need = operands[i]->reg_need;
+    }
+  }
+  SelectPlan plan;
+  switch(exp->type) {
+  case COND_EXP:
+    if(plan_select(exp, &plan)) {
+      for(int i = 0; i < plan.item_count; i++) {
+        if(i + plan.items[i]->reg_need > need) {
+          need = i + plan.items[i]->reg_need;
+        }
+      }
+    }
+    return need;
+  case MOD_BINEXP:
+    // The quotient goes in a third register
+    need = binary_register_need(exp);
+    return need > 3 ? need : 3;
+  case ADD_BINEXP:
+  case SUB_BINEXP:
+  case MUL_BINEXP:
+  case DIV_BINEXP:
+  case EQ_BINEXP:
+  case NEQ_BINEXP:
+  case GT_BINEXP:
+  case GEQ_BINEXP:
+  case LT_BINEXP:
+  case LEQ_BINEXP:
+  case BITAND_BINEXP:
+  case BITOR_BINEXP:
+  case BITXOR_BINEXP:
+  case LSHIFT_BINEXP:
+  case RSHIFT_BINEXP:
+    return binary_register_need(exp);
+  case PLUSEQ_EXP:
+  case MINUSEQ_EXP:
+  case TIMESEQ_EXP:
+  case DIVEQ_EXP:
+  case LSHEQ_EXP:
+  case RSHEQ_EXP:
+  case ANDEQ_EXP:
+  case OREQ_EXP:
+  case XOREQ_EXP:
+  case POSTINC_EXP:
+  case POSTDEC_EXP:
+    return need > 2 ? need : 2;
+  case MODEQ_EXP:
+    return need > 3 ? need : 3;
+  default:
+    return need;
+  }
+}
+
+// Both operands of a binary operator are live at once. The heavier one
+// goes first, so the other fits in the registers it has finished with.
+int binary_register_need(ExpressionNode* exp)
+{
+  int left = exp->left_operand->reg_need;
+  int right = exp->right_operand->reg_need;
+  if(left == right || (right > left && !swappable_operands(exp))) {
+    return right + 1;
+  }
+  return left > right ? left : right;
+}
+
+// The order is unspecified, but code like --y + y++ keeps the left to
+// right result it gets from gcc and the VM
+int swappable_operands(ExpressionNode* exp)
+{
+  return !exp->left_operand->side_effects
+         && !exp->right_operand->side_effects;
+}
+
+int has_side_effects(ExpressionNode* exp)
+{
+  ExpressionNode* operands[3];
+  size_t count = expression_operands(exp, operands);
+  for(size_t i = 0; i < count; i++) {
+    if(operands[i]->side_effects) {
+      return 1;
+    }
+  }
+  switch(exp->type) {
+  case ASSIGN_EXP:
+  case PLUSEQ_EXP:
+  case MINUSEQ_EXP:
+  case TIMESEQ_EXP:
+  case DIVEQ_EXP:
+  case MODEQ_EXP:
+  case LSHEQ_EXP:
+  case RSHEQ_EXP:
+  case ANDEQ_EXP:
+  case OREQ_EXP:
+  case XOREQ_EXP:
+  case PREINC_EXP:
+  case PREDEC_EXP:
+  case POSTINC_EXP:
+  case POSTDEC_EXP:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+size_t expression_operands(ExpressionNode* exp, ExpressionNode** operands)
+{
+  switch(exp->type) {
+  case NEGATE:
+  case BITWISE_COMP:
+  case LOG_NOT:
+    operands[0] = exp->unary_operand;
+    return 1;
+  case PREINC_EXP:
+  case PREDEC_EXP:
+  case POSTINC_EXP:
+  case POSTDEC_EXP:
+    operands[0] = exp->left_operand;
+    return 1;
+  case COND_EXP:
+    operands[0] = exp->condition;
+    operands[1] = exp->if_exp;
+    operands[2] = exp->else_exp;
+    return 3;
+  case ADD_BINEXP:
+  case SUB_BINEXP:
+  case MUL_BINEXP:
+  case DIV_BINEXP:
+  case EQ_BINEXP:
+  case NEQ_BINEXP:
+  case GT_BINEXP:
+  case GEQ_BINEXP:
+  case LT_BINEXP:
+  case LEQ_BINEXP:
+  case AND_BINEXP:
+  case OR_BINEXP:
+  case MOD_BINEXP:
+  case BITAND_BINEXP:
+  case BITOR_BINEXP:
+  case BITXOR_BINEXP:
+  case LSHIFT_BINEXP:
+  case RSHIFT_BINEXP:
+  case ASSIGN_EXP:
+  case PLUSEQ_EXP:
+  case MINUSEQ_EXP:
+  case TIMESEQ_EXP:
+  case DIVEQ_EXP:
+  case MODEQ_EXP:
+  case LSHEQ_EXP:
+  case RSHEQ_EXP:
+  case ANDEQ_EXP:
+  case OREQ_EXP:
+  case XOREQ_EXP:
+  case COMMA_EXP:
+    operands[0] = exp->left_operand;
+    operands[1] = exp->right_operand;
+    return 2;
+  default:
+    return 0;
+  }
+}
+
+// x * c, x / c and x % c, compound assignments included, as one step on
+// x when c is a literal, or a negated one, that shifts and adds or a
+// multiply high handle faster than the multiply or divide. step gets
+// the type and c.
+int constant_operand_step(FunctionCodegen* fc, ExpressionNode* exp,
+                          ExpStep* step)
+{
+  long value;
+  MultiplyPlan plan;
+  if(compile_opts->opt_level < 1
+     || compile_opts->target == X86_64_LINUX_TARGET
+     || !literal_operand(exp->right_operand, &value)) {
+    return 0;
+  }
+  // As in immediate_operand_step, the register form zero extends a
+  // negative 32 bit literal
+  if(step->sf && value < 0 && !is_wide_type(exp->right_operand->value_type)) {
+    return 0;
+  }
+  switch(exp->type) {
+  case MUL_BINEXP:
+  case TIMESEQ_EXP:
+    if(!plan_multiply(step->sf, value, &plan)) {
+      return 0;
+    }
+    step->type = MUL_CONSTANT_STEP;
+    fc->strength_stats.multiplies++;
+    break;
+  case DIV_BINEXP:
+  case DIVEQ_EXP:
+    if(!reducible_divisor(step->sf, value)) {
+      return 0;
+    }
+    step->type = DIV_CONSTANT_STEP;
+    fc->strength_stats.divisions++;
+    break;
+  case MOD_BINEXP:
+  case MODEQ_EXP:
+    if(!reducible_divisor(step->sf, value)) {
+      return 0;
+    }
+    step->type = MOD_CONSTANT_STEP;
+    fc->strength_stats.remainders++;
+    break;
+  default:
+    return 0;
+  }
+  step->imm = value;
+  return 1;
+}
+
+// x op c for add, sub, and, orr, eor, the shifts and the comparisons,
+// compound assignments included, as one instruction on x when the
+// literal c fits its immediate. c may be on the left where the order
+// doesn't matter. step gets the type, the MirOp and c, and returns the
+// operand left to evaluate, or NULL when there is no immediate form.
+ExpressionNode* immediate_operand_step(ExpressionNode* exp, ExpStep* step)
+{
+  long value;
+  uint32_t bits;
+  ExpressionNode* operand = exp->left_operand;
+  ExpressionNode* literal = exp->right_operand;
+  int reversed = 0;
+  if(compile_opts->opt_level < 1
+     || compile_opts->target == X86_64_LINUX_TARGET) {
+    return NULL;
+  }
+  if(!literal_operand(literal, &value)) {
+    switch(exp->type) {
+    case ADD_BINEXP:
+    case BITAND_BINEXP:
+    case BITOR_BINEXP:
+    case BITXOR_BINEXP:
+    case EQ_BINEXP:
+    case NEQ_BINEXP:
+    case GT_BINEXP:
+    case GEQ_BINEXP:
+    case LT_BINEXP:
+    case LEQ_BINEXP:
+      literal = exp->left_operand;
+      if(!literal_operand(literal, &value)) {
+        return NULL;
+      }
+      operand = exp->right_operand;
+      reversed = 1;
+      break;
+    default:
+      return NULL;
+    }
+  }
+  // A 32 bit literal is zero extended in a register, so a 64 bit
+  // operation only takes one that is the same sign extended
+  if(step->sf && value < 0 && !is_wide_type(literal->value_type)) {
+    return NULL;
+  }
+  if(!step->sf) {
+    value = (int32_t)(uint32_t)value;
+  }
+  switch(exp->type) {
+  case ADD_BINEXP:
+  case SUB_BINEXP:
+  case PLUSEQ_EXP:
+  case MINUSEQ_EXP:
+    if(!a64_addsub_fits(value)) {
+      return NULL;
+    }
+    int sub = exp->type == SUB_BINEXP || exp->type == MINUSEQ_EXP;
+    step->op = sub != (value < 0) ? MIR_SUB_IMM : MIR_ADD_IMM;
+    value = value < 0 ? -value : value;
+    break;
+  case BITAND_BINEXP:
+  case BITOR_BINEXP:
+  case BITXOR_BINEXP:
+  case ANDEQ_EXP:
+  case OREQ_EXP:
+  case XOREQ_EXP:
+    if(!a64_bitmask_imm(step->sf, value, &bits)) {
+      return NULL;
     }
-    fprintf(as_file, "  sub sp, sp, #%i\n", func_stack_offset);
-    int ret_tag = tag_counter++;
-    top_st = NULL;
-    SymbolTable* label_st = malloc(sizeof(SymbolTable));
-    label_st->top = NULL;
-    label_st->next = labels;
-    labels = label_st;
-    curr_switch_table = NULL;
-    push_constructed_symbol(NULL, 0, labels);
-    construct_label_table(labels, prgm.main->body);
-    write_block_assembly(prgm.main->body, as_file, ret_tag);
-    fprintf(as_file, ".L%i:\n", ret_tag);
-    fprintf(as_file, "  add sp, sp, #%i\n", func_stack_offset);
-    fputs("  ret\n", as_file);
-  }
-}
-
-void write_block_assembly(BlockNode* block, FILE* as_file, int ret_tag)
-{
-  SymbolTable* block_st = malloc(sizeof(SymbolTable));
-  block_st->top = NULL;
-  block_st->next = top_st;
-  top_st = block_st;
-  // Why am I doing this?
-  push_constructed_symbol(NULL, 0, block_st);
-  for(unsigned int i = 0; i < block->count; i++) {
-    BlockItem* item = block->body[i];
-    if(item->type == STATEMENT_ITEM) {
-      write_statement_assembly(item->stmt, as_file, ret_tag);
-    } else {
-      write_declaration_assembly(item->decl, as_file);
+    step->op = immediate_ops[exp->type];
+    break;
+  case LSHIFT_BINEXP:
+  case RSHIFT_BINEXP:
+  case LSHEQ_EXP:
+  case RSHEQ_EXP:
+    // The register forms take the amount modulo the width too
+    step->op = immediate_ops[exp->type];
+    value &= step->sf ? 63 : 31;
+    break;
+  case EQ_BINEXP:
+  case NEQ_BINEXP:
+  case GT_BINEXP:
+  case GEQ_BINEXP:
+  case LT_BINEXP:
+  case LEQ_BINEXP:
+    if(!a64_addsub_fits(value)) {
+      return NULL;
     }
+    step->op = MIR_CMP_IMM;
+    step->cond = reversed ? reversed_conds[exp->type]
+                          : compare_conds[exp->type];
+    break;
+  default:
+    return NULL;
   }
-  top_st = block_st->next;
-  delete_symbol_table(block_st);
+  step->type = IMMEDIATE_STEP;
+  step->imm = value;
+  return operand;
 }
 
-void write_declaration_assembly(DeclarationNode* decl, FILE* as_file)
+// A literal, or a negated one
+int literal_operand(ExpressionNode* exp, long* value)
 {
-  static int next_offset = 0;
-  if(find_symbol(decl->var_name, top_st).name) {
-    puts("Error: duplicate declaration of variable:");
-    puts(decl->var_name);
-    fclose(as_file);
-    remove(assembly_filename);
-    exit(1);
+  if(exp->type != NEGATE) {
+    return literal_value(exp, value);
   }
-  next_offset += type_size(decl->var_type);
-  push_constructed_symbol(decl->var_name, next_offset, top_st);
-  if(decl->assignment_expression) {
-    write_expression_assembly(X0, decl->assignment_expression, as_file);
+  if(!literal_value(exp->unary_operand, value)) {
+    return 0;
   }
+  *value = -(unsigned long)*value;
+  return 1;
 }
 
-void write_statement_assembly(StatementNode* stmt, FILE* as_file, int ret_tag)
+// Walks the tree with an explicit work stack. Register checks, symbol
+// lookups and label numbering happen when a node is first reached,
+// which is the same order the code for it is emitted in.
+void flatten_expression(FunctionCodegen* fc, Register root_reg,
+                        ExpressionNode* root)
 {
-  static int current_continue_tag = -1;
-  static int current_break_tag = -1;
-  int last_continue_tag; 
-  int last_break_tag; 
-  int tag0;
-  int tag1;
-  int tag2;
-  Symbol label;
-  CaseLabelTableNode* node;
-  switch(stmt->type) {
-  case RETURN_STATEMENT:
-    write_expression_assembly(X0, stmt->expression, as_file); 
-    fprintf(as_file, "  b .L%i\n", ret_tag);
-    break;
-  case CONDITIONAL:
-    tag0 = tag_counter++;
-    if(stmt->else_stmt) {
-      tag1 = tag_counter++;
-    }
-    write_expression_assembly(X0, stmt->condition, as_file);
-    fprintf(as_file, "  cmp %c%i, 0\n", 
-        reg_prefix_for_type(stmt->condition->value_type), X0);
-    fprintf(as_file, "  beq .L%i\n", tag0);
-    write_statement_assembly(stmt->if_stmt, as_file, ret_tag);
-    if(stmt->else_stmt){
-      fprintf(as_file, "  b .L%i\n", tag1);
-    }
-    fprintf(as_file, ".L%i:\n", tag0);
-    if(stmt->else_stmt) {
-      write_statement_assembly(stmt->else_stmt, as_file, ret_tag);
-      fprintf(as_file, ".L%i:\n", tag1);
-    }
-    break;
-  case WHILE_LOOP:
-    tag0 = tag_counter++;
-    tag1 = tag_counter++;
-    last_continue_tag = current_continue_tag;
-    last_break_tag = current_break_tag;
-    current_continue_tag = tag0;
-    current_break_tag = tag1;
-    write_expression_assembly(X0, stmt->loop_condition, as_file);
-    fprintf(as_file, "  cmp %c%i, 0\n", 
-        reg_prefix_for_type(stmt->loop_condition->value_type), X0);
-    fprintf(as_file, "  beq .L%i\n", tag1);
-    fprintf(as_file, ".L%i:\n", tag0);
-    write_statement_assembly(stmt->loop_stmt, as_file, ret_tag);
-    write_expression_assembly(X0, stmt->loop_condition, as_file);
-    fprintf(as_file, "  cmp %c%i, 0\n", 
-        reg_prefix_for_type(stmt->loop_condition->value_type), X0);
-    fprintf(as_file, "  bne .L%i\n", tag0);
-    fprintf(as_file, ".L%i:\n", tag1);
-    current_continue_tag = last_continue_tag;
-    current_break_tag = last_break_tag;
-    break;
-  case DO_LOOP:
-    tag0 = tag_counter++;
-    tag1 = tag_counter++;
-    last_continue_tag = current_continue_tag;
-    last_break_tag = current_break_tag;
-    current_continue_tag = tag0;
-    current_break_tag = tag1;
-    fprintf(as_file, ".L%i:\n", tag0);
-    write_statement_assembly(stmt->loop_stmt, as_file, ret_tag);
-    write_expression_assembly(X0, stmt->loop_condition, as_file);
-    fprintf(as_file, "  cmp %c%i, 0\n", 
-        reg_prefix_for_type(stmt->loop_condition->value_type), X0);
-    fprintf(as_file, "  bne .L%i\n", tag0);
-    fprintf(as_file, ".L%i:\n", tag1);
-    current_continue_tag = last_continue_tag;
-    current_break_tag = last_break_tag;
-    break;
-  case FOR_LOOP:
-    tag0 = tag_counter++;
-    tag1 = tag_counter++;
-    tag2 = tag_counter++;
-    last_continue_tag = current_continue_tag;
-    last_break_tag = current_break_tag;
-    current_continue_tag = tag2;
-    current_break_tag = tag1;
-    write_expression_assembly(X0, stmt->init_exp, as_file);
-    fprintf(as_file, ".L%i:\n", tag0);
-    if(stmt->loop_condition->type != EMPTY_EXP) {
-      write_expression_assembly(X0, stmt->loop_condition, as_file);
-      fprintf(as_file, "  cmp %c%i, 0\n", 
-          reg_prefix_for_type(stmt->loop_condition->value_type), X0);
-      fprintf(as_file, "  beq .L%i\n", tag1);
-    }
-    write_statement_assembly(stmt->loop_stmt, as_file, ret_tag);
-    fprintf(as_file, ".L%i:\n", tag2);
-    write_expression_assembly(X0, stmt->post_exp, as_file);
-    fprintf(as_file, "  b .L%i\n", tag0);
-    fprintf(as_file, ".L%i:\n", tag1);
-    current_continue_tag = last_continue_tag;
-    current_break_tag = last_break_tag;
-    break;
-  case FORDECL_LOOP:
-    tag0 = tag_counter++;
-    tag1 = tag_counter++;
-    tag2 = tag_counter++;
-    last_continue_tag = current_continue_tag;
-    last_break_tag = current_break_tag;
-    current_continue_tag = tag2;
-    current_break_tag = tag1;
-    SymbolTable* for_st = malloc(sizeof(SymbolTable));
-    for_st->top = NULL;
-    for_st->next = top_st;
-    top_st = for_st;
-    push_constructed_symbol(NULL, 0, for_st);
-    write_declaration_assembly(stmt->init_decl, as_file);
-    fprintf(as_file, ".L%i:\n", tag0);
-    if(stmt->loop_condition->type != EMPTY_EXP) {
-      write_expression_assembly(X0, stmt->loop_condition, as_file);
-      fprintf(as_file, "  cmp %c%i, 0\n", 
-          reg_prefix_for_type(stmt->loop_condition->value_type), X0);
-      fprintf(as_file, "  beq .L%i\n", tag1);
-    }
-    write_statement_assembly(stmt->loop_stmt, as_file, ret_tag);
-    fprintf(as_file, ".L%i:\n", tag2);
-    write_expression_assembly(X0, stmt->post_exp, as_file);
-    fprintf(as_file, "  b .L%i\n", tag0);
-    fprintf(as_file, ".L%i:\n", tag1);
-    top_st = for_st->next;
-    delete_symbol_table(for_st);
-    current_continue_tag = last_continue_tag;
-    current_break_tag = last_break_tag;
-    break;
-  case CONTINUE_STATEMENT:
-    if(current_continue_tag < 0) {
-      puts("Error: continue not in loop.");
-      fclose(as_file);
-      remove(assembly_filename);
-      exit(1);  
+  SelectPlan plan;
+  ExpStep arith;
+  ExpressionNode* operand;
+  fc->exp_step_count = 0;
+  fc->exp_work_count = 0;
+  push_exp_work(fc, root, root_reg);
+  while(fc->exp_work_count) {
+    ExpWork work = fc->exp_work[--fc->exp_work_count];
+    if(!work.exp) {
+      if(work.step.type == RELOAD_STEP) {
+        fc->spill_used -= 8 * work.step.reg;
+      }
+      append_exp_step(fc, &work.step);
+      continue;
     }
-    fprintf(as_file, "  b .L%i\n", current_continue_tag);
-    break;
-  case BREAK_STATEMENT:
-    if(current_break_tag < 0) {
-      puts("Error: break not in loop.");
-      fclose(as_file);
-      remove(assembly_filename);
-      exit(1);
+    ExpressionNode* exp = work.exp;
+    Register reg = work.step.reg;
+    ExpStep step = work.step;
+    if(reg && reg + exp->reg_need - 1 > LAST_TEMP_REG) {
+      // Evaluate from x0 with everything under reg saved meanwhile
+      step.type = SPILL_STEP;
+      step.imm = fc->stack_offset + fc->spill_used;
+      append_exp_step(fc, &step);
+      step.type = RELOAD_STEP;
+      push_exp_step(fc, &step);
+      push_exp_work(fc, exp, X0);
+      fc->spill_used += 8 * reg;
+      if(fc->spill_used > fc->spill_size) {
+        fc->spill_size = fc->spill_used;
+      }
+      continue;
     }
-    fprintf(as_file, "  b .L%i\n", current_break_tag);
-    break;
-  case BLOCK_STATEMENT:
-    write_block_assembly(stmt->block, as_file, ret_tag);
-    break;
-  case SWITCH_STATEMENT:
-    tag0 = tag_counter++;
-    last_break_tag = current_break_tag;
-    current_break_tag = tag0;
-    write_expression_assembly(X0, stmt->switch_exp, as_file);
-    write_switch_case_table(stmt, as_file);
-    write_block_assembly(stmt->switch_block, as_file, ret_tag);
-    fprintf(as_file, ".L%i:\n", tag0);
-    current_break_tag = last_break_tag;
-    curr_switch_table = curr_switch_table->parent;
-    break;
-  case CASE_STATEMENT:
-    node = curr_switch_table->first;
-    while(node) {
-      if(!node->def && node->val == stmt->val) {
-        fprintf(as_file, ".L%zu:\n", node->tag);
+    step.type = exp->type;
+    step.sf = is_wide_type(exp->value_type);
+    step.size = access_size_for_type(exp->value_type, step.sf);
+    step.signed_ = exp->value_type.signed_;
+    switch(exp->type) {
+    case CHAR_VALUE:
+    case UCHAR_VALUE:
+      step.sf = 0;
+      step.size = 1;
+      step.imm = exp->type == CHAR_VALUE ? exp->char_value : exp->uchar_value;
+      append_exp_step(fc, &step);
+      break;
+    case SHORT_VALUE:
+    case USHORT_VALUE:
+      step.sf = 0;
+      step.size = 2;
+      step.imm = exp->type == SHORT_VALUE ? exp->short_value
+                                          : exp->ushort_value;
+      append_exp_step(fc, &step);
+      break;
+    case INT_VALUE:
+    case UINT_VALUE:
+      step.sf = 0;
+      step.size = 4;
+      step.imm = exp->type == INT_VALUE ? exp->int_value : (long)exp->uint_value;
+      append_exp_step(fc, &step);
+      break;
+    case LONG_VALUE:
+    case ULONG_VALUE:
+    case LONGLONG_VALUE:
+    case ULONGLONG_VALUE:
+      step.sf = 1;
+      step.size = 8;
+      step.imm = exp->type == LONG_VALUE ? exp->long_value
+                 : exp->type == ULONG_VALUE ? (long)exp->ulong_value
+                 : exp->type == LONGLONG_VALUE ? (long)exp->longlong_value
+                 : (long)exp->ulonglong_value;
+      append_exp_step(fc, &step);
+      break;
+    case NEGATE:
+    case BITWISE_COMP:
+    case LOG_NOT:
+      push_exp_step(fc, &step);
+      push_exp_work(fc, exp->unary_operand, reg);
+      break;
+    case MOD_BINEXP:
+      check_next_reg(reg+1);
+      // Fall through
+    case ADD_BINEXP:
+    case SUB_BINEXP:
+    case MUL_BINEXP:
+    case DIV_BINEXP:
+    case EQ_BINEXP:
+    case NEQ_BINEXP:
+    case GT_BINEXP:
+    case GEQ_BINEXP:
+    case LT_BINEXP:
+    case LEQ_BINEXP:
+    case BITAND_BINEXP:
+    case BITOR_BINEXP:
+    case BITXOR_BINEXP:
+    case LSHIFT_BINEXP:
+    case RSHIFT_BINEXP:
+      check_next_reg(reg);
+      if(constant_operand_step(fc, exp, &step)) {
+        push_exp_step(fc, &step);
+        push_exp_work(fc, exp->left_operand, reg);
         break;
       }
-      node = node->next;
-    }
-    break;
-  case DEFAULT_STATEMENT:
-    node = curr_switch_table->first;
-    while(node) {
-      if(node->def) {
-        fprintf(as_file, ".L%zu:\n", node->tag);
+      operand = immediate_operand_step(exp, &step);
+      if(operand) {
+        push_exp_step(fc, &step);
+        push_exp_work(fc, operand, reg);
         break;
       }
-      node = node->next;
-    }
-    break;
-  case GOTO_STATEMENT:
-    label = find_symbol(stmt->label_name, labels);
-    if(!label.name) {
-      puts("Error: Could not find label for goto");
-      puts(stmt->label_name);
-      fclose(as_file);
-      remove(assembly_filename);
-      exit(1);
-    }
-    fprintf(as_file, "  b .L%zu\n", label.address);
-    break;
-  case LABEL:
-    label = find_symbol(stmt->label_name, labels);
-    if(!label.name) {
-      puts("Error: Could not find label");
-      puts(stmt->label_name);
-      fclose(as_file);
-      remove(assembly_filename);
-      exit(1);
+      step.swapped = exp->right_operand->reg_need
+                     > exp->left_operand->reg_need
+                     && swappable_operands(exp);
+      push_exp_step(fc, &step);
+      if(step.swapped) {
+        push_exp_work(fc, exp->left_operand, reg+1);
+        push_exp_work(fc, exp->right_operand, reg);
+      } else {
+        push_exp_work(fc, exp->right_operand, reg+1);
+        push_exp_work(fc, exp->left_operand, reg);
+      }
+      break;
+    case AND_BINEXP:
+    case OR_BINEXP:
+      step.tag0 = fc->tag_counter++;
+      step.tag1 = fc->tag_counter++;
+      push_exp_step(fc, &step);
+      push_exp_work(fc, exp->right_operand, reg);
+      step.phase = 1;
+      push_exp_step(fc, &step);
+      push_exp_work(fc, exp->left_operand, reg);
+      break;
+    case ASSIGN_EXP:
+      step.imm = get_symbol_offset(fc, exp->left_operand->var_name);
+      step.size = variable_access_size(exp->left_operand);
+      push_exp_step(fc, &step);
+      push_exp_work(fc, exp->right_operand, reg);
+      break;
+    case PLUSEQ_EXP:
+    case MINUSEQ_EXP:
+    case TIMESEQ_EXP:
+    case DIVEQ_EXP:
+    case MODEQ_EXP:
+    case LSHEQ_EXP:
+    case RSHEQ_EXP:
+    case ANDEQ_EXP:
+    case OREQ_EXP:
+    case XOREQ_EXP:
+      step.imm = get_symbol_offset(fc, exp->left_operand->var_name);
+      step.size = variable_access_size(exp->left_operand);
+      check_next_reg(reg);
+      if(exp->type == MODEQ_EXP) {
+        check_next_reg(reg+1);
+      }
+      arith = step;
+      if(constant_operand_step(fc, exp, &arith)
+         || immediate_operand_step(exp, &arith)) {
+        // The variable is loaded, worked on and stored in reg
+        step.type = ASSIGN_EXP;
+        push_exp_step(fc, &step);
+        push_exp_step(fc, &arith);
+        push_exp_work(fc, exp->left_operand, reg);
+        break;
+      }
+      // The value goes in reg first, then the variable in reg+1
+      step.swapped = 1;
+      push_exp_step(fc, &step);
+      push_exp_work(fc, exp->left_operand, reg+1);
+      push_exp_work(fc, exp->right_operand, reg);
+      break;
+    case VAR_EXP:
+      step.imm = get_symbol_offset(fc, exp->var_name);
+      append_exp_step(fc, &step);
+      break;
+    case COMMA_EXP:
+      push_exp_work(fc, exp->right_operand, reg);
+      push_exp_work(fc, exp->left_operand, reg);
+      break;
+    case PREINC_EXP:
+    case PREDEC_EXP:
+      step.imm = get_symbol_offset(fc, exp->left_operand->var_name);
+      push_exp_step(fc, &step);
+      push_exp_work(fc, exp->left_operand, reg);
+      break;
+    case POSTINC_EXP:
+    case POSTDEC_EXP:
+      step.imm = get_symbol_offset(fc, exp->left_operand->var_name);
+      check_next_reg(reg);
+      push_exp_step(fc, &step);
+      push_exp_work(fc, exp->left_operand, reg);
+      break;
+    case COND_EXP:
+      if(plan_select(exp, &plan)) {
+        fc->select_stats.selects++;
+        fc->select_stats.minmax += plan.idiom == MINMAX_SELECT;
+        fc->select_stats.abs += plan.idiom == ABS_SELECT;
+        step.type = SELECT_STEP;
+        step.imm = plan.op;
+        step.cond = plan.cond;
+        step.rn = plan.rn == A64_ZR ? A64_ZR : reg + plan.rn;
+        step.rm = plan.rm == A64_ZR ? A64_ZR : reg + plan.rm;
+        push_exp_step(fc, &step);
+        step.type = COMPARE_STEP;
+        step.sf = plan.compare_sf;
+        step.rn = reg + plan.compare_rn;
+        step.rm = plan.compare_rm == A64_ZR ? A64_ZR
+                                            : reg + plan.compare_rm;
+        push_exp_step(fc, &step);
+        for(int i = plan.item_count; i-- > 0;) {
+          push_exp_work(fc, plan.items[i], reg + i);
+        }
+        break;
+      }
+      step.tag0 = fc->tag_counter++;
+      step.tag1 = fc->tag_counter++;
+      push_exp_step(fc, &step);
+      push_exp_work(fc, exp->else_exp, reg);
+      step.phase = 2;
+      push_exp_step(fc, &step);
+      push_exp_work(fc, exp->if_exp, reg);
+      step.phase = 1;
+      push_exp_step(fc, &step);
+      push_exp_work(fc, exp->condition, reg);
+      break;
+    default:
+      break;
     }
-    fprintf(as_file, ".L%zu:\n", label.address);
-    break;
-  case EXPRESSION:
-    write_expression_assembly(X0, stmt->expression, as_file);
-    break;
-  default:
-    break;
   }
 }
 
-void write_switch_case_table(StatementNode* switch_stmt, FILE* as_file)
+void write_expression_step(ExpStep* step, MirFunction* mf)
 {
-  BlockNode* block = switch_stmt->switch_block;
-  CaseLabelTable* table = malloc(sizeof(CaseLabelTable));
-  table->parent = curr_switch_table;
-  table->first = NULL;
-  curr_switch_table = table;
-  int def_tag = -1;
-  for(size_t i = 0; i < block->count; i++) {
-    if(block->body[i]->type == STATEMENT_ITEM
-       && block->body[i]->stmt->type == CASE_STATEMENT) {
-      CaseLabelTableNode* node = malloc(sizeof(CaseLabelTableNode));
-      node->tag = tag_counter++;
-      node->val = block->body[i]->stmt->val;
-      node->def = 0;
-      node->next = table->first;
-      table->first = node;
-      fprintf(as_file, "  cmp x%i, %ld\n", X0, node->val);
-      fprintf(as_file, "  beq .L%zu\n", node->tag);
-    } else if(block->body[i]->type == STATEMENT_ITEM
-       && block->body[i]->stmt->type == DEFAULT_STATEMENT) {
-      CaseLabelTableNode* node = malloc(sizeof(CaseLabelTableNode));
-      node->tag = tag_counter++;
-      node->val = 0;
-      node->def = 1;
-      node->next = table->first;
-      table->first = node;
-      def_tag = node->tag;
-    }
-  }
-  if(def_tag >= 0) {
-    fprintf(as_file, "  b .L%i\n", def_tag);
-  }
-}
-
-void write_expression_assembly(Register reg, ExpressionNode* exp, FILE* as_file)
-{
-  size_t offset;
-  int tag0;
-  int tag1;
-  char reg_prefix = reg_prefix_for_type(exp->value_type);
-  char sign_char = exp->value_type.signed_ ? 's' : 'u';
-  char suffix = suffix_for_type(exp->value_type);
-  switch(exp->type) {
+  int sf = step->sf;
+  int reg = step->reg;
+  int left = reg + step->swapped;
+  int right = reg + !step->swapped;
+  MirOp div_op = step->signed_ ? MIR_SDIV : MIR_UDIV;
+  MultiplyPlan plan;
+  switch(step->type) {
   case CHAR_VALUE:
-    fprintf(as_file, "  movb w%i, #%i\n", reg, exp->char_value);
-    break;
   case UCHAR_VALUE:
-    fprintf(as_file, "  movb w%i, #%i\n", reg, exp->uchar_value);
-    break;
   case SHORT_VALUE:
-    fprintf(as_file, "  movh w%i, #%i\n", reg, exp->short_value);
-    break;
   case USHORT_VALUE:
-    fprintf(as_file, "  movh w%i, #%i\n", reg, exp->ushort_value);
-    break;
   case INT_VALUE:
-    fprintf(as_file, "  mov w%i, #%i\n", reg, exp->int_value);
-    break;
   case UINT_VALUE:
-    fprintf(as_file, "  mov w%i, #%i\n", reg, exp->uint_value);
-    break;
   case LONG_VALUE:
-    fprintf(as_file, "  mov x%i, #%ld\n", reg, exp->long_value);
-    break;
   case ULONG_VALUE:
-    fprintf(as_file, "  mov x%i, #%lu\n", reg, exp->ulong_value);
-    break;
   case LONGLONG_VALUE:
-    fprintf(as_file, "  mov x%i, #%lld\n", reg, exp->longlong_value);
-    break;
   case ULONGLONG_VALUE:
-    fprintf(as_file, "  mov x%i, #%llu\n", reg, exp->ulonglong_value);
+    mir_mov_imm(mf, sf, step->size, reg, step->imm);
     break;
   case NEGATE:
-    write_expression_assembly(reg, exp->unary_operand, as_file);
-    fprintf(as_file, "  neg %c%i, %c%i\n", reg_prefix, reg, reg_prefix, reg);
+    mir_rr(mf, MIR_NEG, sf, reg, reg);
     break;
   case BITWISE_COMP:
-    write_expression_assembly(reg, exp->unary_operand, as_file);
-    fprintf(as_file, "  mvn %c%i, %c%i\n", reg_prefix, reg, reg_prefix, reg);
+    mir_rr(mf, MIR_MVN, sf, reg, reg);
     break;
   case LOG_NOT:
-    write_expression_assembly(reg, exp->unary_operand, as_file);
     // From GCC
     // cmp w0, 0
     // cset w0, eq
     // and w0, w0, 255 # probably not necessary
-    fprintf(as_file, "  cmp %c%i, 0\n  cset %c%i, eq\n", 
-        reg_prefix, reg, reg_prefix, reg);
+    mir_cmp_imm(mf, sf, reg, 0);
+    mir_cset(mf, sf, reg, A64_EQ);
     break;
   case ADD_BINEXP:
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    fprintf(as_file, "  add %c%i, %c%i, %c%i\n", 
-        reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
-    break;
   case SUB_BINEXP:
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    fprintf(as_file, "  sub %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
-    break;
   case MUL_BINEXP:
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    fprintf(as_file, "  mul %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
+  case BITAND_BINEXP:
+  case BITOR_BINEXP:
+  case BITXOR_BINEXP:
+  case LSHIFT_BINEXP:
+  case RSHIFT_BINEXP:
+    mir_rrr(mf, binary_ops[step->type], sf, reg, left, right);
     break;
   case DIV_BINEXP:
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    fprintf(as_file, "  %cdiv %c%i, %c%i, %c%i\n",
-        sign_char, reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
+    mir_rrr(mf, div_op, sf, reg, left, right);
     break;
   case MOD_BINEXP:
-    check_next_reg(reg);
-    check_next_reg(reg+1);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    fprintf(as_file, "  %cdiv %c%i, %c%i, %c%i\n",
-        sign_char, reg_prefix, reg+2, reg_prefix, reg, reg_prefix, reg+1);
-    fprintf(as_file, "  msub %c%i, %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg+1, reg_prefix, reg+2, reg_prefix, reg);
+    mir_rrr(mf, div_op, sf, reg+2, left, right);
+    mir_rrrr(mf, MIR_MSUB, sf, reg, right, reg+2, left);
     break;
   case EQ_BINEXP:
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    fprintf(as_file, "  cmp %c%i, %c%i\n", reg_prefix, reg, reg_prefix, reg+1);
-    fprintf(as_file, "  cset %c%i, eq\n", reg_prefix, reg);
-    break;
   case NEQ_BINEXP:
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    fprintf(as_file, "  cmp %c%i, %c%i\n", reg_prefix, reg, reg_prefix, reg+1);
-    fprintf(as_file, "  cset %c%i, ne\n", reg_prefix, reg);
-    break;
   case GT_BINEXP:
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    fprintf(as_file, "  cmp %c%i, %c%i\n", reg_prefix, reg, reg_prefix, reg+1);
-    fprintf(as_file, "  cset %c%i, gt\n", reg_prefix, reg);
-    break;
   case GEQ_BINEXP:
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    fprintf(as_file, "  cmp %c%i, %c%i\n", reg_prefix, reg, reg_prefix, reg+1);
-    fprintf(as_file, "  cset %c%i, ge\n", reg_prefix, reg);
-    break;
   case LT_BINEXP:
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    fprintf(as_file, "  cmp %c%i, %c%i\n", reg_prefix, reg, reg_prefix, reg+1);
-    fprintf(as_file, "  cset %c%i, lt\n", reg_prefix, reg);
-    break;
   case LEQ_BINEXP:
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    fprintf(as_file, "  cmp %c%i, %c%i\n", reg_prefix, reg, reg_prefix, reg+1);
-    fprintf(as_file, "  cset %c%i, le\n", reg_prefix, reg);
+    mir_cmp(mf, sf, left, right);
+    mir_cset(mf, sf, reg, compare_conds[step->type]);
     break;
   case AND_BINEXP:
-    tag0 = tag_counter++;
-    tag1 = tag_counter++;
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    fprintf(as_file, "  cmp %c%i, 0\n", reg_prefix, reg);
-    fprintf(as_file, "  beq .L%i\n", tag0);
-    write_expression_assembly(reg, exp->right_operand, as_file);
-    fprintf(as_file, "  cmp %c%i, 0\n", reg_prefix, reg);
-    fprintf(as_file, "  beq .L%i\n", tag0);
-    fprintf(as_file, "  mov %c%i, 1\n", reg_prefix, reg);
-    fprintf(as_file, "  b .L%i\n", tag1);
-    fprintf(as_file, ".L%i:\n  mov %c%i, 0\n", tag0, reg_prefix, reg);
-    fprintf(as_file, ".L%i:\n", tag1);
-    //fprintf(as_file, "  ccmp w%i, 0, 4, ne\n", reg+1);
-    //fprintf(as_file, "  cset w%i, ne\n", reg);
-    break;
   case OR_BINEXP:
-    tag0 = tag_counter++;
-    tag1 = tag_counter++;
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    fprintf(as_file, "  cmp %c%i, 0\n", reg_prefix, reg);
-    fprintf(as_file, "  bne .L%i\n", tag0);
-    write_expression_assembly(reg, exp->right_operand, as_file);
-    fprintf(as_file, "  cmp %c%i, 0\n", reg_prefix, reg);
-    fprintf(as_file, "  bne .L%i\n", tag0);
-    fprintf(as_file, "  mov %c%i, 0\n", reg_prefix, reg);
-    fprintf(as_file, "  b .L%i\n", tag1);
-    fprintf(as_file, ".L%i:\n  mov %c%i, 1\n", tag0, reg_prefix, reg);
-    fprintf(as_file, ".L%i:\n", tag1);
-    //fprintf(as_file, "  orr w%i, w%i, w%i\n", reg, reg, reg+1);
-    //fprintf(as_file, "  cmp w%i, 0\n", reg);
-    //fprintf(as_file, "  cset w%i, ne\n", reg);
-    break;
-  case BITAND_BINEXP:
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    fprintf(as_file, "  and %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
-    break;
-  case BITOR_BINEXP:
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    fprintf(as_file, "  orr %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
-    break;
-  case BITXOR_BINEXP:
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    fprintf(as_file, "  eor %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
-    break;
-  case LSHIFT_BINEXP:
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    fprintf(as_file, "  lsl %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
-    break;
-  case RSHIFT_BINEXP:
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    fprintf(as_file, "  asr %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
+    // Both operands branch to tag0 on the value that decides the result
+    mir_cmp_imm(mf, sf, reg, 0);
+    mir_branch(mf, MIR_BCOND, step->type == AND_BINEXP ? A64_EQ : A64_NE,
+               step->tag0);
+    if(step->phase == 1) {
+      break;
+    }
+    mir_mov_imm(mf, sf, sf ? 8 : 4, reg, step->type == AND_BINEXP);
+    mir_branch(mf, MIR_B, A64_AL, step->tag1);
+    mir_label(mf, step->tag0);
+    mir_mov_imm(mf, sf, sf ? 8 : 4, reg, step->type != AND_BINEXP);
+    mir_label(mf, step->tag1);
+    //emit: ccmp w<reg+1>, 0, 4, ne
+    //emit: cset w<reg>, ne
     break;
   case ASSIGN_EXP:
-    offset = get_symbol_offset(exp->left_operand->var_name, as_file);
-    suffix = suffix_for_type(exp->left_operand->value_type);
-    write_expression_assembly(reg, exp->right_operand, as_file);
-    if(suffix) {
-      fprintf(as_file, "  str%c %c%i, [sp, %lu]\n", suffix, reg_prefix, reg, offset);
-    } else {
-      fprintf(as_file, "  str %c%i, [sp, %lu]\n", reg_prefix, reg, offset);
-    }
+    mir_stack(mf, MIR_STR, step->size == 8, step->size, reg, step->imm);
     break;
   case PLUSEQ_EXP:
-    offset = get_symbol_offset(exp->left_operand->var_name, as_file);
-    suffix = suffix_for_type(exp->left_operand->value_type);
-    check_next_reg(reg);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    fprintf(as_file, "  add %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
-    if(suffix) {
-      fprintf(as_file, "  str%c %c%i, [sp, %lu]\n", suffix, reg_prefix, reg, offset);
-    } else {
-      fprintf(as_file, "  str %c%i, [sp, %lu]\n", reg_prefix, reg, offset);
-    }
-    break;
   case MINUSEQ_EXP:
-    offset = get_symbol_offset(exp->left_operand->var_name, as_file);
-    suffix = suffix_for_type(exp->left_operand->value_type);
-    check_next_reg(reg);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    fprintf(as_file, "  sub %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
-    if(suffix) {
-      fprintf(as_file, "  str%c %c%i, [sp, %lu]\n", suffix, reg_prefix, reg, offset);
-    } else {
-      fprintf(as_file, "  str %c%i, [sp, %lu]\n", reg_prefix, reg, offset);
-    }
-    break;
   case TIMESEQ_EXP:
-    offset = get_symbol_offset(exp->left_operand->var_name, as_file);
-    suffix = suffix_for_type(exp->left_operand->value_type);
-    check_next_reg(reg);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    fprintf(as_file, "  mul %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
-    if(suffix) {
-      fprintf(as_file, "  str%c %c%i, [sp, %lu]\n", suffix, reg_prefix, reg, offset);
-    } else {
-      fprintf(as_file, "  str %c%i, [sp, %lu]\n", reg_prefix, reg, offset);
-    }
+  case LSHEQ_EXP:
+  case RSHEQ_EXP:
+  case ANDEQ_EXP:
+  case OREQ_EXP:
+  case XOREQ_EXP:
+    mir_rrr(mf, binary_ops[step->type], sf, reg, left, right);
+    mir_stack(mf, MIR_STR, step->size == 8, step->size, reg, step->imm);
     break;
   case DIVEQ_EXP:
-    offset = get_symbol_offset(exp->left_operand->var_name, as_file);
-    suffix = suffix_for_type(exp->left_operand->value_type);
-    check_next_reg(reg);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    fprintf(as_file, "  %cdiv %c%i, %c%i, %c%i\n",
-        sign_char, reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
-    if(suffix) {
-      fprintf(as_file, "  str%c %c%i, [sp, %lu]\n", suffix, reg_prefix, reg, offset);
-    } else {
-      fprintf(as_file, "  str %c%i, [sp, %lu]\n", reg_prefix, reg, offset);
-    }
+    mir_rrr(mf, div_op, sf, reg, left, right);
+    mir_stack(mf, MIR_STR, step->size == 8, step->size, reg, step->imm);
     break;
   case MODEQ_EXP:
-    offset = get_symbol_offset(exp->left_operand->var_name, as_file);
-    suffix = suffix_for_type(exp->left_operand->value_type);
-    check_next_reg(reg);
-    check_next_reg(reg+1);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    fprintf(as_file, "  %cdiv %c%i, %c%i, %c%i\n",
-        sign_char, reg_prefix, reg+2, reg_prefix, reg, reg_prefix, reg+1);
-    fprintf(as_file, "  msub %c%i, %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg+1, reg_prefix, reg+2, reg_prefix, reg);
-    if(suffix) {
-      fprintf(as_file, "  str%c %c%i, [sp, %lu]\n", suffix, reg_prefix, reg, offset);
-    } else {
-      fprintf(as_file, "  str %c%i, [sp, %lu]\n", reg_prefix, reg, offset);
-    }
+    mir_rrr(mf, div_op, sf, reg+2, left, right);
+    mir_rrrr(mf, MIR_MSUB, sf, reg, right, reg+2, left);
+    mir_stack(mf, MIR_STR, step->size == 8, step->size, reg, step->imm);
     break;
-  case LSHEQ_EXP:
-    offset = get_symbol_offset(exp->left_operand->var_name, as_file);
-    suffix = suffix_for_type(exp->left_operand->value_type);
-    check_next_reg(reg);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    fprintf(as_file, "  lsl %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
-    if(suffix) {
-      fprintf(as_file, "  str%c %c%i, [sp, %lu]\n", suffix, reg_prefix, reg, offset);
-    } else {
-      fprintf(as_file, "  str %c%i, [sp, %lu]\n", reg_prefix, reg, offset);
-    }
+  case VAR_EXP:
+    mir_stack(mf, MIR_LDR, sf, step->size, reg, step->imm);
     break;
-  case RSHEQ_EXP:
-    offset = get_symbol_offset(exp->left_operand->var_name, as_file);
-    suffix = suffix_for_type(exp->left_operand->value_type);
-    check_next_reg(reg);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    fprintf(as_file, "  asr %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
-    if(suffix) {
-      fprintf(as_file, "  str%c %c%i, [sp, %lu]\n", suffix, reg_prefix, reg, offset);
-    } else {
-      fprintf(as_file, "  str %c%i, [sp, %lu]\n", reg_prefix, reg, offset);
-    }
+  case PREINC_EXP:
+  case PREDEC_EXP:
+    mir_rri(mf, step->type == PREINC_EXP ? MIR_ADD_IMM : MIR_SUB_IMM, sf,
+            reg, reg, 1);
+    mir_stack(mf, MIR_STR, sf, step->size, reg, step->imm);
     break;
-  case ANDEQ_EXP:
-    offset = get_symbol_offset(exp->left_operand->var_name, as_file);
-    suffix = suffix_for_type(exp->left_operand->value_type);
-    check_next_reg(reg);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    fprintf(as_file, "  and %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
-    if(suffix) {
-      fprintf(as_file, "  str%c %c%i, [sp, %lu]\n", suffix, reg_prefix, reg, offset);
-    } else {
-      fprintf(as_file, "  str %c%i, [sp, %lu]\n", reg_prefix, reg, offset);
-    }
+  case POSTINC_EXP:
+  case POSTDEC_EXP:
+    mir_rri(mf, step->type == POSTINC_EXP ? MIR_ADD_IMM : MIR_SUB_IMM, sf,
+            reg+1, reg, 1);
+    mir_stack(mf, MIR_STR, sf, step->size, reg+1, step->imm);
     break;
-  case OREQ_EXP:
-    offset = get_symbol_offset(exp->left_operand->var_name, as_file);
-    suffix = suffix_for_type(exp->left_operand->value_type);
-    check_next_reg(reg);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    fprintf(as_file, "  orr %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
-    if(suffix) {
-      fprintf(as_file, "  str%c %c%i, [sp, %lu]\n", suffix, reg_prefix, reg, offset);
+  case COND_EXP:
+    if(step->phase == 1) {
+      mir_cmp_imm(mf, sf, reg, 0);
+      mir_branch(mf, MIR_BCOND, A64_EQ, step->tag0);
+    } else if(step->phase == 2) {
+      mir_branch(mf, MIR_B, A64_AL, step->tag1);
+      mir_label(mf, step->tag0);
     } else {
-      fprintf(as_file, "  str %c%i, [sp, %lu]\n", reg_prefix, reg, offset);
+      mir_label(mf, step->tag1);
     }
     break;
-  case XOREQ_EXP:
-    offset = get_symbol_offset(exp->left_operand->var_name, as_file);
-    suffix = suffix_for_type(exp->left_operand->value_type);
-    check_next_reg(reg);
-    write_expression_assembly(reg+1, exp->right_operand, as_file);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    fprintf(as_file, "  eor %c%i, %c%i, %c%i\n",
-        reg_prefix, reg, reg_prefix, reg, reg_prefix, reg+1);
-    if(suffix) {
-      fprintf(as_file, "  str%c %c%i, [sp, %lu]\n", suffix, reg_prefix, reg, offset);
+  case COMPARE_STEP:
+    if(step->rm == A64_ZR) {
+      mir_cmp_imm(mf, sf, step->rn, 0);
     } else {
-      fprintf(as_file, "  str %c%i, [sp, %lu]\n", reg_prefix, reg, offset);
+      mir_cmp(mf, sf, step->rn, step->rm);
     }
     break;
-  case VAR_EXP:
-    offset = get_symbol_offset(exp->var_name, as_file);
-    if(suffix) {
-      fprintf(as_file, "  ldr%c %c%i, [sp, %lu]\n", suffix, reg_prefix, reg, offset);
-    } else {
-      fprintf(as_file, "  ldr %c%i, [sp, %lu]\n", reg_prefix, reg, offset);
+  case SELECT_STEP:
+    mir_csel(mf, step->imm, sf, reg, step->rn, step->rm, step->cond);
+    break;
+  case SPILL_STEP:
+    for(int r = 0; r < reg; r++) {
+      mir_stack(mf, MIR_STR, 1, 8, r, step->imm + 8 * r);
     }
     break;
-  case COMMA_EXP:
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    write_expression_assembly(reg, exp->right_operand, as_file);
+  case MUL_CONSTANT_STEP:
+    plan_multiply(sf, step->imm, &plan);
+    lower_multiply(mf, &plan, sf, reg, reg+1);
     break;
-  case PREINC_EXP:
-    offset = get_symbol_offset(exp->left_operand->var_name, as_file);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    fprintf(as_file, "  add %c%i, %c%i, #1\n", reg_prefix, reg, reg_prefix, reg);
-    if(suffix) {
-      fprintf(as_file, "  str%c %c%i, [sp, %lu]\n", suffix, reg_prefix, reg, offset);
-    } else {
-      fprintf(as_file, "  str %c%i, [sp, %lu]\n", reg_prefix, reg, offset);
-    }
+  case DIV_CONSTANT_STEP:
+    lower_divide(mf, sf, step->signed_, reg, reg, reg+1, step->imm);
     break;
-  case PREDEC_EXP:
-    offset = get_symbol_offset(exp->left_operand->var_name, as_file);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    fprintf(as_file, "  sub %c%i, %c%i, #1\n", reg_prefix, reg, reg_prefix, reg);
-    if(suffix) {
-      fprintf(as_file, "  str%c %c%i, [sp, %lu]\n", suffix, reg_prefix, reg, offset);
-    } else {
-      fprintf(as_file, "  str %c%i, [sp, %lu]\n", reg_prefix, reg, offset);
-    }
+  case MOD_CONSTANT_STEP:
+    lower_remainder(mf, sf, step->signed_, reg, reg+1, reg+2, step->imm);
     break;
-  case POSTINC_EXP:
-    offset = get_symbol_offset(exp->left_operand->var_name, as_file);
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    fprintf(as_file, "  add %c%i, %c%i, #1\n", reg_prefix, reg+1, reg_prefix, reg);
-    if(suffix) {
-      fprintf(as_file, "  str%c %c%i, [sp, %lu]\n", suffix, reg_prefix, reg+1, offset);
+  case IMMEDIATE_STEP:
+    if(step->op == MIR_CMP_IMM) {
+      mir_cmp_imm(mf, sf, reg, step->imm);
+      mir_cset(mf, sf, reg, step->cond);
     } else {
-      fprintf(as_file, "  str %c%i, [sp, %lu]\n", reg_prefix, reg+1, offset);
+      mir_rri(mf, step->op, sf, reg, reg, step->imm);
     }
     break;
-  case POSTDEC_EXP:
-    offset = get_symbol_offset(exp->left_operand->var_name, as_file);
-    check_next_reg(reg);
-    write_expression_assembly(reg, exp->left_operand, as_file);
-    fprintf(as_file, "  sub %c%i, %c%i, #1\n", reg_prefix, reg+1, reg_prefix, reg);
-    if(suffix) {
-      fprintf(as_file, "  str%c %c%i, [sp, %lu]\n", suffix, reg_prefix, reg+1, offset);
-    } else {
-      fprintf(as_file, "  str %c%i, [sp, %lu]\n", reg_prefix, reg+1, offset);
+  case RELOAD_STEP:
+    mir_rri(mf, MIR_ADD_IMM, 1, reg, X0, 0);
+    for(int r = 0; r < reg; r++) {
+      mir_stack(mf, MIR_LDR, 1, 8, r, step->imm + 8 * r);
     }
     break;
-  case COND_EXP:
-    tag0 = tag_counter++;
-    tag1 = tag_counter++;
-    write_expression_assembly(reg, exp->condition, as_file);
-    fprintf(as_file, "  cmp %c%i, 0\n", reg_prefix, reg);
-    fprintf(as_file, "  beq .L%i\n", tag0);
-    write_expression_assembly(reg, exp->if_exp, as_file);
-    fprintf(as_file, "  b .L%i\n", tag1);
-    fprintf(as_file, ".L%i:\n", tag0);
-    write_expression_assembly(reg, exp->else_exp, as_file);
-    fprintf(as_file, ".L%i:\n", tag1);
-    break;
-  case EMPTY_EXP:
-    break;
   default:
     break;
   }
 }
 
-void check_next_reg(Register reg)
+void append_exp_step(FunctionCodegen* fc, ExpStep* step)
 {
-  if(reg+1 > 18) {
-    puts("Error:  Can only handle up to 18 registers right now");
-    remove(assembly_filename);
-    exit(1);
+  if(fc->exp_step_count == fc->exp_step_capacity) {
+    fc->exp_step_capacity = fc->exp_step_capacity
+                            ? 2 * fc->exp_step_capacity : 64;
+    fc->exp_steps = realloc(fc->exp_steps,
+                            sizeof(ExpStep) * fc->exp_step_capacity);
+    if(!fc->exp_steps) {
+      perror("Error");
+      exit(1);
+    }
   }
+  fc->exp_steps[fc->exp_step_count++] = *step;
 }
 
-int type_size(Type type)
+// Steps go on the work stack too, so they come out after everything
+// pushed on top of them
+void push_exp_step(FunctionCodegen* fc, ExpStep* step)
 {
-  switch(type.base) {
-  case CHAR_VAR: return 1;
-  case SHORT_VAR: return 2;
-  case INT_VAR: return 4;
-  case LONG_VAR: return 8;
-  case LONG_LONG_VAR: return 8;
-  case FLOAT_VAR: return 4;
-  case DOUBLE_VAR: return 8;
-  default: return 4;
-  }
+  push_exp_work(fc, NULL, step->reg);
+  fc->exp_work[fc->exp_work_count-1].step = *step;
 }
 
-int count_local_vars(BlockNode* block)
+void push_exp_work(FunctionCodegen* fc, ExpressionNode* exp, Register reg)
 {
-  int local_vars = 0;
-  Type type;
-  for(unsigned int i = 0; i < block->count; i++) {
-    if(block->body[i]->type == DECLARATION_ITEM) {
-      type = block->body[i]->decl->var_type;
-      local_vars += type_size(type);
-    } else {
-      switch(block->body[i]->stmt->type) {
-      case FORDECL_LOOP:
-        type = block->body[i]->stmt->init_decl->var_type;
-        local_vars += type_size(type);
-        if (block->body[i]->stmt->loop_stmt->type == BLOCK_STATEMENT) {
-          local_vars += count_local_vars(block->body[i]->stmt->loop_stmt->block);
-        }
-        break;
-      case WHILE_LOOP:
-      case DO_LOOP:
-      case FOR_LOOP:
-        if (block->body[i]->stmt->loop_stmt->type == BLOCK_STATEMENT) {
-          local_vars += count_local_vars(block->body[i]->stmt->loop_stmt->block);
-        }
-        break;
-      case CONDITIONAL:
-        if (block->body[i]->stmt->if_stmt->type == BLOCK_STATEMENT) {
-          local_vars += count_local_vars(block->body[i]->stmt->if_stmt->block);
-        }
-        if (block->body[i]->stmt->else_stmt 
-            && block->body[i]->stmt->else_stmt->type == BLOCK_STATEMENT) {
-          local_vars += count_local_vars(block->body[i]->stmt->else_stmt->block);
-        }
-        break;
-      default:
-        break;
-      }
+  if(fc->exp_work_count == fc->exp_work_capacity) {
+    fc->exp_work_capacity = fc->exp_work_capacity
+                            ? 2 * fc->exp_work_capacity : 64;
+    fc->exp_work = realloc(fc->exp_work,
+                           sizeof(ExpWork) * fc->exp_work_capacity);
+    if(!fc->exp_work) {
+      perror("Error");
+      exit(1);
     }
   }
-  return local_vars;
+  ExpWork* work = &fc->exp_work[fc->exp_work_count++];
+  work->exp = exp;
+  work->step = (ExpStep){.reg = reg};
 }
 
-void construct_label_table(SymbolTable* st, BlockNode* block)
+void push_cond_work(FunctionCodegen* fc, ExpressionNode* cond, int on_true,
+                    int tag)
 {
-  for(unsigned int i = 0; i < block->count; i++) {
-    if(block->body[i]->type == DECLARATION_ITEM) {
-      continue;
-    }
-    StatementNode* stmt = block->body[i]->stmt;
-    switch(stmt->type) {
-    case LABEL:
-      push_constructed_symbol(stmt->label_name, tag_counter++, st);
-      break;
-    case FORDECL_LOOP:
-    case WHILE_LOOP:
-    case DO_LOOP:
-    case FOR_LOOP:
-      if (stmt->loop_stmt->type == BLOCK_STATEMENT) {
-        construct_label_table(st, stmt->loop_stmt->block);
-      }
-      break;
-    case CONDITIONAL:
-      if (stmt->if_stmt->type == BLOCK_STATEMENT) {
-        construct_label_table(st, stmt->if_stmt->block);
-      }
-      if (stmt->else_stmt 
-          && stmt->else_stmt->type == BLOCK_STATEMENT) {
-        construct_label_table(st, stmt->else_stmt->block);
-      }
-      break;
-    default:
-      break;
+  if(fc->cond_work_count == fc->cond_work_capacity) {
+    fc->cond_work_capacity = fc->cond_work_capacity
+                             ? 2 * fc->cond_work_capacity : 16;
+    fc->cond_work = realloc(fc->cond_work,
+                            sizeof(CondWork) * fc->cond_work_capacity);
+    if(!fc->cond_work) {
+      perror("Error");
+      exit(1);
     }
   }
+  fc->cond_work[fc->cond_work_count++] = (CondWork){cond, on_true, tag};
+}
+
+void check_next_reg(Register reg)
+{
+  if(reg+1 > LAST_TEMP_REG) {
+    puts("Error:  Can only handle up to 18 registers right now");
+    exit(1);
+  }
 }
 
-size_t get_symbol_offset(char* name, FILE* as_file)
+size_t get_symbol_offset(FunctionCodegen* fc, char* name)
 {
   Symbol sym = {.name = NULL, .offset = 0};
-  SymbolTable* st = top_st;
+  SymbolTable* st = fc->top_st;
   assert(st);
   while(!sym.name) {
     sym = find_symbol(name, st);
     if(!st->next && !sym.name) {
       puts("Error: Symbol not found:");
       puts(name);
-      fclose(as_file);
-      remove(assembly_filename);
       exit(1);
     }
     st = st->next;
   }
-  return func_stack_offset - sym.offset;
+  return fc->stack_offset - sym.offset;
 }
 
-char reg_prefix_for_type(Type type)
+// Whether values of the type live in x rather than w registers
+int is_wide_type(Type type)
 {
   switch(type.base) {
   case LONG_LONG_VAR:
   case LONG_VAR:
-    return 'x';
+    return 1;
   default:
-    return 'w';
+    return 0;
   }
-  return 'w';
+  return 0;
+}
+
+// Assignments store at the width of the variable, whatever the width
+// of the value
+int variable_access_size(ExpressionNode* var)
+{
+  return access_size_for_type(var->value_type, is_wide_type(var->value_type));
 }
 
-char suffix_for_type(Type type)
+// Width of a load or store of a variable, narrow types use ldrb/ldrh
+// and the rest move the whole register
+int access_size_for_type(Type type, int sf)
 {
   switch (type.base) {
   case CHAR_VAR:
-    return 'b';
+    return 1;
   case SHORT_VAR:
-    return 'h';
+    return 2;
   default:
-    return '\0';
+    return sf ? 8 : 4;
   }
-  return '\0';
+  return 4;
 }
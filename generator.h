@@ -3,6 +3,37 @@
 
 #include "parser.h"
 
-void generate_assembly(ProgramNode, const char*);
+#include <time.h>
+
+typedef enum OutputKind_e {
+  ASSEMBLY_OUTPUT,
+  OBJECT_OUTPUT,     // -c
+  EXECUTABLE_OUTPUT, // -static
+  RUN_OUTPUT,        // -run, x86-64 code called in this process
+  VM_OUTPUT          // -vm, bytecode interpreted on any host
+} OutputKind;
+
+typedef enum Target_e {
+  AARCH64_APPLE_TARGET, // _main and friends, the default
+  AARCH64_LINUX_TARGET, // -target aarch64-linux, ELF names and GNU as
+  X86_64_LINUX_TARGET   // -target x86_64-linux, SysV and GNU as
+} Target;
+
+typedef struct CompileOptions_s {
+  OutputKind output_kind;
+  const char* output; // -o path, "-" for stdout, NULL derives it from input
+  int pipe;           // -pipe, assembly goes to the system as via a pipe
+  int opt_level;      // -O<n>
+  int stats;          // -stats, report what the optimizations did
+  int threads;        // -j<n>, functions generated in parallel
+  Target target;      // -target <name>
+  struct timespec started; // When the compiler began, for -stats
+} CompileOptions;
+
+// Returns the exit status, which is main's result with -run and -vm
+int generate(ProgramNode, const char*, CompileOptions*);
+int is_wide_type(Type);
+int access_size_for_type(Type, int);
+int variable_access_size(ExpressionNode*);
 
 #endif
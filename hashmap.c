@@ -0,0 +1,115 @@
+#include "hashmap.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+size_t hash_key(HashMap*, const void*);
+int keys_equal(HashMap*, const void*, const void*);
+void hash_map_grow(HashMap*);
+
+void hash_map_init(HashMap* map, HashKeyType key_type)
+{
+  map->key_type = key_type;
+  map->capacity = 16;
+  map->count = 0;
+  map->entries = calloc(map->capacity, sizeof(HashEntry));
+  if(!map->entries) {
+    perror("Error");
+    exit(1);
+  }
+}
+
+size_t hash_key(HashMap* map, const void* key)
+{
+  size_t h;
+  if(map->key_type == STRING_KEY) {
+    // FNV-1a
+    h = 14695981039346656037u;
+    for(const unsigned char* c = key; *c; c++) {
+      h ^= *c;
+      h *= 1099511628211u;
+    }
+    return h;
+  }
+  h = (size_t)(uintptr_t)key;
+  h ^= h >> 17;
+  h *= 0x9e3779b97f4a7c15u;
+  return h ^ (h >> 29);
+}
+
+int keys_equal(HashMap* map, const void* a, const void* b)
+{
+  if(map->key_type == STRING_KEY) {
+    return !strcmp(a, b);
+  }
+  return a == b;
+}
+
+void hash_map_grow(HashMap* map)
+{
+  HashEntry* old = map->entries;
+  size_t old_capacity = map->capacity;
+  map->capacity *= 2;
+  map->count = 0;
+  map->entries = calloc(map->capacity, sizeof(HashEntry));
+  if(!map->entries) {
+    perror("Error");
+    exit(1);
+  }
+  for(size_t i = 0; i < old_capacity; i++) {
+    if(old[i].key) {
+      hash_map_put(map, old[i].key, old[i].value);
+    }
+  }
+  free(old);
+}
+
+// Returns 1 if the key was already present (its value is replaced).
+int hash_map_put(HashMap* map, const void* key, size_t value)
+{
+  if(2 * (map->count + 1) > map->capacity) {
+    hash_map_grow(map);
+  }
+  size_t mask = map->capacity - 1;
+  size_t i = hash_key(map, key) & mask;
+  while(map->entries[i].key) {
+    if(keys_equal(map, map->entries[i].key, key)) {
+      map->entries[i].value = value;
+      return 1;
+    }
+    i = (i + 1) & mask;
+  }
+  map->entries[i].key = key;
+  map->entries[i].value = value;
+  map->count++;
+  return 0;
+}
+
+int hash_map_get(HashMap* map, const void* key, size_t* value)
+{
+  if(!key) {
+    return 0;
+  }
+  size_t mask = map->capacity - 1;
+  size_t i = hash_key(map, key) & mask;
+  while(map->entries[i].key) {
+    if(keys_equal(map, map->entries[i].key, key)) {
+      if(value) {
+        *value = map->entries[i].value;
+      }
+      return 1;
+    }
+    i = (i + 1) & mask;
+  }
+  return 0;
+}
+
+void hash_map_free(HashMap* map)
+{
+  free(map->entries);
+  map->entries = NULL;
+  map->capacity = 0;
+  map->count = 0;
+}
@@ -0,0 +1,29 @@
+#ifndef HASHMAP_H_
+#define HASHMAP_H_
+
+#include <stddef.h>
+
+typedef enum HashKeyType_e {
+  POINTER_KEY,
+  STRING_KEY
+} HashKeyType;
+
+typedef struct HashEntry_s {
+  const void* key;
+  size_t value;
+} HashEntry;
+
+// Open addressing map from a pointer (or C string) to a size_t.
+typedef struct HashMap_s {
+  HashKeyType key_type;
+  HashEntry* entries;
+  size_t capacity;
+  size_t count;
+} HashMap;
+
+void hash_map_init(HashMap*, HashKeyType);
+int hash_map_put(HashMap*, const void*, size_t);
+int hash_map_get(HashMap*, const void*, size_t*);
+void hash_map_free(HashMap*);
+
+#endif
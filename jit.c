@@ -0,0 +1,49 @@
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS under -std=c18
+
+#include "jit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+typedef int (*JitEntry)(void);
+
+// Copies the code into fresh pages and makes them executable. The pages
+// are never writable and executable at the same time.
+void* jit_load(const uint8_t* bytes, size_t count)
+{
+#if !defined(__x86_64__)
+  (void)bytes;
+  (void)count;
+  puts("Error: -run needs an x86-64 host");
+  exit(1);
+#else
+  void* mem = mmap(NULL, count, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(mem == MAP_FAILED) {
+    perror("Error");
+    exit(1);
+  }
+  memcpy(mem, bytes, count);
+  if(mprotect(mem, count, PROT_READ | PROT_EXEC) < 0) {
+    perror("Error");
+    exit(1);
+  }
+  return mem;
+#endif
+}
+
+// Calls the code at entry as int entry(void)
+int jit_call(void* entry)
+{
+  // ISO C has no conversion from object to function pointers
+  JitEntry fn;
+  memcpy(&fn, &entry, sizeof(fn));
+  return fn();
+}
+
+void jit_unload(void* mem, size_t count)
+{
+  munmap(mem, count);
+}
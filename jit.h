@@ -0,0 +1,12 @@
+#ifndef JIT_H_
+#define JIT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Runs freshly encoded x86-64 code in this process, for -run
+void* jit_load(const uint8_t*, size_t);
+int jit_call(void*);
+void jit_unload(void*, size_t);
+
+#endif
@@ -0,0 +1,963 @@
+#include "mir.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCRATCH_REG 16
+
+void print_reg(Emitter*, int, int);
+void print_zr_reg(Emitter*, int, int);
+void print_mov_parts(Emitter*, int, int, long);
+void print_add_parts(Emitter*, MirInsn*);
+int log2_size(int);
+
+const char* mir_names[] = {
+  [MIR_MOV_IMM] = "mov", [MIR_NEG] = "neg", [MIR_MVN] = "mvn",
+  [MIR_ADD] = "add", [MIR_SUB] = "sub", [MIR_MUL] = "mul",
+  [MIR_SDIV] = "sdiv", [MIR_UDIV] = "udiv", [MIR_AND] = "and",
+  [MIR_ORR] = "orr", [MIR_EOR] = "eor", [MIR_LSL] = "lsl",
+  [MIR_ASR] = "asr", [MIR_MSUB] = "msub", [MIR_SMULL] = "smull",
+  [MIR_UMULL] = "umull", [MIR_SMULH] = "smulh", [MIR_UMULH] = "umulh",
+  [MIR_ADD_SHIFT] = "add", [MIR_SUB_SHIFT] = "sub", [MIR_LSL_IMM] = "lsl",
+  [MIR_LSR_IMM] = "lsr", [MIR_ASR_IMM] = "asr", [MIR_AND_IMM] = "and",
+  [MIR_ORR_IMM] = "orr", [MIR_EOR_IMM] = "eor", [MIR_ADD_IMM] = "add",
+  [MIR_SUB_IMM] = "sub", [MIR_CMP] = "cmp", [MIR_CMP_IMM] = "cmp",
+  [MIR_CMN] = "cmn", [MIR_CCMP] = "ccmp", [MIR_CCMP_IMM] = "ccmp",
+  [MIR_CSET] = "cset",
+  [MIR_CSEL] = "csel", [MIR_CSINC] = "csinc", [MIR_CSINV] = "csinv",
+  [MIR_CSNEG] = "csneg", [MIR_LDR] = "ldr",
+  [MIR_STR] = "str", [MIR_B] = "b", [MIR_BCOND] = "b", [MIR_CBZ] = "cbz",
+  [MIR_CBNZ] = "cbnz", [MIR_LDR_INDEX] = "ldr", [MIR_ADR] = "adr",
+  [MIR_BR] = "br", [MIR_OFFSET] = ".long", [MIR_WORD] = ".long",
+  [MIR_RET] = "ret", [MIR_NOP] = ""
+};
+
+const char* shift_names[] = {
+  [A64_LSL] = "lsl", [A64_LSR] = "lsr", [A64_ASR] = "asr"
+};
+
+const char* mov_names[] = {
+  [A64_MOVZ] = "movz", [A64_MOVN] = "movn", [A64_MOVK] = "movk"
+};
+
+const A64CondSelect select_ops[] = {
+  [MIR_CSEL] = A64_CSEL, [MIR_CSINC] = A64_CSINC, [MIR_CSINV] = A64_CSINV,
+  [MIR_CSNEG] = A64_CSNEG
+};
+
+// Register forms that map straight onto a64_reg_op
+const A64RegOp reg_ops[] = {
+  [MIR_ADD] = A64_ADD, [MIR_SUB] = A64_SUB, [MIR_SDIV] = A64_SDIV,
+  [MIR_UDIV] = A64_UDIV, [MIR_AND] = A64_AND, [MIR_ORR] = A64_ORR,
+  [MIR_EOR] = A64_EOR, [MIR_LSL] = A64_LSLV, [MIR_ASR] = A64_ASRV,
+  [MIR_AND_IMM] = A64_AND, [MIR_ORR_IMM] = A64_ORR, [MIR_EOR_IMM] = A64_EOR
+};
+
+void mir_init(MirFunction* mf, const char* name)
+{
+  size_t len = strlen(name);
+  mf->name = malloc(len + 1);
+  mf->count = 0;
+  mf->capacity = 256;
+  mf->insns = malloc(sizeof(MirInsn) * mf->capacity);
+  mf->blocks = NULL;
+  mf->block_count = 0;
+  if(!mf->name || !mf->insns) {
+    perror("Error");
+    exit(1);
+  }
+  memcpy(mf->name, name, len + 1);
+}
+
+void mir_free(MirFunction* mf)
+{
+  free(mf->name);
+  free(mf->insns);
+  free(mf->blocks);
+  memset(mf, 0, sizeof(MirFunction));
+}
+
+// Returns the new instruction with every operand zeroed
+MirInsn* mir_append(MirFunction* mf, MirOp op, int sf)
+{
+  if(mf->count == mf->capacity) {
+    mf->capacity *= 2;
+    mf->insns = realloc(mf->insns, sizeof(MirInsn) * mf->capacity);
+    if(!mf->insns) {
+      perror("Error");
+      exit(1);
+    }
+  }
+  MirInsn* insn = &mf->insns[mf->count++];
+  memset(insn, 0, sizeof(MirInsn));
+  insn->op = op;
+  insn->sf = sf;
+  insn->size = sf ? 8 : 4;
+  return insn;
+}
+
+void mir_label(MirFunction* mf, size_t tag)
+{
+  mir_append(mf, MIR_LABEL, 0)->imm = tag;
+}
+
+void mir_branch(MirFunction* mf, MirOp op, A64Cond cond, size_t tag)
+{
+  MirInsn* insn = mir_append(mf, op, 0);
+  insn->cond = cond;
+  insn->imm = tag;
+}
+
+void mir_mov_imm(MirFunction* mf, int sf, int size, int rd, long imm)
+{
+  MirInsn* insn = mir_append(mf, MIR_MOV_IMM, sf);
+  insn->size = size;
+  insn->rd = rd;
+  insn->imm = imm;
+}
+
+void mir_rr(MirFunction* mf, MirOp op, int sf, int rd, int rn)
+{
+  MirInsn* insn = mir_append(mf, op, sf);
+  insn->rd = rd;
+  insn->rn = rn;
+}
+
+void mir_rrr(MirFunction* mf, MirOp op, int sf, int rd, int rn, int rm)
+{
+  MirInsn* insn = mir_append(mf, op, sf);
+  insn->rd = rd;
+  insn->rn = rn;
+  insn->rm = rm;
+}
+
+void mir_rrrr(MirFunction* mf, MirOp op, int sf, int rd, int rn, int rm,
+              int ra)
+{
+  MirInsn* insn = mir_append(mf, op, sf);
+  insn->rd = rd;
+  insn->rn = rn;
+  insn->rm = rm;
+  insn->ra = ra;
+}
+
+void mir_rri(MirFunction* mf, MirOp op, int sf, int rd, int rn, long imm)
+{
+  MirInsn* insn = mir_append(mf, op, sf);
+  insn->rd = rd;
+  insn->rn = rn;
+  insn->imm = imm;
+}
+
+void mir_shifted(MirFunction* mf, MirOp op, int sf, int rd, int rn, int rm,
+                 A64Shift shift, int amount)
+{
+  MirInsn* insn = mir_append(mf, op, sf);
+  insn->rd = rd;
+  insn->rn = rn;
+  insn->rm = rm;
+  insn->cond = shift;
+  insn->imm = amount;
+}
+
+void mir_cmp(MirFunction* mf, int sf, int rn, int rm)
+{
+  MirInsn* insn = mir_append(mf, MIR_CMP, sf);
+  insn->rn = rn;
+  insn->rm = rm;
+}
+
+void mir_cmp_imm(MirFunction* mf, int sf, int rn, long imm)
+{
+  MirInsn* insn = mir_append(mf, MIR_CMP_IMM, sf);
+  insn->rn = rn;
+  insn->imm = imm;
+}
+
+void mir_ccmp(MirFunction* mf, int sf, int rn, int rm, int nzcv,
+              A64Cond cond)
+{
+  MirInsn* insn = mir_append(mf, MIR_CCMP, sf);
+  insn->rn = rn;
+  insn->rm = rm;
+  insn->size = nzcv;
+  insn->cond = cond;
+}
+
+// ccmp rn, #imm5, #nzcv, cond
+void mir_ccmp_imm(MirFunction* mf, int sf, int rn, int imm5, int nzcv,
+                  A64Cond cond)
+{
+  MirInsn* insn = mir_append(mf, MIR_CCMP_IMM, sf);
+  insn->rn = rn;
+  insn->imm = imm5;
+  insn->size = nzcv;
+  insn->cond = cond;
+}
+
+void mir_csel(MirFunction* mf, MirOp op, int sf, int rd, int rn, int rm,
+              A64Cond cond)
+{
+  MirInsn* insn = mir_append(mf, op, sf);
+  insn->rd = rd;
+  insn->rn = rn;
+  insn->rm = rm;
+  insn->cond = cond;
+}
+
+// cbz or cbnz rn, tag
+void mir_cbz(MirFunction* mf, MirOp op, int sf, int rn, size_t tag)
+{
+  MirInsn* insn = mir_append(mf, op, sf);
+  insn->rn = rn;
+  insn->imm = tag;
+}
+
+void mir_cset(MirFunction* mf, int sf, int rd, A64Cond cond)
+{
+  MirInsn* insn = mir_append(mf, MIR_CSET, sf);
+  insn->rd = rd;
+  insn->cond = cond;
+}
+
+// ldr/str of size bytes at [sp, offset]
+void mir_stack(MirFunction* mf, MirOp op, int sf, int size, int reg,
+               long offset)
+{
+  MirInsn* insn = mir_append(mf, op, sf);
+  insn->size = size;
+  insn->rd = reg;
+  insn->imm = offset;
+}
+
+// ldr rd, [rn, rm, lsl #log2 size], the narrow forms zero extending
+void mir_ldr_index(MirFunction* mf, int sf, int size, int rd, int rn,
+                   int rm)
+{
+  MirInsn* insn = mir_append(mf, MIR_LDR_INDEX, sf);
+  insn->size = size;
+  insn->rd = rd;
+  insn->rn = rn;
+  insn->rm = rm;
+}
+
+void mir_adr(MirFunction* mf, int rd, size_t tag)
+{
+  MirInsn* insn = mir_append(mf, MIR_ADR, 1);
+  insn->rd = rd;
+  insn->imm = tag;
+}
+
+// Any instruction whose imm is a label to jump to
+int mir_is_branch(MirInsn* insn)
+{
+  return insn->op == MIR_B || insn->op == MIR_BCOND || insn->op == MIR_CBZ
+         || insn->op == MIR_CBNZ;
+}
+
+int mir_ends_block(MirInsn* insn)
+{
+  return mir_is_branch(insn) || insn->op == MIR_BR || insn->op == MIR_RET;
+}
+
+// A block starts at every label and after every branch
+void mir_split_blocks(MirFunction* mf)
+{
+  free(mf->blocks);
+  mf->blocks = malloc(sizeof(MirBlock) * (mf->count + 1));
+  if(!mf->blocks) {
+    perror("Error");
+    exit(1);
+  }
+  mf->block_count = 0;
+  size_t start = 0;
+  for(size_t i = 0; i < mf->count; i++) {
+    int label_next = i + 1 < mf->count && mf->insns[i+1].op == MIR_LABEL;
+    if(mir_ends_block(&mf->insns[i]) || label_next || i + 1 == mf->count) {
+      mf->blocks[mf->block_count].start = start;
+      mf->blocks[mf->block_count].end = i + 1;
+      mf->block_count++;
+      start = i + 1;
+    }
+  }
+}
+
+// Drops the instructions passes have turned into MIR_NOP
+// Moves every label of the function up by base
+void mir_rebase_labels(MirFunction* mf, long base)
+{
+  for(size_t i = 0; i < mf->count; i++) {
+    MirInsn* insn = &mf->insns[i];
+    if(insn->op == MIR_LABEL || insn->op == MIR_ADR
+       || insn->op == MIR_OFFSET || mir_is_branch(insn)) {
+      insn->imm += base;
+    }
+  }
+}
+
+void mir_compact(MirFunction* mf)
+{
+  size_t out = 0;
+  for(size_t i = 0; i < mf->count; i++) {
+    if(mf->insns[i].op != MIR_NOP) {
+      mf->insns[out++] = mf->insns[i];
+    }
+  }
+  mf->count = out;
+}
+
+// Whether the instruction reads reg, or the flags for MIR_FLAGS
+int mir_reads(MirInsn* insn, int reg)
+{
+  switch(insn->op) {
+  case MIR_CCMP:
+  case MIR_CCMP_IMM:
+  case MIR_CSEL:
+  case MIR_CSINC:
+  case MIR_CSINV:
+  case MIR_CSNEG:
+  case MIR_CSET:
+  case MIR_BCOND:
+    if(reg == MIR_FLAGS) {
+      return 1;
+    }
+    break;
+  case MIR_RET:
+    return reg == 0;
+  default:
+    break;
+  }
+  uint8_t* fields[3];
+  int count = mir_read_fields(insn, fields);
+  for(int i = 0; i < count; i++) {
+    if(*fields[i] == reg) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// The fields of insn holding registers it reads, at most three. Register
+// 31 is left out where it reads as zero. The flags and ret's x0 are read
+// without a field.
+int mir_read_fields(MirInsn* insn, uint8_t** fields)
+{
+  int count = 0;
+  switch(insn->op) {
+  case MIR_NEG:
+  case MIR_MVN:
+  case MIR_ADD_IMM:
+  case MIR_SUB_IMM:
+  case MIR_LSL_IMM:
+  case MIR_LSR_IMM:
+  case MIR_ASR_IMM:
+  case MIR_AND_IMM:
+  case MIR_ORR_IMM:
+  case MIR_EOR_IMM:
+  case MIR_CMP_IMM:
+  case MIR_CCMP_IMM:
+  case MIR_CBZ:
+  case MIR_CBNZ:
+  case MIR_BR:
+    fields[count++] = &insn->rn;
+    break;
+  case MIR_MSUB:
+    fields[count++] = &insn->ra;
+    // Fall through
+  case MIR_ADD:
+  case MIR_SUB:
+  case MIR_MUL:
+  case MIR_SDIV:
+  case MIR_UDIV:
+  case MIR_AND:
+  case MIR_ORR:
+  case MIR_EOR:
+  case MIR_LSL:
+  case MIR_ASR:
+  case MIR_SMULL:
+  case MIR_UMULL:
+  case MIR_SMULH:
+  case MIR_UMULH:
+  case MIR_CMP:
+  case MIR_CMN:
+  case MIR_CCMP:
+  case MIR_LDR_INDEX:
+    fields[count++] = &insn->rn;
+    fields[count++] = &insn->rm;
+    break;
+  case MIR_ADD_SHIFT:
+  case MIR_SUB_SHIFT:
+  case MIR_CSEL:
+  case MIR_CSINC:
+  case MIR_CSINV:
+  case MIR_CSNEG:
+    if(insn->rn != A64_ZR) {
+      fields[count++] = &insn->rn;
+    }
+    if(insn->rm != A64_ZR) {
+      fields[count++] = &insn->rm;
+    }
+    break;
+  case MIR_STR:
+    if(insn->rd != A64_ZR) {
+      fields[count++] = &insn->rd;
+    }
+    break;
+  default:
+    break;
+  }
+  return count;
+}
+
+int mir_writes(MirInsn* insn, int reg)
+{
+  switch(insn->op) {
+  case MIR_CMP:
+  case MIR_CMP_IMM:
+  case MIR_CMN:
+  case MIR_CCMP:
+  case MIR_CCMP_IMM:
+    return reg == MIR_FLAGS;
+  case MIR_LABEL:
+  case MIR_STR:
+  case MIR_B:
+  case MIR_BCOND:
+  case MIR_CBZ:
+  case MIR_CBNZ:
+  case MIR_BR:
+  case MIR_OFFSET:
+  case MIR_WORD:
+  case MIR_RET:
+  case MIR_NOP:
+    return 0;
+  default:
+    return insn->rd == reg;
+  }
+}
+
+void mir_print(MirFunction* mf, Emitter* em, MirSyntax syntax)
+{
+  int gnu = syntax == GNU_SYNTAX;
+  if(gnu) {
+    emit_str(em, ".global ");
+    emit_str(em, mf->name);
+    emit_str(em, "\n.type ");
+    emit_str(em, mf->name);
+    emit_str(em, ", %function\n");
+  } else {
+    emit_char(em, '_');
+  }
+  emit_str(em, mf->name);
+  emit_bytes(em, ":\n", 2);
+  long last_label = 0;
+  for(size_t i = 0; i < mf->count; i++) {
+    MirInsn* insn = &mf->insns[i];
+    if(insn->op == MIR_NOP) {
+      continue;
+    }
+    if(insn->op == MIR_LABEL) {
+      emit_label_ref(em, insn->imm);
+      emit_bytes(em, ":\n", 2);
+      last_label = insn->imm;
+      continue;
+    }
+    // GNU as only takes what one instruction can encode, so spell out
+    // what mir_encode would do
+    if(gnu && insn->op == MIR_MOV_IMM) {
+      print_mov_parts(em, insn->sf, insn->rd, insn->imm);
+      continue;
+    }
+    if(gnu && (insn->op == MIR_ADD_IMM || insn->op == MIR_SUB_IMM)) {
+      print_add_parts(em, insn);
+      continue;
+    }
+    if(gnu && insn->op == MIR_CMP_IMM && !a64_addsub_fits(insn->imm)) {
+      print_mov_parts(em, insn->sf, SCRATCH_REG, insn->imm);
+      emit_str(em, "  cmp ");
+      print_reg(em, insn->sf, insn->rn);
+      emit_bytes(em, ", ", 2);
+      print_reg(em, insn->sf, SCRATCH_REG);
+      emit_char(em, '\n');
+      continue;
+    }
+    emit_bytes(em, "  ", 2);
+    if(gnu && (insn->op == MIR_LDR || insn->op == MIR_STR)
+       && !a64_scaled_offset(log2_size(insn->size), insn->imm)) {
+      emit_str(em, insn->op == MIR_LDR ? "ldur" : "stur");
+    } else {
+      emit_str(em, mir_names[insn->op]);
+    }
+    switch(insn->op) {
+    case MIR_MOV_IMM:
+      emit_char(em, ' ');
+      print_reg(em, insn->sf, insn->rd);
+      emit_bytes(em, ", #", 3);
+      emit_long(em, insn->imm);
+      break;
+    case MIR_NEG:
+    case MIR_MVN:
+      emit_char(em, ' ');
+      print_reg(em, insn->sf, insn->rd);
+      emit_bytes(em, ", ", 2);
+      print_reg(em, insn->sf, insn->rn);
+      break;
+    case MIR_MSUB:
+    case MIR_ADD:
+    case MIR_SUB:
+    case MIR_MUL:
+    case MIR_SDIV:
+    case MIR_UDIV:
+    case MIR_AND:
+    case MIR_ORR:
+    case MIR_EOR:
+    case MIR_LSL:
+    case MIR_ASR:
+      emit_char(em, ' ');
+      print_reg(em, insn->sf, insn->rd);
+      emit_bytes(em, ", ", 2);
+      print_reg(em, insn->sf, insn->rn);
+      emit_bytes(em, ", ", 2);
+      print_reg(em, insn->sf, insn->rm);
+      if(insn->op == MIR_MSUB) {
+        emit_bytes(em, ", ", 2);
+        print_reg(em, insn->sf, insn->ra);
+      }
+      break;
+    case MIR_SMULL:
+    case MIR_UMULL:
+    case MIR_SMULH:
+    case MIR_UMULH:
+      emit_char(em, ' ');
+      print_reg(em, 1, insn->rd);
+      emit_bytes(em, ", ", 2);
+      print_reg(em, insn->sf, insn->rn);
+      emit_bytes(em, ", ", 2);
+      print_reg(em, insn->sf, insn->rm);
+      break;
+    case MIR_ADD_SHIFT:
+    case MIR_SUB_SHIFT:
+      emit_char(em, ' ');
+      print_reg(em, insn->sf, insn->rd);
+      emit_bytes(em, ", ", 2);
+      print_zr_reg(em, insn->sf, insn->rn);
+      emit_bytes(em, ", ", 2);
+      print_reg(em, insn->sf, insn->rm);
+      emit_bytes(em, ", ", 2);
+      emit_str(em, shift_names[insn->cond]);
+      emit_bytes(em, " #", 2);
+      emit_long(em, insn->imm);
+      break;
+    case MIR_ADD_IMM:
+    case MIR_SUB_IMM:
+    case MIR_LSL_IMM:
+    case MIR_LSR_IMM:
+    case MIR_ASR_IMM:
+      emit_char(em, ' ');
+      print_reg(em, insn->sf, insn->rd);
+      emit_bytes(em, ", ", 2);
+      print_reg(em, insn->sf, insn->rn);
+      emit_bytes(em, ", #", 3);
+      emit_long(em, insn->imm);
+      break;
+    case MIR_AND_IMM:
+    case MIR_ORR_IMM:
+    case MIR_EOR_IMM:
+      emit_char(em, ' ');
+      print_reg(em, insn->sf, insn->rd);
+      emit_bytes(em, ", ", 2);
+      print_reg(em, insn->sf, insn->rn);
+      emit_bytes(em, ", #", 3);
+      emit_ulong(em, insn->sf ? (unsigned long)insn->imm
+                              : (uint32_t)insn->imm);
+      break;
+    case MIR_CMP:
+    case MIR_CMN:
+      emit_char(em, ' ');
+      print_reg(em, insn->sf, insn->rn);
+      emit_bytes(em, ", ", 2);
+      print_reg(em, insn->sf, insn->rm);
+      break;
+    case MIR_CMP_IMM:
+      emit_char(em, ' ');
+      print_reg(em, insn->sf, insn->rn);
+      emit_bytes(em, ", #", 3);
+      emit_long(em, insn->imm);
+      break;
+    case MIR_CCMP:
+      emit_char(em, ' ');
+      print_reg(em, insn->sf, insn->rn);
+      emit_bytes(em, ", ", 2);
+      print_reg(em, insn->sf, insn->rm);
+      emit_bytes(em, ", #", 3);
+      emit_long(em, insn->size);
+      emit_bytes(em, ", ", 2);
+      emit_str(em, a64_cond_name(insn->cond));
+      break;
+    case MIR_CCMP_IMM:
+      emit_char(em, ' ');
+      print_reg(em, insn->sf, insn->rn);
+      emit_bytes(em, ", #", 3);
+      emit_long(em, insn->imm);
+      emit_bytes(em, ", #", 3);
+      emit_long(em, insn->size);
+      emit_bytes(em, ", ", 2);
+      emit_str(em, a64_cond_name(insn->cond));
+      break;
+    case MIR_CSET:
+      emit_char(em, ' ');
+      print_reg(em, insn->sf, insn->rd);
+      emit_bytes(em, ", ", 2);
+      emit_str(em, a64_cond_name(insn->cond));
+      break;
+    case MIR_CSEL:
+    case MIR_CSINC:
+    case MIR_CSINV:
+    case MIR_CSNEG:
+      emit_char(em, ' ');
+      print_reg(em, insn->sf, insn->rd);
+      emit_bytes(em, ", ", 2);
+      print_zr_reg(em, insn->sf, insn->rn);
+      emit_bytes(em, ", ", 2);
+      print_zr_reg(em, insn->sf, insn->rm);
+      emit_bytes(em, ", ", 2);
+      emit_str(em, a64_cond_name(insn->cond));
+      break;
+    case MIR_LDR:
+    case MIR_STR:
+      if(insn->size < 4) {
+        emit_char(em, insn->size == 1 ? 'b' : 'h');
+      }
+      emit_char(em, ' ');
+      print_zr_reg(em, insn->sf, insn->rd);
+      emit_bytes(em, ", [sp, ", 7);
+      emit_long(em, insn->imm);
+      emit_char(em, ']');
+      break;
+    case MIR_LDR_INDEX:
+      if(insn->size < 4) {
+        emit_char(em, insn->size == 1 ? 'b' : 'h');
+      }
+      emit_char(em, ' ');
+      print_reg(em, insn->sf, insn->rd);
+      emit_bytes(em, ", [", 3);
+      print_reg(em, 1, insn->rn);
+      emit_bytes(em, ", ", 2);
+      print_reg(em, 1, insn->rm);
+      if(insn->size > 1) {
+        emit_str(em, ", lsl #");
+        emit_long(em, log2_size(insn->size));
+      }
+      emit_char(em, ']');
+      break;
+    case MIR_ADR:
+      emit_char(em, ' ');
+      print_reg(em, 1, insn->rd);
+      emit_bytes(em, ", ", 2);
+      emit_label_ref(em, insn->imm);
+      break;
+    case MIR_BR:
+      emit_char(em, ' ');
+      print_reg(em, 1, insn->rn);
+      break;
+    case MIR_OFFSET:
+      emit_char(em, ' ');
+      emit_label_ref(em, last_label);
+      emit_bytes(em, " - ", 3);
+      emit_label_ref(em, insn->imm);
+      break;
+    case MIR_BCOND:
+      emit_str(em, a64_cond_name(insn->cond));
+      // Fall through
+    case MIR_B:
+      emit_char(em, ' ');
+      emit_label_ref(em, insn->imm);
+      break;
+    case MIR_CBZ:
+    case MIR_CBNZ:
+      emit_char(em, ' ');
+      print_reg(em, insn->sf, insn->rn);
+      emit_bytes(em, ", ", 2);
+      emit_label_ref(em, insn->imm);
+      break;
+    case MIR_WORD:
+      emit_char(em, ' ');
+      emit_long(em, insn->imm);
+      break;
+    default:
+      break;
+    }
+    emit_char(em, '\n');
+  }
+  if(gnu) {
+    emit_str(em, ".size ");
+    emit_str(em, mf->name);
+    emit_str(em, ", .-");
+    emit_str(em, mf->name);
+    emit_char(em, '\n');
+  }
+}
+
+// mov when one instruction does it, otherwise orr from the zero register
+// or movz/movn and movk
+void print_mov_parts(Emitter* em, int sf, int rd, long imm)
+{
+  A64MovPart parts[4];
+  uint32_t bits;
+  if(a64_mov_bitmask(sf, imm, &bits)) {
+    emit_str(em, "  orr ");
+    print_reg(em, sf, rd);
+    emit_bytes(em, ", ", 2);
+    print_zr_reg(em, sf, A64_ZR);
+    emit_bytes(em, ", #", 3);
+    emit_ulong(em, sf ? (unsigned long)imm : (uint32_t)imm);
+    emit_char(em, '\n');
+    return;
+  }
+  int count = a64_mov_parts(sf, imm, parts);
+  for(int i = 0; i < count; i++) {
+    emit_bytes(em, "  ", 2);
+    emit_str(em, count == 1 ? "mov" : mov_names[parts[i].kind]);
+    emit_char(em, ' ');
+    print_reg(em, sf, rd);
+    emit_bytes(em, ", #", 3);
+    if(count == 1) {
+      emit_long(em, sf ? imm : (int32_t)imm);
+    } else {
+      emit_ulong(em, parts[i].imm16);
+      if(parts[i].hw) {
+        emit_str(em, ", lsl #");
+        emit_long(em, 16 * parts[i].hw);
+      }
+    }
+    emit_char(em, '\n');
+  }
+}
+
+// add/sub split the way a64_add_imm encodes it: flipped for a negative
+// imm, the high 12 bits shifted by 12, then the low 12 bits
+void print_add_parts(Emitter* em, MirInsn* insn)
+{
+  int sub = insn->op == MIR_SUB_IMM;
+  long imm = insn->imm;
+  if(imm < 0) {
+    sub = !sub;
+    imm = -imm;
+  }
+  int rn = insn->rn;
+  for(int shift = 12; shift >= 0; shift -= 12) {
+    long part = (imm >> shift) & 0xfff;
+    if(!part && (shift || imm >> 12)) {
+      continue;
+    }
+    emit_str(em, sub ? "  sub " : "  add ");
+    print_reg(em, insn->sf, insn->rd);
+    emit_bytes(em, ", ", 2);
+    print_reg(em, insn->sf, rn);
+    emit_bytes(em, ", #", 3);
+    emit_long(em, part);
+    if(shift) {
+      emit_str(em, ", lsl #12");
+    }
+    emit_char(em, '\n');
+    rn = insn->rd;
+  }
+}
+
+// Register 31 is sp, except in the operands print_zr_reg prints
+void print_reg(Emitter* em, int sf, int reg)
+{
+  if(reg == A64_SP) {
+    emit_bytes(em, "sp", 2);
+  } else {
+    emit_reg(em, sf ? 'x' : 'w', reg);
+  }
+}
+
+// For the operands where register 31 is the zero register
+void print_zr_reg(Emitter* em, int sf, int reg)
+{
+  if(reg == A64_ZR) {
+    emit_str(em, sf ? "xzr" : "wzr");
+  } else {
+    emit_reg(em, sf ? 'x' : 'w', reg);
+  }
+}
+
+int log2_size(int size)
+{
+  return size == 8 ? 3 : size == 4 ? 2 : size == 2 ? 1 : 0;
+}
+
+// Appends the machine code for the function. Labels are bound in code
+// and still need a64_resolve_labels. Returns 0 on success.
+int mir_encode(MirFunction* mf, A64Code* code)
+{
+  long last_label = 0;
+  uint32_t bits;
+  for(size_t i = 0; i < mf->count; i++) {
+    MirInsn* insn = &mf->insns[i];
+    int sf = insn->sf;
+    switch(insn->op) {
+    case MIR_LABEL:
+      a64_bind_label(code, insn->imm);
+      last_label = insn->imm;
+      break;
+    case MIR_MOV_IMM:
+      a64_mov_imm(code, sf, insn->rd, insn->imm);
+      break;
+    case MIR_NEG:
+      a64_emit(code, a64_reg_op(A64_SUB, sf, insn->rd, A64_ZR, insn->rn));
+      break;
+    case MIR_MVN:
+      a64_emit(code, a64_reg_op(A64_ORN, sf, insn->rd, A64_ZR, insn->rn));
+      break;
+    case MIR_ADD:
+    case MIR_SUB:
+    case MIR_SDIV:
+    case MIR_UDIV:
+    case MIR_AND:
+    case MIR_ORR:
+    case MIR_EOR:
+    case MIR_LSL:
+    case MIR_ASR:
+      a64_emit(code, a64_reg_op(reg_ops[insn->op], sf, insn->rd, insn->rn,
+                                insn->rm));
+      break;
+    case MIR_MUL:
+      a64_emit(code, a64_madd(sf, 0, insn->rd, insn->rn, insn->rm, A64_ZR));
+      break;
+    case MIR_MSUB:
+      a64_emit(code, a64_madd(sf, 1, insn->rd, insn->rn, insn->rm,
+                              insn->ra));
+      break;
+    case MIR_SMULL:
+    case MIR_UMULL:
+      a64_emit(code, a64_mul_long(insn->op == MIR_SMULL, insn->rd, insn->rn,
+                                  insn->rm));
+      break;
+    case MIR_SMULH:
+    case MIR_UMULH:
+      a64_emit(code, a64_mul_high(insn->op == MIR_SMULH, insn->rd, insn->rn,
+                                  insn->rm));
+      break;
+    case MIR_ADD_SHIFT:
+    case MIR_SUB_SHIFT:
+      a64_emit(code, a64_shifted_op(insn->op == MIR_ADD_SHIFT ? A64_ADD
+                                                               : A64_SUB,
+                                    sf, insn->rd, insn->rn, insn->rm,
+                                    insn->cond, insn->imm));
+      break;
+    case MIR_LSL_IMM:
+      a64_emit(code, a64_bitfield(sf, 0, insn->rd, insn->rn,
+                                  -insn->imm & (sf ? 63 : 31),
+                                  (sf ? 63 : 31) - insn->imm));
+      break;
+    case MIR_LSR_IMM:
+    case MIR_ASR_IMM:
+      a64_emit(code, a64_bitfield(sf, insn->op == MIR_ASR_IMM, insn->rd,
+                                  insn->rn, insn->imm, sf ? 63 : 31));
+      break;
+    case MIR_AND_IMM:
+    case MIR_ORR_IMM:
+    case MIR_EOR_IMM:
+      if(!a64_bitmask_imm(sf, insn->imm, &bits)) {
+        puts("Error: immediate out of range");
+        return -1;
+      }
+      a64_emit(code, a64_logical_imm(reg_ops[insn->op], sf, insn->rd,
+                                     insn->rn, bits));
+      break;
+    case MIR_ADD_IMM:
+    case MIR_SUB_IMM:
+      if(a64_add_imm(code, sf, insn->op == MIR_SUB_IMM, insn->rd, insn->rn,
+                     insn->imm)) {
+        puts("Error: immediate out of range");
+        return -1;
+      }
+      break;
+    case MIR_CMP:
+      a64_emit(code, a64_reg_op(A64_SUBS, sf, A64_ZR, insn->rn, insn->rm));
+      break;
+    case MIR_CMN:
+      a64_emit(code, a64_reg_op(A64_ADDS, sf, A64_ZR, insn->rn, insn->rm));
+      break;
+    case MIR_CCMP:
+      a64_emit(code, a64_ccmp(sf, insn->rn, insn->rm, insn->size,
+                              insn->cond));
+      break;
+    case MIR_CCMP_IMM:
+      a64_emit(code, a64_ccmp_imm(sf, insn->rn, insn->imm, insn->size,
+                                  insn->cond));
+      break;
+    case MIR_CMP_IMM:
+      if(a64_addsub_fits(insn->imm)) {
+        // cmn for a negative imm, the shifted form past 12 bits
+        long magnitude = insn->imm < 0 ? -insn->imm : insn->imm;
+        int shift12 = magnitude >= 4096;
+        a64_emit(code, a64_addsub_imm(sf, insn->imm >= 0, 1, A64_ZR,
+                                      insn->rn, magnitude >> 12 * shift12,
+                                      shift12));
+      } else {
+        // Too wide for the immediate form, go through the scratch register
+        a64_mov_imm(code, sf, SCRATCH_REG, insn->imm);
+        a64_emit(code, a64_reg_op(A64_SUBS, sf, A64_ZR, insn->rn,
+                                  SCRATCH_REG));
+      }
+      break;
+    case MIR_CSET:
+      a64_emit(code, a64_csinc(sf, insn->rd, A64_ZR, A64_ZR,
+                               a64_invert_cond(insn->cond)));
+      break;
+    case MIR_CSEL:
+    case MIR_CSINC:
+    case MIR_CSINV:
+    case MIR_CSNEG:
+      a64_emit(code, a64_cond_select(select_ops[insn->op], sf, insn->rd,
+                                     insn->rn, insn->rm, insn->cond));
+      break;
+    case MIR_LDR:
+    case MIR_STR:
+      if(a64_stack_access(code, log2_size(insn->size), insn->op == MIR_LDR,
+                          insn->rd, insn->imm)) {
+        puts("Error: stack offset out of range");
+        return -1;
+      }
+      break;
+    case MIR_LDR_INDEX:
+      a64_emit(code, a64_mem_index(log2_size(insn->size), insn->rd,
+                                   insn->rn, insn->rm));
+      break;
+    case MIR_ADR:
+      a64_emit_branch(code, a64_adr(insn->rd), A64_FIXUP_BCOND, insn->imm);
+      break;
+    case MIR_B:
+      a64_emit_branch(code, a64_b(), A64_FIXUP_B, insn->imm);
+      break;
+    case MIR_BCOND:
+      a64_emit_branch(code, a64_bcond(insn->cond), A64_FIXUP_BCOND,
+                      insn->imm);
+      break;
+    case MIR_CBZ:
+    case MIR_CBNZ:
+      a64_emit_branch(code, a64_cbz(sf, insn->op == MIR_CBNZ, insn->rn),
+                      A64_FIXUP_BCOND, insn->imm);
+      break;
+    case MIR_BR:
+      a64_emit(code, a64_br(insn->rn));
+      break;
+    case MIR_OFFSET:
+      a64_emit_offset(code, last_label, insn->imm);
+      break;
+    case MIR_WORD:
+      a64_emit(code, insn->imm);
+      break;
+    case MIR_RET:
+      a64_emit(code, a64_ret());
+      break;
+    case MIR_NOP:
+      break;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,141 @@
+#ifndef MIR_H_
+#define MIR_H_
+
+#include "aarch64.h"
+#include "emitter.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Machine instructions after selection, before they are printed or
+// encoded. Labels are the generator's numeric tags. The operations are
+// AArch64's; x86_64.c lowers them for -target x86_64-linux.
+typedef enum MirOp_e {
+  MIR_LABEL,   // imm is the label
+  MIR_MOV_IMM, // rd = imm, size is the width of the literal
+  MIR_NEG,     // rd = op rn
+  MIR_MVN,
+  MIR_ADD,     // rd = rn op rm
+  MIR_SUB,
+  MIR_MUL,
+  MIR_SDIV,
+  MIR_UDIV,
+  MIR_AND,
+  MIR_ORR,
+  MIR_EOR,
+  MIR_LSL,
+  MIR_ASR,
+  MIR_MSUB,    // rd = ra - rn * rm
+  MIR_SMULL,   // xd = wn * wm, the full 64 bit product
+  MIR_UMULL,
+  MIR_SMULH,   // xd = high 64 bits of xn * xm
+  MIR_UMULH,
+  MIR_ADD_SHIFT, // rd = rn op (rm shifted by imm), cond is the A64Shift
+  MIR_SUB_SHIFT, // and register 31 is zero
+  MIR_LSL_IMM, // rd = rn op imm
+  MIR_LSR_IMM,
+  MIR_ASR_IMM,
+  MIR_AND_IMM, // imm is a logical immediate, see a64_bitmask_imm
+  MIR_ORR_IMM,
+  MIR_EOR_IMM,
+  MIR_ADD_IMM, // rd = rn op imm, register 31 is sp
+  MIR_SUB_IMM,
+  MIR_CMP,     // flags for rn - rm
+  MIR_CMP_IMM, // flags for rn - imm
+  MIR_CMN,     // flags for rn + rm
+  MIR_CCMP,    // flags for rn - rm if cond holds, else size as nzcv. Not
+               // lowered for x86-64, so the generator leaves it out there
+  MIR_CCMP_IMM, // Same with imm, 5 bits, in place of rm
+  MIR_CSET,    // rd = cond ? 1 : 0
+  MIR_CSEL,    // rd = cond ? rn : rm, rm + 1, ~rm or -rm, register 31 is
+  MIR_CSINC,   // zero. Like MIR_CCMP, not lowered for x86-64.
+  MIR_CSINV,
+  MIR_CSNEG,
+  MIR_LDR,     // rd <-> [sp, imm], size is the access width. A store
+               // of register 31 stores zero.
+  MIR_STR,
+  MIR_LDR_INDEX, // rd = [rn + rm * size], zero extended
+  MIR_ADR,     // rd = address of label imm
+  MIR_B,       // imm is the label
+  MIR_BCOND,
+  MIR_CBZ,     // Branch to imm when rn is zero
+  MIR_CBNZ,
+  MIR_BR,      // Branch to the address in rn
+  MIR_OFFSET,  // Data word, bytes from label imm to the label before it.
+               // Jump tables are labels followed by these.
+  MIR_WORD,    // Data word imm
+  MIR_RET,
+  MIR_NOP      // Deleted by a pass, dropped by mir_compact
+} MirOp;
+
+// Pseudo register for the condition flags in mir_reads/mir_writes
+#define MIR_FLAGS 32
+
+// Assembler dialects for mir_print
+typedef enum MirSyntax_e {
+  APPLE_SYNTAX, // _name labels, mov takes any immediate
+  GNU_SYNTAX    // ELF symbols and directives, only encodable operands
+} MirSyntax;
+
+typedef struct MirInsn_s {
+  uint8_t op;
+  uint8_t sf;   // 64 bit registers
+  uint8_t size; // Bytes, or a ccmp's nzcv
+  uint8_t cond; // A64Cond
+  uint8_t rd;
+  uint8_t rn;
+  uint8_t rm;
+  uint8_t ra;
+  long imm;
+} MirInsn;
+
+// Instructions [start, end) with no label after start and no branch
+// before end - 1
+typedef struct MirBlock_s {
+  size_t start;
+  size_t end;
+} MirBlock;
+
+typedef struct MirFunction_s {
+  char* name;
+  MirInsn* insns;
+  size_t count;
+  size_t capacity;
+  MirBlock* blocks;
+  size_t block_count;
+} MirFunction;
+
+void mir_init(MirFunction*, const char*);
+void mir_free(MirFunction*);
+MirInsn* mir_append(MirFunction*, MirOp, int);
+void mir_label(MirFunction*, size_t);
+void mir_branch(MirFunction*, MirOp, A64Cond, size_t);
+void mir_mov_imm(MirFunction*, int, int, int, long);
+void mir_rr(MirFunction*, MirOp, int, int, int);
+void mir_rrr(MirFunction*, MirOp, int, int, int, int);
+void mir_rrrr(MirFunction*, MirOp, int, int, int, int, int);
+void mir_rri(MirFunction*, MirOp, int, int, int, long);
+void mir_shifted(MirFunction*, MirOp, int, int, int, int, A64Shift, int);
+void mir_cmp(MirFunction*, int, int, int);
+void mir_cmp_imm(MirFunction*, int, int, long);
+void mir_ccmp(MirFunction*, int, int, int, int, A64Cond);
+void mir_ccmp_imm(MirFunction*, int, int, int, int, A64Cond);
+void mir_cbz(MirFunction*, MirOp, int, int, size_t);
+void mir_cset(MirFunction*, int, int, A64Cond);
+void mir_csel(MirFunction*, MirOp, int, int, int, int, A64Cond);
+void mir_stack(MirFunction*, MirOp, int, int, int, long);
+void mir_ldr_index(MirFunction*, int, int, int, int, int);
+void mir_adr(MirFunction*, int, size_t);
+int mir_is_branch(MirInsn*);
+int mir_ends_block(MirInsn*);
+void mir_split_blocks(MirFunction*);
+void mir_compact(MirFunction*);
+void mir_rebase_labels(MirFunction*, long);
+int mir_reads(MirInsn*, int);
+int mir_read_fields(MirInsn*, uint8_t**);
+int mir_writes(MirInsn*, int);
+
+void mir_print(MirFunction*, Emitter*, MirSyntax);
+int mir_encode(MirFunction*, A64Code*);
+
+#endif
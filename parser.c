@@ -12,6 +12,7 @@ typedef enum State_t {
 } State;
 
 void print_error(const char*);
+void add_function(ProgramNode*, FunctionNode*);
 FunctionNode* construct_function(Type);
 BlockNode* construct_block();
 DeclarationNode* construct_declaration(Token);
@@ -40,6 +41,9 @@ ProgramNode parse(TokenList* _tokens)
 {
   tokens = _tokens;
   ProgramNode prgm;
+  prgm.functions = NULL;
+  prgm.function_count = 0;
+  prgm.function_capacity = 0;
   prgm.main = NULL;
 
   while(!token_list_empty(tokens)) {
@@ -51,15 +55,19 @@ ProgramNode parse(TokenList* _tokens)
       if(token_list_peek_n(tokens, 1).type != LEFT_PAREN) {
         print_error("Cannot handle global vars.");
       }
-      if(strcmp(token_list_peek_front(tokens).value, "main") != 0) {
-        print_error("Can only declare main function for now.");
+      for(size_t i = 0; i < prgm.function_count; i++) {
+        if(!strcmp(token_list_peek_front(tokens).value,
+                   prgm.functions[i]->name)) {
+          print_error("More than one definition of a function.");
+        }
       }
-      if(prgm.main != NULL) {
-        print_error("More than one main function.");
-      }
-      Type main_type = {.base = INT_VAR, .cvr = 0, .storage = 0, .signed_ = 1};
+      Type fn_type = {.base = INT_VAR, .cvr = 0, .storage = 0, .signed_ = 1};
       top_st = NULL;
-      prgm.main = construct_function(main_type);
+      FunctionNode* func = construct_function(fn_type);
+      add_function(&prgm, func);
+      if(!strcmp(func->name, "main")) {
+        prgm.main = func;
+      }
       break;
     case IDENTIFIER:
       print_error("Cannot handle most statements right now.");
@@ -76,6 +84,21 @@ ProgramNode parse(TokenList* _tokens)
   return prgm;
 }
 
+void add_function(ProgramNode* prgm, FunctionNode* func)
+{
+  if(prgm->function_count == prgm->function_capacity) {
+    prgm->function_capacity = prgm->function_capacity
+                              ? 2 * prgm->function_capacity : 4;
+    prgm->functions = realloc(prgm->functions,
+                              sizeof(FunctionNode*) * prgm->function_capacity);
+    if(!prgm->functions) {
+      perror("Error");
+      exit(1);
+    }
+  }
+  prgm->functions[prgm->function_count++] = func;
+}
+
 void print_error(const char * msg)
 {
   puts(msg);
@@ -590,7 +613,6 @@ ExpressionNode* parse_number(Token num)
     break;
   case LONG_LITERAL:
     number->type = LONG_VALUE;
-    printf("Long literal %s\n", num.value);
     if(num.value[strlen(num.value)-1] == 'l' ||
         num.value[strlen(num.value)-1] == 'L') {
       num.value[strlen(num.value)-1] = '\0';
@@ -118,6 +118,8 @@ typedef struct Type_s {
 typedef struct ExpressionNode_s {
   ExpressionType type;
   Type value_type;
+  int reg_need; // Registers its code uses, numbered by the generator
+  int side_effects; // Whether it assigns anywhere, set with reg_need
   union {
     char char_value;
     unsigned char uchar_value;
@@ -207,6 +209,9 @@ typedef struct FunctionNode_s {
 } FunctionNode;
 
 typedef struct ProgramNode_s {
+  FunctionNode** functions; // In source order
+  size_t function_count;
+  size_t function_capacity;
   FunctionNode* main;
 } ProgramNode;
 
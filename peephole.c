@@ -0,0 +1,420 @@
+#include "peephole.h"
+#include "mir.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_PASSES 8
+#define LIVENESS_BUDGET 64
+
+typedef struct Peephole_s {
+  MirFunction* mf;
+  long* label_index; // Label tag -> instruction index
+  size_t label_count;
+  int zero_reg; // Register 31 reads as zero in a store, not on x86-64
+} Peephole;
+
+typedef struct PeepholeRule_s {
+  const char* name;
+  int window; // Instructions matched, not counting labels skipped over
+  int (*apply)(Peephole*, size_t);
+} PeepholeRule;
+
+int store_load(Peephole*, size_t);
+int branch_next(Peephole*, size_t);
+int branch_chain(Peephole*, size_t);
+int unreachable(Peephole*, size_t);
+int add_zero(Peephole*, size_t);
+int cset_branch(Peephole*, size_t);
+int cset_cset(Peephole*, size_t);
+int zero_store(Peephole*, size_t);
+int copy_result(Peephole*, size_t);
+int copy_operand(Peephole*, size_t);
+int is_copy(MirInsn*);
+void apply_rules(Peephole*, PeepholeStats*);
+void index_labels(Peephole*);
+size_t next_insn(Peephole*, size_t);
+int reg_dead(Peephole*, size_t, int, int*);
+int reg_dead_at_label(Peephole*, size_t, int);
+size_t count_insns(MirFunction*);
+
+// Tried in order at every instruction
+const PeepholeRule rules[PEEPHOLE_RULE_COUNT] = {
+  [STORE_LOAD_RULE] = {"store-load", 2, store_load},
+  [BRANCH_NEXT_RULE] = {"branch-next", 1, branch_next},
+  [BRANCH_CHAIN_RULE] = {"branch-chain", 1, branch_chain},
+  [UNREACHABLE_RULE] = {"unreachable", 2, unreachable},
+  [ADD_ZERO_RULE] = {"add-zero", 1, add_zero},
+  [CSET_BRANCH_RULE] = {"cset-branch", 3, cset_branch},
+  [CSET_CSET_RULE] = {"cset-cset", 3, cset_cset},
+  [ZERO_STORE_RULE] = {"zero-store", 2, zero_store},
+  [COPY_RESULT_RULE] = {"copy-result", 2, copy_result},
+  [COPY_OPERAND_RULE] = {"copy-operand", 2, copy_operand}
+};
+
+void peephole_optimize(MirFunction* mf, int zero_reg,
+                       PeepholeStats* stats)
+{
+  Peephole p = {mf, NULL, 0, zero_reg};
+  stats->insns_before += count_insns(mf);
+  apply_rules(&p, stats);
+  free(p.label_index);
+  stats->insns_after += count_insns(mf);
+}
+
+// Register allocation turns the loads and stores of promoted locals into
+// copies, so the copy rules get another go at them. What this removes
+// counts toward the first run.
+void peephole_after_regalloc(MirFunction* mf, PeepholeStats* stats)
+{
+  Peephole p = {mf, NULL, 0, 1};
+  size_t before = count_insns(mf);
+  apply_rules(&p, stats);
+  free(p.label_index);
+  stats->insns_after -= before - count_insns(mf);
+}
+
+void apply_rules(Peephole* p, PeepholeStats* stats)
+{
+  MirFunction* mf = p->mf;
+  for(int pass = 0; pass < MAX_PASSES; pass++) {
+    int changed = 0;
+    index_labels(p);
+    for(size_t i = 0; i < mf->count; i++) {
+      for(int r = 0; r < PEEPHOLE_RULE_COUNT; r++) {
+        if(mf->insns[i].op == MIR_NOP) {
+          break;
+        }
+        if(i + rules[r].window <= mf->count && rules[r].apply(p, i)) {
+          stats->hits[r]++;
+          changed = 1;
+        }
+      }
+    }
+    mir_compact(mf);
+    if(!changed) {
+      break;
+    }
+  }
+}
+
+void print_peephole_stats(PeepholeStats* stats)
+{
+  long removed = (long)stats->insns_before - (long)stats->insns_after;
+  fprintf(stderr, "peephole: %zu -> %zu instructions (%.1f%% fewer)\n",
+          stats->insns_before, stats->insns_after,
+          stats->insns_before ? 100.0 * removed / stats->insns_before : 0.0);
+  for(int r = 0; r < PEEPHOLE_RULE_COUNT; r++) {
+    fprintf(stderr, "  %-14s %zu\n", rules[r].name, stats->hits[r]);
+  }
+}
+
+// str r, [sp, n]; ldr r, [sp, n] -> str r, [sp, n]
+// ldrb and ldrh zero extend, so only full width accesses qualify
+int store_load(Peephole* p, size_t i)
+{
+  MirInsn* str = &p->mf->insns[i];
+  size_t j = next_insn(p, i);
+  if(str->op != MIR_STR || str->size < 4 || j == p->mf->count) {
+    return 0;
+  }
+  MirInsn* ldr = &p->mf->insns[j];
+  if(ldr->op != MIR_LDR || ldr->rd != str->rd || ldr->imm != str->imm
+     || ldr->size != str->size || ldr->sf != str->sf) {
+    return 0;
+  }
+  ldr->op = MIR_NOP;
+  return 1;
+}
+
+// b .Lk; .Lk: -> .Lk:
+int branch_next(Peephole* p, size_t i)
+{
+  MirInsn* b = &p->mf->insns[i];
+  if(!mir_is_branch(b)) {
+    return 0;
+  }
+  for(size_t j = next_insn(p, i);
+      j < p->mf->count && p->mf->insns[j].op == MIR_LABEL;
+      j = next_insn(p, j)) {
+    if(p->mf->insns[j].imm == b->imm) {
+      b->op = MIR_NOP;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// b .Lj where .Lj: b .Lk -> b .Lk
+int branch_chain(Peephole* p, size_t i)
+{
+  MirInsn* b = &p->mf->insns[i];
+  if(!mir_is_branch(b)) {
+    return 0;
+  }
+  size_t j = p->label_index[b->imm];
+  while(j < p->mf->count && (p->mf->insns[j].op == MIR_LABEL
+                             || p->mf->insns[j].op == MIR_NOP)) {
+    j++;
+  }
+  if(j == p->mf->count || p->mf->insns[j].op != MIR_B
+     || p->mf->insns[j].imm == b->imm) {
+    return 0;
+  }
+  b->imm = p->mf->insns[j].imm;
+  return 1;
+}
+
+// Nothing between an unconditional branch and the next label can run
+int unreachable(Peephole* p, size_t i)
+{
+  MirInsn* b = &p->mf->insns[i];
+  size_t j = next_insn(p, i);
+  if((b->op != MIR_B && b->op != MIR_RET) || j == p->mf->count
+     || p->mf->insns[j].op == MIR_LABEL) {
+    return 0;
+  }
+  p->mf->insns[j].op = MIR_NOP;
+  return 1;
+}
+
+// add r, r, #0 -> nothing, mostly the frame setup when there are no locals
+int add_zero(Peephole* p, size_t i)
+{
+  MirInsn* add = &p->mf->insns[i];
+  if((add->op != MIR_ADD_IMM && add->op != MIR_SUB_IMM) || add->imm
+     || add->rd != add->rn) {
+    return 0;
+  }
+  add->op = MIR_NOP;
+  return 1;
+}
+
+// cset r, c; cmp r, #0; beq .Lk -> b.!c .Lk when r and the flags are dead
+int cset_branch(Peephole* p, size_t i)
+{
+  MirInsn* cset = &p->mf->insns[i];
+  size_t j = next_insn(p, i);
+  size_t k = j < p->mf->count ? next_insn(p, j) : j;
+  if(cset->op != MIR_CSET || k == p->mf->count) {
+    return 0;
+  }
+  MirInsn* cmp = &p->mf->insns[j];
+  MirInsn* b = &p->mf->insns[k];
+  if(cmp->op != MIR_CMP_IMM || cmp->rn != cset->rd || cmp->imm
+     || b->op != MIR_BCOND || (b->cond != A64_EQ && b->cond != A64_NE)) {
+    return 0;
+  }
+  int budget = LIVENESS_BUDGET;
+  if(!reg_dead(p, k + 1, cset->rd, &budget)
+     || !reg_dead_at_label(p, b->imm, cset->rd)) {
+    return 0;
+  }
+  budget = LIVENESS_BUDGET;
+  if(!reg_dead(p, k + 1, MIR_FLAGS, &budget)
+     || !reg_dead_at_label(p, b->imm, MIR_FLAGS)) {
+    return 0;
+  }
+  b->cond = b->cond == A64_EQ ? a64_invert_cond(cset->cond) : cset->cond;
+  cset->op = MIR_NOP;
+  cmp->op = MIR_NOP;
+  return 1;
+}
+
+// cset r, c; cmp r, #0; cset r, eq -> cset r, !c when the flags are dead
+int cset_cset(Peephole* p, size_t i)
+{
+  MirInsn* first = &p->mf->insns[i];
+  size_t j = next_insn(p, i);
+  size_t k = j < p->mf->count ? next_insn(p, j) : j;
+  if(first->op != MIR_CSET || k == p->mf->count) {
+    return 0;
+  }
+  MirInsn* cmp = &p->mf->insns[j];
+  MirInsn* second = &p->mf->insns[k];
+  if(cmp->op != MIR_CMP_IMM || cmp->rn != first->rd || cmp->imm
+     || second->op != MIR_CSET || second->rd != first->rd
+     || (second->cond != A64_EQ && second->cond != A64_NE)) {
+    return 0;
+  }
+  int budget = LIVENESS_BUDGET;
+  if(!reg_dead(p, k + 1, MIR_FLAGS, &budget)) {
+    return 0;
+  }
+  second->cond = second->cond == A64_EQ ? a64_invert_cond(first->cond)
+                                        : first->cond;
+  first->op = MIR_NOP;
+  cmp->op = MIR_NOP;
+  return 1;
+}
+
+// mov r, #0; str r, [sp, n] -> str zr, [sp, n] when r is dead
+int zero_store(Peephole* p, size_t i)
+{
+  MirInsn* mov = &p->mf->insns[i];
+  size_t j = next_insn(p, i);
+  if(!p->zero_reg || mov->op != MIR_MOV_IMM || mov->imm
+     || j == p->mf->count) {
+    return 0;
+  }
+  MirInsn* str = &p->mf->insns[j];
+  if(str->op != MIR_STR || str->rd != mov->rd) {
+    return 0;
+  }
+  int budget = LIVENESS_BUDGET;
+  if(!reg_dead(p, j + 1, mov->rd, &budget)) {
+    return 0;
+  }
+  str->rd = A64_ZR;
+  mov->op = MIR_NOP;
+  return 1;
+}
+
+// op t, ...; mov r, t -> op r, ... when t is dead
+int copy_result(Peephole* p, size_t i)
+{
+  MirInsn* def = &p->mf->insns[i];
+  size_t j = next_insn(p, i);
+  if(j == p->mf->count || !is_copy(&p->mf->insns[j])) {
+    return 0;
+  }
+  MirInsn* copy = &p->mf->insns[j];
+  if(copy->rn != def->rd || !mir_writes(def, def->rd)
+     || def->sf != copy->sf) {
+    return 0;
+  }
+  int budget = LIVENESS_BUDGET;
+  if(!reg_dead(p, j + 1, def->rd, &budget)) {
+    return 0;
+  }
+  def->rd = copy->rd;
+  copy->op = MIR_NOP;
+  return 1;
+}
+
+// mov t, r; ...; op ..., t, ... -> ...; op ..., r, ... when t is dead
+// after op and nothing in between, all in one block, writes t or r. A w
+// copy zero extends, so then op has to read t as a w register too. ret
+// reads x0 without naming it.
+int copy_operand(Peephole* p, size_t i)
+{
+  MirInsn* copy = &p->mf->insns[i];
+  if(!is_copy(copy)) {
+    return 0;
+  }
+  int t = copy->rd;
+  int budget = LIVENESS_BUDGET;
+  size_t j = next_insn(p, i);
+  while(j < p->mf->count && !mir_reads(&p->mf->insns[j], t)) {
+    MirInsn* insn = &p->mf->insns[j];
+    if(insn->op == MIR_LABEL || mir_ends_block(insn) || mir_writes(insn, t)
+       || mir_writes(insn, copy->rn) || budget-- <= 0) {
+      return 0;
+    }
+    j = next_insn(p, j);
+  }
+  if(j == p->mf->count || p->mf->insns[j].op == MIR_RET) {
+    return 0;
+  }
+  MirInsn* use = &p->mf->insns[j];
+  int wide = use->sf || (use->op == MIR_STR && use->size == 8)
+             || use->op == MIR_LDR_INDEX || use->op == MIR_BR;
+  if(!copy->sf && wide) {
+    return 0;
+  }
+  budget = LIVENESS_BUDGET;
+  if(!mir_writes(use, t) && !reg_dead(p, j + 1, t, &budget)) {
+    return 0;
+  }
+  uint8_t* fields[3];
+  int count = mir_read_fields(use, fields);
+  for(int f = 0; f < count; f++) {
+    if(*fields[f] == t) {
+      *fields[f] = copy->rn;
+    }
+  }
+  copy->op = MIR_NOP;
+  return 1;
+}
+
+// add rd, rn, #0 between two general registers, neither one sp
+int is_copy(MirInsn* insn)
+{
+  return insn->op == MIR_ADD_IMM && !insn->imm && insn->rd != insn->rn
+         && insn->rd != A64_SP && insn->rn != A64_SP;
+}
+
+void index_labels(Peephole* p)
+{
+  size_t max_tag = 0;
+  for(size_t i = 0; i < p->mf->count; i++) {
+    MirInsn* insn = &p->mf->insns[i];
+    if(insn->op == MIR_LABEL && (size_t)insn->imm > max_tag) {
+      max_tag = insn->imm;
+    }
+  }
+  if(max_tag + 1 > p->label_count) {
+    p->label_count = max_tag + 1;
+    p->label_index = realloc(p->label_index, sizeof(long) * p->label_count);
+    if(!p->label_index) {
+      perror("Error");
+      exit(1);
+    }
+  }
+  for(size_t i = 0; i < p->mf->count; i++) {
+    if(p->mf->insns[i].op == MIR_LABEL) {
+      p->label_index[p->mf->insns[i].imm] = i;
+    }
+  }
+}
+
+size_t next_insn(Peephole* p, size_t i)
+{
+  do {
+    i++;
+  } while(i < p->mf->count && p->mf->insns[i].op == MIR_NOP);
+  return i;
+}
+
+// Whether reg is written before it is read on every path from i. Gives
+// up and says it is live once the budget of instructions runs out.
+int reg_dead(Peephole* p, size_t i, int reg, int* budget)
+{
+  while(i < p->mf->count && (*budget)-- > 0) {
+    MirInsn* insn = &p->mf->insns[i];
+    if(mir_reads(insn, reg)) {
+      return 0;
+    }
+    if(mir_writes(insn, reg) || insn->op == MIR_RET) {
+      return 1;
+    }
+    if(insn->op == MIR_BR) {
+      return 0;
+    }
+    if(insn->op == MIR_B) {
+      i = p->label_index[insn->imm];
+      continue;
+    }
+    if(mir_is_branch(insn)
+       && !reg_dead(p, p->label_index[insn->imm], reg, budget)) {
+      return 0;
+    }
+    i++;
+  }
+  return i >= p->mf->count;
+}
+
+int reg_dead_at_label(Peephole* p, size_t tag, int reg)
+{
+  int budget = LIVENESS_BUDGET;
+  return reg_dead(p, p->label_index[tag], reg, &budget);
+}
+
+size_t count_insns(MirFunction* mf)
+{
+  size_t count = 0;
+  for(size_t i = 0; i < mf->count; i++) {
+    count += mf->insns[i].op != MIR_LABEL && mf->insns[i].op != MIR_NOP;
+  }
+  return count;
+}
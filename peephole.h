@@ -0,0 +1,30 @@
+#ifndef PEEPHOLE_H_
+#define PEEPHOLE_H_
+
+#include "mir.h"
+
+typedef enum PeepholeRuleId_e {
+  STORE_LOAD_RULE,
+  BRANCH_NEXT_RULE,
+  BRANCH_CHAIN_RULE,
+  UNREACHABLE_RULE,
+  ADD_ZERO_RULE,
+  CSET_BRANCH_RULE,
+  CSET_CSET_RULE,
+  ZERO_STORE_RULE,
+  COPY_RESULT_RULE,
+  COPY_OPERAND_RULE,
+  PEEPHOLE_RULE_COUNT
+} PeepholeRuleId;
+
+typedef struct PeepholeStats_s {
+  size_t hits[PEEPHOLE_RULE_COUNT];
+  size_t insns_before;
+  size_t insns_after;
+} PeepholeStats;
+
+void peephole_optimize(MirFunction*, int, PeepholeStats*);
+void peephole_after_regalloc(MirFunction*, PeepholeStats*);
+void print_peephole_stats(PeepholeStats*);
+
+#endif
@@ -26,10 +26,11 @@ void print_lexemes(TokenList* lexemes)
 
 void pretty_print(ProgramNode program)
 {
-  if(program.main) {
-    FunctionNode* main = program.main;
-    printf("func main -> %s:\n", (main->type.base == INT_VAR ? "int" : "void"));
-    print_block(main->body, 1);
+  for(size_t i = 0; i < program.function_count; i++) {
+    FunctionNode* func = program.functions[i];
+    printf("func %s -> %s:\n", func->name,
+           (func->type.base == INT_VAR ? "int" : "void"));
+    print_block(func->body, 1);
   }
 }
 
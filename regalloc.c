@@ -0,0 +1,354 @@
+#include "regalloc.h"
+#include "mir.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Locals go in the callee saved x19-x28. Expression temporaries stop at
+// x18, so the two never meet.
+#define FIRST_LOCAL_REG 19
+#define LOCAL_REG_COUNT 10
+
+typedef struct SlotAccess_s {
+  long offset;
+  int size;
+  size_t index;
+} SlotAccess;
+
+// Instructions [start, end] over which a slot's value may be needed
+typedef struct LiveInterval_s {
+  long offset;
+  int size;  // 0 when the slot is accessed in ways a register can't mimic
+  size_t start;
+  size_t end;
+  int reg;   // -1 while the slot stays in memory
+} LiveInterval;
+
+// From a label back to a branch that jumps to it
+typedef struct BackEdge_s {
+  size_t start;
+  size_t end;
+} BackEdge;
+
+size_t collect_intervals(MirFunction*, LiveInterval**);
+void extend_over_loops(MirFunction*, LiveInterval*, size_t);
+int linear_scan(LiveInterval*, size_t, RegAllocStats*);
+void rewrite_accesses(MirFunction*, LiveInterval*, size_t);
+void save_local_regs(MirFunction*, int);
+LiveInterval* find_interval(LiveInterval*, size_t, long);
+int compare_accesses(const void*, const void*);
+int compare_starts(const void*, const void*);
+
+void allocate_registers(MirFunction* mf, RegAllocStats* stats)
+{
+  LiveInterval* intervals = NULL;
+  size_t count = collect_intervals(mf, &intervals);
+  stats->locals += count;
+  extend_over_loops(mf, intervals, count);
+  int used = linear_scan(intervals, count, stats);
+  if(used) {
+    rewrite_accesses(mf, intervals, count);
+    save_local_regs(mf, used);
+  }
+  free(intervals);
+}
+
+void print_regalloc_stats(RegAllocStats* stats)
+{
+  fprintf(stderr, "regalloc: %zu of %zu locals in registers, %zu spilled\n",
+          stats->promoted, stats->locals, stats->spilled);
+}
+
+// One interval per stack slot, sorted by offset. A slot qualifies when
+// every access is a full 4 or 8 byte one at the same width and nothing
+// else touches its bytes, since a register can't model ldrb zero
+// extension or a wider store spilling into the next slot.
+size_t collect_intervals(MirFunction* mf, LiveInterval** out)
+{
+  size_t access_count = 0;
+  for(size_t i = 0; i < mf->count; i++) {
+    access_count += mf->insns[i].op == MIR_LDR
+                    || mf->insns[i].op == MIR_STR;
+  }
+  SlotAccess* accesses = malloc(sizeof(SlotAccess) * (access_count + 1));
+  LiveInterval* intervals = malloc(sizeof(LiveInterval) * (access_count + 1));
+  if(!accesses || !intervals) {
+    perror("Error");
+    exit(1);
+  }
+  size_t n = 0;
+  for(size_t i = 0; i < mf->count; i++) {
+    MirInsn* insn = &mf->insns[i];
+    if(insn->op == MIR_LDR || insn->op == MIR_STR) {
+      accesses[n++] = (SlotAccess){insn->imm, insn->size, i};
+    }
+  }
+  qsort(accesses, n, sizeof(SlotAccess), compare_accesses);
+  size_t count = 0;
+  long reach = 0;          // Highest byte any earlier slot touches
+  LiveInterval* reacher = NULL;
+  for(size_t a = 0; a < n; a++) {
+    SlotAccess* access = &accesses[a];
+    LiveInterval* last = count ? &intervals[count-1] : NULL;
+    if(last && last->offset == access->offset) {
+      if(access->size != last->size) {
+        last->size = 0;
+      }
+      last->end = access->index;
+    } else {
+      intervals[count++] = (LiveInterval){access->offset, access->size,
+                                          access->index, access->index, -1};
+      last = &intervals[count-1];
+      if(reacher && access->offset < reach) {
+        reacher->size = 0;
+        last->size = 0;
+      }
+    }
+    if(access->size < 4) {
+      last->size = 0;
+    }
+    if(access->offset + access->size > reach) {
+      reach = access->offset + access->size;
+      reacher = last;
+    }
+  }
+  free(accesses);
+  *out = intervals;
+  return count;
+}
+
+// A value may be needed anywhere inside a loop that uses it, so the
+// interval grows to cover every loop it overlaps, to a fixed point
+void extend_over_loops(MirFunction* mf, LiveInterval* intervals,
+                       size_t count)
+{
+  size_t max_tag = 0;
+  for(size_t i = 0; i < mf->count; i++) {
+    if(mf->insns[i].op == MIR_LABEL && (size_t)mf->insns[i].imm > max_tag) {
+      max_tag = mf->insns[i].imm;
+    }
+  }
+  size_t* label_index = calloc(max_tag + 1, sizeof(size_t));
+  BackEdge* loops = malloc(sizeof(BackEdge) * (mf->count + 1));
+  if(!label_index || !loops) {
+    perror("Error");
+    exit(1);
+  }
+  for(size_t i = 0; i < mf->count; i++) {
+    if(mf->insns[i].op == MIR_LABEL) {
+      label_index[mf->insns[i].imm] = i;
+    }
+  }
+  size_t loop_count = 0;
+  for(size_t i = 0; i < mf->count; i++) {
+    MirInsn* insn = &mf->insns[i];
+    if(mir_is_branch(insn) && label_index[insn->imm] <= i) {
+      loops[loop_count++] = (BackEdge){label_index[insn->imm], i};
+    }
+  }
+  for(size_t v = 0; v < count; v++) {
+    LiveInterval* interval = &intervals[v];
+    int changed = interval->size != 0;
+    while(changed) {
+      changed = 0;
+      for(size_t l = 0; l < loop_count; l++) {
+        if(loops[l].start > interval->end || loops[l].end < interval->start) {
+          continue;
+        }
+        if(loops[l].start < interval->start) {
+          interval->start = loops[l].start;
+          changed = 1;
+        }
+        if(loops[l].end > interval->end) {
+          interval->end = loops[l].end;
+          changed = 1;
+        }
+      }
+    }
+  }
+  free(label_index);
+  free(loops);
+}
+
+// Poletto and Sarkar's linear scan. When every register is taken, the
+// interval that ends last stays in memory. Returns how many of the
+// registers were used.
+int linear_scan(LiveInterval* intervals, size_t count, RegAllocStats* stats)
+{
+  LiveInterval** order = malloc(sizeof(LiveInterval*) * (count + 1));
+  if(!order) {
+    perror("Error");
+    exit(1);
+  }
+  size_t candidates = 0;
+  for(size_t i = 0; i < count; i++) {
+    if(intervals[i].size) {
+      order[candidates++] = &intervals[i];
+    }
+  }
+  qsort(order, candidates, sizeof(LiveInterval*), compare_starts);
+  LiveInterval* active[LOCAL_REG_COUNT];
+  int active_count = 0;
+  int used = 0;
+  for(size_t i = 0; i < candidates; i++) {
+    LiveInterval* current = order[i];
+    // Expire intervals that ended, active stays sorted by end
+    int kept = 0;
+    for(int a = 0; a < active_count; a++) {
+      if(active[a]->end >= current->start) {
+        active[kept++] = active[a];
+      }
+    }
+    active_count = kept;
+    int reg = -1;
+    if(active_count < LOCAL_REG_COUNT) {
+      for(int r = 0; r < LOCAL_REG_COUNT && reg < 0; r++) {
+        reg = FIRST_LOCAL_REG + r;
+        for(int a = 0; a < active_count; a++) {
+          if(active[a]->reg == reg) {
+            reg = -1;
+            break;
+          }
+        }
+      }
+    } else if(active[active_count-1]->end > current->end) {
+      LiveInterval* spill = active[--active_count];
+      reg = spill->reg;
+      spill->reg = -1;
+    }
+    if(reg < 0) {
+      continue;
+    }
+    current->reg = reg;
+    if(reg - FIRST_LOCAL_REG + 1 > used) {
+      used = reg - FIRST_LOCAL_REG + 1;
+    }
+    int a = active_count++;
+    while(a > 0 && active[a-1]->end > current->end) {
+      active[a] = active[a-1];
+      a--;
+    }
+    active[a] = current;
+  }
+  for(size_t i = 0; i < candidates; i++) {
+    stats->promoted += order[i]->reg >= 0;
+    stats->spilled += order[i]->reg < 0;
+  }
+  free(order);
+  return used;
+}
+
+// ldr r, [sp, n] -> mov r, xN and str r, [sp, n] -> mov xN, r. A w move
+// clears the upper half just as the 4 byte load would.
+void rewrite_accesses(MirFunction* mf, LiveInterval* intervals,
+                      size_t count)
+{
+  for(size_t i = 0; i < mf->count; i++) {
+    MirInsn* insn = &mf->insns[i];
+    if(insn->op != MIR_LDR && insn->op != MIR_STR) {
+      continue;
+    }
+    LiveInterval* interval = find_interval(intervals, count, insn->imm);
+    if(interval->reg < 0) {
+      continue;
+    }
+    int reg = insn->rd;
+    int load = insn->op == MIR_LDR;
+    int sf = insn->size == 8;
+    if(reg == A64_ZR) {
+      // str zr, [sp, n] -> mov xN, #0
+      insn->op = MIR_MOV_IMM;
+      insn->sf = sf;
+      insn->size = sf ? 8 : 4;
+      insn->imm = 0;
+      insn->rd = interval->reg;
+      continue;
+    }
+    insn->op = MIR_ADD_IMM;
+    insn->sf = sf;
+    insn->size = sf ? 8 : 4;
+    insn->imm = 0;
+    insn->rd = load ? reg : interval->reg;
+    insn->rn = load ? interval->reg : reg;
+  }
+}
+
+// The registers are callee saved, so they go in a save area above the
+// locals for the length of the function
+void save_local_regs(MirFunction* mf, int used)
+{
+  MirInsn* old = mf->insns;
+  size_t old_count = mf->count;
+  long frame = 0;
+  size_t first = 0;
+  if(old_count && old[0].op == MIR_SUB_IMM && old[0].rd == 31
+     && old[0].rn == 31) {
+    frame = old[0].imm;
+    first = 1;
+  }
+  long new_frame = frame + (8 * used + 15) / 16 * 16;
+  mf->capacity = old_count + 2 * (used + 2);
+  mf->count = 0;
+  mf->insns = malloc(sizeof(MirInsn) * mf->capacity);
+  if(!mf->insns) {
+    perror("Error");
+    exit(1);
+  }
+  mir_rri(mf, MIR_SUB_IMM, 1, 31, 31, new_frame);
+  for(int r = 0; r < used; r++) {
+    mir_stack(mf, MIR_STR, 1, 8, FIRST_LOCAL_REG + r, frame + 8 * r);
+  }
+  for(size_t i = first; i < old_count; i++) {
+    MirInsn* insn = &old[i];
+    if(insn->op == MIR_ADD_IMM && insn->rd == 31 && insn->rn == 31
+       && i + 1 < old_count && old[i+1].op == MIR_RET) {
+      continue;
+    }
+    if(insn->op == MIR_RET) {
+      for(int r = 0; r < used; r++) {
+        mir_stack(mf, MIR_LDR, 1, 8, FIRST_LOCAL_REG + r, frame + 8 * r);
+      }
+      mir_rri(mf, MIR_ADD_IMM, 1, 31, 31, new_frame);
+    }
+    *mir_append(mf, insn->op, insn->sf) = *insn;
+  }
+  free(old);
+}
+
+// intervals is sorted by offset and holds every slot accessed
+LiveInterval* find_interval(LiveInterval* intervals, size_t count,
+                            long offset)
+{
+  size_t lo = 0;
+  size_t hi = count;
+  while(hi - lo > 1) {
+    size_t mid = (lo + hi) / 2;
+    if(intervals[mid].offset <= offset) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return &intervals[lo];
+}
+
+int compare_accesses(const void* a, const void* b)
+{
+  const SlotAccess* x = a;
+  const SlotAccess* y = b;
+  if(x->offset != y->offset) {
+    return x->offset < y->offset ? -1 : 1;
+  }
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+int compare_starts(const void* a, const void* b)
+{
+  const LiveInterval* x = *(LiveInterval* const*)a;
+  const LiveInterval* y = *(LiveInterval* const*)b;
+  if(x->start != y->start) {
+    return x->start < y->start ? -1 : 1;
+  }
+  return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
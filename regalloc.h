@@ -0,0 +1,15 @@
+#ifndef REGALLOC_H_
+#define REGALLOC_H_
+
+#include "mir.h"
+
+typedef struct RegAllocStats_s {
+  size_t locals;   // Stack slots the function accesses
+  size_t promoted; // Slots that live in registers instead
+  size_t spilled;  // Slots left in memory for want of a register
+} RegAllocStats;
+
+void allocate_registers(MirFunction*, RegAllocStats*);
+void print_regalloc_stats(RegAllocStats*);
+
+#endif
@@ -0,0 +1,359 @@
+#include "strength.h"
+#include "mir.h"
+
+#include <stdio.h>
+
+// A multiplier and shift that divide by a constant, from Granlund and
+// Montgomery as worked out in Hacker's Delight, chapter 10
+typedef struct Magic_s {
+  uint64_t multiplier;
+  int shift;
+  int add; // Unsigned only: the multiplier took one bit more than fits
+} Magic;
+
+int exact_log2(uint64_t);
+uint64_t width_mask(int);
+long signed_value(int, uint64_t);
+Magic unsigned_magic(int, uint64_t);
+Magic signed_magic(int, long);
+void divide_unsigned(MirFunction*, int, int, int, int, uint64_t);
+void divide_signed(MirFunction*, int, int, int, int, long);
+void divide_by_power(MirFunction*, int, int, int, int, int);
+void shift_right(MirFunction*, MirOp, int, int, int, int);
+
+// Whether x * c takes at most two shifts and adds, which is where the
+// mov and mul stop losing
+int plan_multiply(int sf, long c, MultiplyPlan* plan)
+{
+  int width = sf ? 64 : 32;
+  uint64_t u = (uint64_t)c & width_mask(sf);
+  uint64_t neg = -u & width_mask(sf);
+  *plan = (MultiplyPlan){MUL_ZERO, 0, 0};
+  if(!u) {
+    return 1;
+  }
+  int b = 0;
+  while(!(u >> b & 1)) {
+    b++;
+  }
+  uint64_t odd = u >> b;
+  int a;
+  if(odd == 1) {
+    *plan = (MultiplyPlan){MUL_SHIFT, 0, b};
+  } else if((a = exact_log2(neg)) >= 0) {
+    *plan = (MultiplyPlan){MUL_NEG, 0, a};
+  } else if((a = exact_log2(neg + 1)) > 0) {
+    *plan = (MultiplyPlan){MUL_NEG_SUB, a, 0};
+  } else if((a = exact_log2(odd - 1)) > 0) {
+    *plan = (MultiplyPlan){MUL_ADD, a, b};
+  } else if(!b && (a = exact_log2(u + 1)) > 1) {
+    *plan = (MultiplyPlan){MUL_SUB, a, 0};
+  } else if(!b) {
+    for(a = 1; a < width - 1; a++) {
+      uint64_t factor = ((uint64_t)1 << a) + 1;
+      int a2;
+      if(u % factor == 0 && (a2 = exact_log2(u / factor - 1)) > 0) {
+        *plan = (MultiplyPlan){MUL_ADD_ADD, a, a2};
+        return 1;
+      }
+    }
+    return 0;
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+// reg = reg * c, scratch is free to use
+void lower_multiply(MirFunction* mf, MultiplyPlan* plan, int sf, int reg,
+                    int scratch)
+{
+  switch(plan->kind) {
+  case MUL_ZERO:
+    mir_mov_imm(mf, sf, sf ? 8 : 4, reg, 0);
+    break;
+  case MUL_ADD:
+    mir_shifted(mf, MIR_ADD_SHIFT, sf, reg, reg, reg, A64_LSL, plan->a);
+    // Fall through
+  case MUL_SHIFT:
+    if(plan->b) {
+      mir_rri(mf, MIR_LSL_IMM, sf, reg, reg, plan->b);
+    }
+    break;
+  case MUL_ADD_ADD:
+    mir_shifted(mf, MIR_ADD_SHIFT, sf, reg, reg, reg, A64_LSL, plan->a);
+    mir_shifted(mf, MIR_ADD_SHIFT, sf, reg, reg, reg, A64_LSL, plan->b);
+    break;
+  case MUL_SUB:
+    mir_rri(mf, MIR_LSL_IMM, sf, scratch, reg, plan->a);
+    mir_rrr(mf, MIR_SUB, sf, reg, scratch, reg);
+    break;
+  case MUL_NEG:
+    mir_shifted(mf, MIR_SUB_SHIFT, sf, reg, A64_ZR, reg, A64_LSL, plan->b);
+    break;
+  case MUL_NEG_SUB:
+    mir_shifted(mf, MIR_SUB_SHIFT, sf, reg, reg, reg, A64_LSL, plan->a);
+    break;
+  }
+}
+
+// Division by zero is left to the divide instruction
+int reducible_divisor(int sf, long c)
+{
+  return ((uint64_t)c & width_mask(sf)) != 0;
+}
+
+// rd = rn / c without a divide. rd may be rn, scratch must be neither.
+void lower_divide(MirFunction* mf, int sf, int signed_, int rd, int rn,
+                  int scratch, long c)
+{
+  if(signed_) {
+    divide_signed(mf, sf, rd, rn, scratch, signed_value(sf, c));
+  } else {
+    divide_unsigned(mf, sf, rd, rn, scratch, (uint64_t)c & width_mask(sf));
+  }
+}
+
+// reg = reg % c as reg - reg / c * c, the quotient going in quotient
+void lower_remainder(MirFunction* mf, int sf, int signed_, int reg,
+                     int scratch, int quotient, long c)
+{
+  int size = sf ? 8 : 4;
+  long d = signed_ ? signed_value(sf, c)
+                   : (long)((uint64_t)c & width_mask(sf));
+  uint64_t magnitude = signed_ && d < 0 ? -(uint64_t)d : (uint64_t)d;
+  int k = exact_log2(magnitude & width_mask(sf));
+  if(k == 0) {
+    mir_mov_imm(mf, sf, size, reg, 0);
+    return;
+  }
+  if(k > 0 && !signed_) {
+    mir_mov_imm(mf, sf, size, scratch, d - 1);
+    mir_rrr(mf, MIR_AND, sf, reg, reg, scratch);
+    return;
+  }
+  if(k > 0) {
+    // The remainder takes the sign of n whatever the sign of c
+    divide_by_power(mf, sf, quotient, reg, scratch, k);
+    mir_shifted(mf, MIR_SUB_SHIFT, sf, reg, reg, quotient, A64_LSL, k);
+    return;
+  }
+  lower_divide(mf, sf, signed_, quotient, reg, scratch, c);
+  mir_mov_imm(mf, sf, size, scratch, d);
+  mir_rrrr(mf, MIR_MSUB, sf, reg, quotient, scratch, reg);
+}
+
+void print_strength_stats(StrengthStats* stats)
+{
+  fprintf(stderr, "strength: %zu multiplies, %zu divisions, %zu remainders"
+          " by constants\n", stats->multiplies, stats->divisions,
+          stats->remainders);
+}
+
+// -1 unless v is a power of two
+int exact_log2(uint64_t v)
+{
+  if(!v || (v & (v - 1))) {
+    return -1;
+  }
+  int k = 0;
+  while(v >>= 1) {
+    k++;
+  }
+  return k;
+}
+
+uint64_t width_mask(int sf)
+{
+  return sf ? UINT64_MAX : UINT32_MAX;
+}
+
+long signed_value(int sf, uint64_t v)
+{
+  return sf ? (long)v : (long)(int32_t)(uint32_t)v;
+}
+
+// Hacker's Delight magicu: the smallest shift whose multiplier gives
+// exact quotients for every width bit n. 2 <= d < 2^(width-1).
+Magic unsigned_magic(int width, uint64_t d)
+{
+  uint64_t mask = width == 64 ? UINT64_MAX : UINT32_MAX;
+  uint64_t top = (uint64_t)1 << (width - 1);
+  Magic magic = {0, 0, 0};
+  uint64_t nc = mask - (-d & mask) % d;
+  int p = width - 1;
+  uint64_t q1 = top / nc;
+  uint64_t r1 = top - q1 * nc;
+  uint64_t q2 = (top - 1) / d;
+  uint64_t r2 = top - 1 - q2 * d;
+  uint64_t delta;
+  do {
+    p++;
+    if(r1 >= nc - r1) {
+      q1 = (2 * q1 + 1) & mask;
+      r1 = (2 * r1 - nc) & mask;
+    } else {
+      q1 = 2 * q1 & mask;
+      r1 = 2 * r1 & mask;
+    }
+    if(r2 + 1 >= d - r2) {
+      magic.add |= q2 >= top - 1;
+      q2 = (2 * q2 + 1) & mask;
+      r2 = (2 * r2 + 1 - d) & mask;
+    } else {
+      magic.add |= q2 >= top;
+      q2 = 2 * q2 & mask;
+      r2 = (2 * r2 + 1) & mask;
+    }
+    delta = d - 1 - r2;
+  } while(p < 2 * width && (q1 < delta || (q1 == delta && r1 == 0)));
+  magic.multiplier = (q2 + 1) & mask;
+  magic.shift = p - width;
+  return magic;
+}
+
+// Hacker's Delight magic, for 2 <= |d| and d not a power of two
+Magic signed_magic(int width, long d)
+{
+  uint64_t mask = width == 64 ? UINT64_MAX : UINT32_MAX;
+  uint64_t top = (uint64_t)1 << (width - 1);
+  Magic magic = {0, 0, 0};
+  uint64_t ad = (d < 0 ? -(uint64_t)d : (uint64_t)d) & mask;
+  uint64_t t = top + (d < 0);
+  uint64_t anc = t - 1 - t % ad;
+  int p = width - 1;
+  uint64_t q1 = top / anc;
+  uint64_t r1 = top - q1 * anc;
+  uint64_t q2 = top / ad;
+  uint64_t r2 = top - q2 * ad;
+  uint64_t delta;
+  do {
+    p++;
+    q1 *= 2;
+    r1 *= 2;
+    if(r1 >= anc) {
+      q1++;
+      r1 -= anc;
+    }
+    q2 *= 2;
+    r2 *= 2;
+    if(r2 >= ad) {
+      q2++;
+      r2 -= ad;
+    }
+    delta = ad - r2;
+  } while(q1 < delta || (q1 == delta && r1 == 0));
+  magic.multiplier = (d < 0 ? -(q2 + 1) : q2 + 1) & mask;
+  magic.shift = p - width;
+  return magic;
+}
+
+void divide_unsigned(MirFunction* mf, int sf, int rd, int rn, int scratch,
+                     uint64_t d)
+{
+  int width = sf ? 64 : 32;
+  int k = exact_log2(d);
+  if(k >= 0) {
+    shift_right(mf, MIR_LSR_IMM, sf, rd, rn, k);
+    return;
+  }
+  if(d >> (width - 1)) {
+    // Only a quotient of 0 or 1 fits
+    mir_mov_imm(mf, sf, sf ? 8 : 4, scratch, d);
+    mir_cmp(mf, sf, rn, scratch);
+    mir_cset(mf, sf, rd, A64_HS);
+    return;
+  }
+  Magic magic = unsigned_magic(width, d);
+  mir_mov_imm(mf, sf, sf ? 8 : 4, scratch, magic.multiplier);
+  if(sf) {
+    mir_rrr(mf, MIR_UMULH, 1, scratch, rn, scratch);
+    if(!magic.add) {
+      shift_right(mf, MIR_LSR_IMM, 1, rd, scratch, magic.shift);
+      return;
+    }
+  } else {
+    // The high half of the 64 bit product
+    mir_rrr(mf, MIR_UMULL, 0, scratch, rn, scratch);
+    if(!magic.add) {
+      mir_rri(mf, MIR_LSR_IMM, 1, rd, scratch, 32 + magic.shift);
+      return;
+    }
+    mir_rri(mf, MIR_LSR_IMM, 1, scratch, scratch, 32);
+  }
+  // The multiplier's missing top bit means adding n, halved first so the
+  // sum can't overflow: (t + (n - t) / 2) >> (shift - 1)
+  mir_rrr(mf, MIR_SUB, sf, rd, rn, scratch);
+  mir_shifted(mf, MIR_ADD_SHIFT, sf, rd, scratch, rd, A64_LSR, 1);
+  shift_right(mf, MIR_LSR_IMM, sf, rd, rd, magic.shift - 1);
+}
+
+void divide_signed(MirFunction* mf, int sf, int rd, int rn, int scratch,
+                   long d)
+{
+  int width = sf ? 64 : 32;
+  if(d == 1) {
+    shift_right(mf, MIR_ASR_IMM, sf, rd, rn, 0);
+    return;
+  }
+  if(d == -1) {
+    mir_rr(mf, MIR_NEG, sf, rd, rn);
+    return;
+  }
+  int k = exact_log2((d < 0 ? -(uint64_t)d : (uint64_t)d) & width_mask(sf));
+  if(k > 0) {
+    divide_by_power(mf, sf, rd, rn, scratch, k);
+    if(d < 0) {
+      mir_rr(mf, MIR_NEG, sf, rd, rd);
+    }
+    return;
+  }
+  Magic magic = signed_magic(width, d);
+  long m = signed_value(sf, magic.multiplier);
+  // A multiplier that wrapped to the other sign is off by n
+  MirOp fix = d > 0 && m < 0 ? MIR_ADD : d < 0 && m > 0 ? MIR_SUB : MIR_NOP;
+  mir_mov_imm(mf, sf, sf ? 8 : 4, scratch, m);
+  if(sf) {
+    mir_rrr(mf, MIR_SMULH, 1, scratch, rn, scratch);
+  } else {
+    mir_rrr(mf, MIR_SMULL, 0, scratch, rn, scratch);
+    mir_rri(mf, MIR_ASR_IMM, 1, scratch, scratch,
+            fix == MIR_NOP ? 32 + magic.shift : 32);
+  }
+  if(fix != MIR_NOP) {
+    mir_rrr(mf, fix, sf, scratch, scratch, rn);
+  }
+  if(magic.shift && (sf || fix != MIR_NOP)) {
+    mir_rri(mf, MIR_ASR_IMM, sf, scratch, scratch, magic.shift);
+  }
+  // Round toward zero by adding one to a negative quotient
+  mir_shifted(mf, MIR_ADD_SHIFT, sf, rd, scratch, scratch, A64_LSR,
+              width - 1);
+}
+
+// Signed n / 2^k for k >= 1. A negative n is biased by 2^k - 1 first so
+// the shift rounds toward zero.
+void divide_by_power(MirFunction* mf, int sf, int rd, int rn, int scratch,
+                     int k)
+{
+  int width = sf ? 64 : 32;
+  if(k == 1) {
+    mir_shifted(mf, MIR_ADD_SHIFT, sf, scratch, rn, rn, A64_LSR, width - 1);
+  } else {
+    mir_rri(mf, MIR_ASR_IMM, sf, scratch, rn, width - 1);
+    mir_shifted(mf, MIR_ADD_SHIFT, sf, scratch, rn, scratch, A64_LSR,
+                width - k);
+  }
+  mir_rri(mf, MIR_ASR_IMM, sf, rd, scratch, k);
+}
+
+// A shift by 0 is a move, or nothing at all
+void shift_right(MirFunction* mf, MirOp op, int sf, int rd, int rn,
+                 int amount)
+{
+  if(amount) {
+    mir_rri(mf, op, sf, rd, rn, amount);
+  } else if(rd != rn) {
+    mir_rri(mf, MIR_ADD_IMM, sf, rd, rn, 0);
+  }
+}
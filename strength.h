@@ -0,0 +1,36 @@
+#ifndef STRENGTH_H_
+#define STRENGTH_H_
+
+#include "mir.h"
+
+// How x * c is built from shifts and adds of x
+typedef enum MultiplyKind_e {
+  MUL_ZERO,
+  MUL_SHIFT,    // x << b
+  MUL_ADD,      // (x + (x << a)) << b
+  MUL_ADD_ADD,  // y + (y << b) where y = x + (x << a)
+  MUL_SUB,      // (x << a) - x
+  MUL_NEG,      // -(x << b)
+  MUL_NEG_SUB   // x - (x << a)
+} MultiplyKind;
+
+typedef struct MultiplyPlan_s {
+  MultiplyKind kind;
+  int a;
+  int b;
+} MultiplyPlan;
+
+typedef struct StrengthStats_s {
+  size_t multiplies; // Multiplies by a constant done with shifts and adds
+  size_t divisions;  // Divisions by a constant done without a divide
+  size_t remainders; // Same for the divide under a %
+} StrengthStats;
+
+int plan_multiply(int, long, MultiplyPlan*);
+void lower_multiply(MirFunction*, MultiplyPlan*, int, int, int);
+int reducible_divisor(int, long);
+void lower_divide(MirFunction*, int, int, int, int, int, long);
+void lower_remainder(MirFunction*, int, int, int, int, int, long);
+void print_strength_stats(StrengthStats*);
+
+#endif
@@ -0,0 +1,260 @@
+#include "summary.h"
+#include "parser.h"
+#include "hashmap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+void summarize_block(FunctionSummary*, BlockNode*, int*, long);
+void summarize_statement(FunctionSummary*, StatementNode*, int*, long);
+void place_declarations(FunctionSummary*, DeclarationNode**, size_t);
+void place_declaration(FunctionSummary*, DeclarationNode*);
+int compare_declaration_sizes(const void*, const void*);
+long add_switch(FunctionSummary*, StatementNode*);
+void add_case(FunctionSummary*, long, StatementNode*, int*);
+
+FunctionSummary* summarize_function(FunctionNode* func, int* tag_counter)
+{
+  FunctionSummary* summary = calloc(1, sizeof(FunctionSummary));
+  if(!summary) {
+    perror("Error");
+    exit(1);
+  }
+  hash_map_init(&summary->slots, POINTER_KEY);
+  hash_map_init(&summary->labels, STRING_KEY);
+  hash_map_init(&summary->case_tags, POINTER_KEY);
+  hash_map_init(&summary->switch_ids, POINTER_KEY);
+  summarize_block(summary, func->body, tag_counter, -1);
+  return summary;
+}
+
+// switch_id is the index of the innermost enclosing switch, or -1.
+// A block's own variables go below those of the blocks around it, and
+// the blocks inside it start where they end. Sibling blocks are never
+// live at once, so they share the same bytes.
+void summarize_block(FunctionSummary* summary, BlockNode* block,
+                     int* tag_counter, long switch_id)
+{
+  int outer_top = summary->scope_top;
+  DeclarationNode** decls = malloc(sizeof(DeclarationNode*)
+                                   * (block->count + 1));
+  if(!decls) {
+    perror("Error");
+    exit(1);
+  }
+  size_t decl_count = 0;
+  for(size_t i = 0; i < block->count; i++) {
+    if(block->body[i]->type == DECLARATION_ITEM) {
+      decls[decl_count++] = block->body[i]->decl;
+    }
+  }
+  place_declarations(summary, decls, decl_count);
+  free(decls);
+  for(size_t i = 0; i < block->count; i++) {
+    if(block->body[i]->type == STATEMENT_ITEM) {
+      summarize_statement(summary, block->body[i]->stmt, tag_counter,
+                          switch_id);
+    }
+  }
+  summary->scope_top = outer_top;
+}
+
+void summarize_statement(FunctionSummary* summary, StatementNode* stmt,
+                         int* tag_counter, long switch_id)
+{
+  int outer_top;
+  switch(stmt->type) {
+  case CONDITIONAL:
+    summarize_statement(summary, stmt->if_stmt, tag_counter, switch_id);
+    if(stmt->else_stmt) {
+      summarize_statement(summary, stmt->else_stmt, tag_counter, switch_id);
+    }
+    break;
+  case FORDECL_LOOP:
+    outer_top = summary->scope_top;
+    place_declaration(summary, stmt->init_decl);
+    summarize_statement(summary, stmt->loop_stmt, tag_counter, switch_id);
+    summary->scope_top = outer_top;
+    break;
+  case FOR_LOOP:
+  case WHILE_LOOP:
+  case DO_LOOP:
+    summarize_statement(summary, stmt->loop_stmt, tag_counter, switch_id);
+    break;
+  case BLOCK_STATEMENT:
+    summarize_block(summary, stmt->block, tag_counter, switch_id);
+    break;
+  case SWITCH_STATEMENT:
+    summarize_block(summary, stmt->switch_block, tag_counter,
+                    add_switch(summary, stmt));
+    break;
+  case CASE_STATEMENT:
+  case DEFAULT_STATEMENT:
+    add_case(summary, switch_id, stmt, tag_counter);
+    break;
+  case LABEL:
+    if(hash_map_put(&summary->labels, stmt->label_name, (*tag_counter)++)) {
+      puts("Error: duplicate label:");
+      puts(stmt->label_name);
+      exit(1);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+// Largest first, so every slot is naturally aligned without padding
+void place_declarations(FunctionSummary* summary, DeclarationNode** decls,
+                        size_t count)
+{
+  qsort(decls, count, sizeof(DeclarationNode*), compare_declaration_sizes);
+  for(size_t i = 0; i < count; i++) {
+    place_declaration(summary, decls[i]);
+  }
+}
+
+// Slot offsets count down from the top of the frame to the start of the
+// variable, so one that is a multiple of the size keeps it aligned
+void place_declaration(FunctionSummary* summary, DeclarationNode* decl)
+{
+  int size = type_size(decl->var_type);
+  int offset = (summary->scope_top + size + size - 1) / size * size;
+  summary->scope_top = offset;
+  if(offset > summary->locals_size) {
+    summary->locals_size = offset;
+  }
+  hash_map_put(&summary->slots, decl, offset);
+}
+
+// Equal sizes stay in source order, which qsort alone doesn't promise
+int compare_declaration_sizes(const void* a, const void* b)
+{
+  DeclarationNode* x = *(DeclarationNode* const*)a;
+  DeclarationNode* y = *(DeclarationNode* const*)b;
+  int x_size = type_size(x->var_type);
+  int y_size = type_size(y->var_type);
+  if(x_size != y_size) {
+    return y_size - x_size;
+  }
+  return x < y ? -1 : x > y;
+}
+
+long add_switch(FunctionSummary* summary, StatementNode* stmt)
+{
+  if(summary->switch_count == summary->switch_capacity) {
+    summary->switch_capacity = summary->switch_capacity ?
+                               2 * summary->switch_capacity : 4;
+    summary->switches = realloc(summary->switches,
+        sizeof(SwitchSummary) * summary->switch_capacity);
+    if(!summary->switches) {
+      perror("Error");
+      exit(1);
+    }
+  }
+  SwitchSummary* sw = &summary->switches[summary->switch_count];
+  sw->cases = NULL;
+  sw->case_count = 0;
+  sw->case_capacity = 0;
+  sw->has_default = 0;
+  sw->default_tag = 0;
+  hash_map_put(&summary->switch_ids, stmt, summary->switch_count);
+  return summary->switch_count++;
+}
+
+void add_case(FunctionSummary* summary, long switch_id, StatementNode* stmt,
+              int* tag_counter)
+{
+  if(switch_id < 0) {
+    puts("Error: case or default outside of switch statement.");
+    exit(1);
+  }
+  SwitchSummary* sw = &summary->switches[switch_id];
+  size_t tag = (*tag_counter)++;
+  hash_map_put(&summary->case_tags, stmt, tag);
+  if(stmt->type == DEFAULT_STATEMENT) {
+    if(sw->has_default) {
+      puts("Error: multiple default labels in one switch.");
+      exit(1);
+    }
+    sw->has_default = 1;
+    sw->default_tag = tag;
+    return;
+  }
+  for(size_t i = 0; i < sw->case_count; i++) {
+    if(sw->cases[i].val == stmt->val) {
+      printf("Error: duplicate case value: %ld\n", stmt->val);
+      exit(1);
+    }
+  }
+  if(sw->case_count == sw->case_capacity) {
+    sw->case_capacity = sw->case_capacity ? 2 * sw->case_capacity : 8;
+    sw->cases = realloc(sw->cases, sizeof(CaseLabel) * sw->case_capacity);
+    if(!sw->cases) {
+      perror("Error");
+      exit(1);
+    }
+  }
+  sw->cases[sw->case_count].val = stmt->val;
+  sw->cases[sw->case_count].tag = tag;
+  sw->case_count++;
+}
+
+SwitchSummary* find_switch_summary(FunctionSummary* summary,
+                                   StatementNode* stmt)
+{
+  size_t id;
+  if(!hash_map_get(&summary->switch_ids, stmt, &id)) {
+    return NULL;
+  }
+  return &summary->switches[id];
+}
+
+size_t find_case_tag(FunctionSummary* summary, StatementNode* stmt)
+{
+  size_t tag = 0;
+  hash_map_get(&summary->case_tags, stmt, &tag);
+  return tag;
+}
+
+int find_label_tag(FunctionSummary* summary, char* name, size_t* tag)
+{
+  return hash_map_get(&summary->labels, name, tag);
+}
+
+size_t find_slot_offset(FunctionSummary* summary, DeclarationNode* decl)
+{
+  size_t offset = 0;
+  hash_map_get(&summary->slots, decl, &offset);
+  return offset;
+}
+
+int type_size(Type type)
+{
+  switch(type.base) {
+  case CHAR_VAR: return 1;
+  case SHORT_VAR: return 2;
+  case INT_VAR: return 4;
+  case LONG_VAR: return 8;
+  case LONG_LONG_VAR: return 8;
+  case FLOAT_VAR: return 4;
+  case DOUBLE_VAR: return 8;
+  default: return 4;
+  }
+}
+
+void delete_function_summary(FunctionSummary* summary)
+{
+  if(!summary) {
+    return ;
+  }
+  for(size_t i = 0; i < summary->switch_count; i++) {
+    free(summary->switches[i].cases);
+  }
+  free(summary->switches);
+  hash_map_free(&summary->slots);
+  hash_map_free(&summary->labels);
+  hash_map_free(&summary->case_tags);
+  hash_map_free(&summary->switch_ids);
+  free(summary);
+}
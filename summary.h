@@ -0,0 +1,42 @@
+#ifndef SUMMARY_H_
+#define SUMMARY_H_
+
+#include "parser.h"
+#include "hashmap.h"
+
+typedef struct CaseLabel_s {
+  long val;
+  size_t tag;
+} CaseLabel;
+
+typedef struct SwitchSummary_s {
+  CaseLabel* cases; // In source order
+  size_t case_count;
+  size_t case_capacity;
+  int has_default;
+  size_t default_tag;
+} SwitchSummary;
+
+// Everything codegen needs to know about a function before walking it,
+// gathered in a single pass over the body.
+typedef struct FunctionSummary_s {
+  int locals_size;    // The most bytes of locals live at once
+  int scope_top;      // Bytes taken by the scopes around the current one
+  HashMap slots;      // DeclarationNode* -> stack offset
+  HashMap labels;     // label name -> tag
+  HashMap case_tags;  // CASE/DEFAULT StatementNode* -> tag
+  HashMap switch_ids; // SWITCH StatementNode* -> index into switches
+  SwitchSummary* switches;
+  size_t switch_count;
+  size_t switch_capacity;
+} FunctionSummary;
+
+FunctionSummary* summarize_function(FunctionNode*, int*);
+SwitchSummary* find_switch_summary(FunctionSummary*, StatementNode*);
+size_t find_case_tag(FunctionSummary*, StatementNode*);
+int find_label_tag(FunctionSummary*, char*, size_t*);
+size_t find_slot_offset(FunctionSummary*, DeclarationNode*);
+void delete_function_summary(FunctionSummary*);
+int type_size(Type type);
+
+#endif
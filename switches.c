@@ -0,0 +1,391 @@
+#include "switches.h"
+#include "mir.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Costs in instructions run to reach a case
+#define COMPARE_COST 2        // cmp, b.eq per case tried
+#define TABLE_COST 7          // sub, cmp, b.hi, adr, ldr, sub, br
+#define LOOKUP_COST 6         // sub, cmp, b.hi, adr, ldr, then str or b
+#define BIT_TEST_COST 5       // sub, cmp, b.hi, mov, lsl
+#define BIT_TEST_TARGET_COST 3 // mov, and, cbnz per target
+#define MIN_TABLE_DENSITY 40  // Percent of a table's entries that are cases
+#define MAX_TABLE_ENTRIES 4096
+#define MAX_BIT_TEST_TARGETS 3
+#define BIT_TEST_WIDTH 64
+#define MAX_LINEAR_CLUSTERS 3 // Tested one after another, not split
+
+// Registers the dispatch may use, the value being in x0
+#define INDEX_REG 1
+#define ADDRESS_REG 2
+
+typedef enum ClusterKind_e {
+  CASE_CLUSTER,    // One value compared for
+  TABLE_CLUSTER,
+  BIT_TEST_CLUSTER
+} ClusterKind;
+
+// Sorted cases [first, last] dispatched together
+typedef struct Cluster_s {
+  ClusterKind kind;
+  size_t first;
+  size_t last;
+} Cluster;
+
+typedef struct SwitchLowering_s {
+  MirFunction* mf;
+  CaseLabel* cases;
+  Cluster* clusters;
+  size_t default_tag;
+  int* tag_counter;
+  SwitchTables* tables;
+  int tree;
+} SwitchLowering;
+
+size_t find_clusters(SwitchLowering*, size_t);
+size_t table_end(CaseLabel*, size_t, size_t);
+size_t bit_test_end(CaseLabel*, size_t, size_t);
+size_t count_targets(CaseLabel*, size_t, size_t, size_t*);
+void write_tree(SwitchLowering*, size_t, size_t);
+void write_cluster(SwitchLowering*, Cluster*, size_t);
+int write_range_check(MirFunction*, long, long, size_t);
+void write_table(SwitchLowering*, Cluster*, size_t);
+void write_bit_test(SwitchLowering*, Cluster*, size_t);
+JumpTable* add_table(SwitchTables*, size_t, int*);
+int compare_cases(const void*, const void*);
+int compare_values(const void*, const void*);
+
+// Sorts the cases and splits them into clusters: dense runs go through a
+// jump table, runs spanning less than 64 values with few targets are
+// tested against a bit mask, and the rest are single compares. A binary
+// search over the clusters picks the one to try. tables is NULL when the
+// target has no lowering for jump tables.
+void lower_switch(MirFunction* mf, CaseLabel* cases, size_t count,
+                  size_t default_tag, int* tag_counter, SwitchTables* tables,
+                  SwitchStats* stats)
+{
+  stats->switches++;
+  if(!count) {
+    mir_branch(mf, MIR_B, A64_AL, default_tag);
+    return;
+  }
+  qsort(cases, count, sizeof(CaseLabel), compare_cases);
+  SwitchLowering sl = {mf, cases, NULL, default_tag, tag_counter, tables, 0};
+  sl.clusters = malloc(sizeof(Cluster) * count);
+  if(!sl.clusters) {
+    perror("Error");
+    exit(1);
+  }
+  size_t cluster_count = find_clusters(&sl, count);
+  for(size_t c = 0; c < cluster_count; c++) {
+    stats->tables += sl.clusters[c].kind == TABLE_CLUSTER;
+    stats->bit_tests += sl.clusters[c].kind == BIT_TEST_CLUSTER;
+  }
+  write_tree(&sl, 0, cluster_count - 1);
+  stats->trees += sl.tree;
+  free(sl.clusters);
+}
+
+// Whether loading the picked value from a table beats branching to code
+// that sets it, holes in the table taking the default's value. Sorts the
+// cases.
+int plan_lookup(CaseValue* cases, size_t count, int has_default)
+{
+  if(COMPARE_COST * count <= LOOKUP_COST) {
+    return 0;
+  }
+  qsort(cases, count, sizeof(CaseValue), compare_values);
+  unsigned long entries = cases[count-1].val - cases[0].val + 1;
+  if(entries > MAX_TABLE_ENTRIES
+     || count * 100 < MIN_TABLE_DENSITY * entries) {
+    return 0;
+  }
+  return has_default || entries == count;
+}
+
+// Loads the value of the case x0 matches into w0, or branches to miss
+// when x0 is outside the cases. cases are sorted by plan_lookup.
+void lower_switch_lookup(MirFunction* mf, CaseValue* cases, size_t count,
+                         uint32_t fill, size_t miss, int* tag_counter,
+                         SwitchTables* tables, SwitchStats* stats)
+{
+  stats->switches++;
+  stats->lookups++;
+  long lo = cases[0].val;
+  int index = write_range_check(mf, lo, cases[count-1].val, miss);
+  JumpTable* table = add_table(tables, cases[count-1].val - lo + 1,
+                               tag_counter);
+  table->values = malloc(sizeof(uint32_t) * table->count);
+  if(!table->values) {
+    perror("Error");
+    exit(1);
+  }
+  for(size_t i = 0; i < table->count; i++) {
+    table->values[i] = fill;
+  }
+  for(size_t i = 0; i < count; i++) {
+    table->values[cases[i].val - lo] = cases[i].bits;
+  }
+  mir_adr(mf, ADDRESS_REG, table->tag);
+  mir_ldr_index(mf, 0, 4, 0, ADDRESS_REG, index);
+}
+
+// The tables go after the function's code, out of the way of execution
+void append_switch_tables(MirFunction* mf, SwitchTables* tables)
+{
+  for(size_t t = 0; t < tables->count; t++) {
+    JumpTable* table = &tables->tables[t];
+    mir_label(mf, table->tag);
+    for(size_t i = 0; i < table->count; i++) {
+      if(table->targets) {
+        mir_append(mf, MIR_OFFSET, 0)->imm = table->targets[i];
+      } else {
+        mir_append(mf, MIR_WORD, 0)->imm = table->values[i];
+      }
+    }
+    free(table->targets);
+    free(table->values);
+  }
+  free(tables->tables);
+  tables->tables = NULL;
+  tables->count = 0;
+  tables->capacity = 0;
+}
+
+void print_switch_stats(SwitchStats* stats)
+{
+  fprintf(stderr, "switch: %zu switches, %zu lookup tables, %zu jump "
+          "tables, %zu bit tests, %zu compare trees\n", stats->switches,
+          stats->lookups, stats->tables, stats->bit_tests, stats->trees);
+}
+
+// Greedy from the smallest value: the longest run that is dense enough
+// for a table, else the longest run a bit test covers, else one case
+size_t find_clusters(SwitchLowering* sl, size_t count)
+{
+  size_t cluster_count = 0;
+  size_t first = 0;
+  while(first < count) {
+    size_t targets[MAX_BIT_TEST_TARGETS + 1];
+    Cluster* cluster = &sl->clusters[cluster_count++];
+    size_t last = sl->tables ? table_end(sl->cases, first, count) : first;
+    if(COMPARE_COST * (last - first + 1) > TABLE_COST) {
+      *cluster = (Cluster){TABLE_CLUSTER, first, last};
+    } else {
+      last = bit_test_end(sl->cases, first, count);
+      size_t target_count = count_targets(sl->cases, first, last, targets);
+      if(COMPARE_COST * (last - first + 1)
+         > BIT_TEST_COST + BIT_TEST_TARGET_COST * target_count) {
+        *cluster = (Cluster){BIT_TEST_CLUSTER, first, last};
+      } else {
+        last = first;
+        *cluster = (Cluster){CASE_CLUSTER, first, first};
+      }
+    }
+    first = last + 1;
+  }
+  return cluster_count;
+}
+
+// Last case of the longest run from first whose table would be dense
+// enough, first itself when there is none
+size_t table_end(CaseLabel* cases, size_t first, size_t count)
+{
+  size_t end = first;
+  for(size_t last = first + 1; last < count; last++) {
+    unsigned long entries = cases[last].val - cases[first].val + 1;
+    if(entries > MAX_TABLE_ENTRIES) {
+      break;
+    }
+    if((last - first + 1) * 100 >= MIN_TABLE_DENSITY * entries) {
+      end = last;
+    }
+  }
+  return end;
+}
+
+// Last case of the longest run from first that fits in one mask, with no
+// more targets than a bit test tries
+size_t bit_test_end(CaseLabel* cases, size_t first, size_t count)
+{
+  size_t targets[MAX_BIT_TEST_TARGETS + 1];
+  size_t last = first;
+  while(last + 1 < count
+        && cases[last+1].val - cases[first].val < BIT_TEST_WIDTH
+        && count_targets(cases, first, last + 1, targets)
+           <= MAX_BIT_TEST_TARGETS) {
+    last++;
+  }
+  return last;
+}
+
+// Distinct targets of cases [first, last] into targets, counting stops
+// once there are more than a bit test handles
+size_t count_targets(CaseLabel* cases, size_t first, size_t last,
+                     size_t* targets)
+{
+  size_t count = 0;
+  for(size_t i = first; i <= last && count <= MAX_BIT_TEST_TARGETS; i++) {
+    size_t t = 0;
+    while(t < count && targets[t] != cases[i].tag) {
+      t++;
+    }
+    if(t == count) {
+      targets[count++] = cases[i].tag;
+    }
+  }
+  return count;
+}
+
+// Clusters [first, last]. Any value not in one of them goes to default.
+void write_tree(SwitchLowering* sl, size_t first, size_t last)
+{
+  MirFunction* mf = sl->mf;
+  if(last - first + 1 > MAX_LINEAR_CLUSTERS) {
+    sl->tree = 1;
+    size_t mid = (first + last + 1) / 2;
+    size_t lower = (*sl->tag_counter)++;
+    mir_cmp_imm(mf, 1, 0, sl->cases[sl->clusters[mid].first].val);
+    mir_branch(mf, MIR_BCOND, A64_LO, lower);
+    write_tree(sl, mid, last);
+    mir_label(mf, lower);
+    write_tree(sl, first, mid - 1);
+    return;
+  }
+  for(size_t c = first; c <= last; c++) {
+    Cluster* cluster = &sl->clusters[c];
+    if(cluster->kind == CASE_CLUSTER) {
+      write_cluster(sl, cluster, sl->default_tag);
+      continue;
+    }
+    size_t next = c == last ? sl->default_tag : (size_t)(*sl->tag_counter)++;
+    write_cluster(sl, cluster, next);
+    if(c != last) {
+      mir_label(mf, next);
+    }
+  }
+  if(sl->clusters[last].kind == CASE_CLUSTER) {
+    mir_branch(mf, MIR_B, A64_AL, sl->default_tag);
+  }
+}
+
+// Values outside the cluster's range go to miss. A single case falls
+// through instead.
+void write_cluster(SwitchLowering* sl, Cluster* cluster, size_t miss)
+{
+  CaseLabel* cases = sl->cases;
+  switch(cluster->kind) {
+  case CASE_CLUSTER:
+    mir_cmp_imm(sl->mf, 1, 0, cases[cluster->first].val);
+    mir_branch(sl->mf, MIR_BCOND, A64_EQ, cases[cluster->first].tag);
+    break;
+  case TABLE_CLUSTER:
+    write_table(sl, cluster, miss);
+    break;
+  case BIT_TEST_CLUSTER:
+    write_bit_test(sl, cluster, miss);
+    break;
+  }
+}
+
+// Branches to miss unless x0 is in [lo, hi]. Returns the register
+// holding its offset into the range.
+int write_range_check(MirFunction* mf, long lo, long hi, size_t miss)
+{
+  int index = lo ? INDEX_REG : 0;
+  if(lo > 0 && lo < 4096) {
+    mir_rri(mf, MIR_SUB_IMM, 1, INDEX_REG, 0, lo);
+  } else if(lo) {
+    mir_mov_imm(mf, 1, 8, INDEX_REG, lo);
+    mir_rrr(mf, MIR_SUB, 1, INDEX_REG, 0, INDEX_REG);
+  }
+  // Values below lo wrap around to large unsigned offsets
+  mir_cmp_imm(mf, 1, index, hi - lo);
+  mir_branch(mf, MIR_BCOND, A64_HI, miss);
+  return index;
+}
+
+// adr, then the entry's distance back to the case, which is subtracted
+void write_table(SwitchLowering* sl, Cluster* cluster, size_t miss)
+{
+  MirFunction* mf = sl->mf;
+  long lo = sl->cases[cluster->first].val;
+  long hi = sl->cases[cluster->last].val;
+  int index = write_range_check(mf, lo, hi, miss);
+  JumpTable* table = add_table(sl->tables, hi - lo + 1, sl->tag_counter);
+  table->targets = malloc(sizeof(size_t) * table->count);
+  if(!table->targets) {
+    perror("Error");
+    exit(1);
+  }
+  for(size_t i = 0; i < table->count; i++) {
+    table->targets[i] = sl->default_tag;
+  }
+  for(size_t i = cluster->first; i <= cluster->last; i++) {
+    table->targets[sl->cases[i].val - lo] = sl->cases[i].tag;
+  }
+  mir_adr(mf, ADDRESS_REG, table->tag);
+  mir_ldr_index(mf, 0, 4, INDEX_REG, ADDRESS_REG, index);
+  mir_rrr(mf, MIR_SUB, 1, ADDRESS_REG, ADDRESS_REG, INDEX_REG);
+  mir_append(mf, MIR_BR, 0)->rn = ADDRESS_REG;
+}
+
+// 1 << offset, anded with the mask of each target's values in turn
+void write_bit_test(SwitchLowering* sl, Cluster* cluster, size_t miss)
+{
+  MirFunction* mf = sl->mf;
+  size_t targets[MAX_BIT_TEST_TARGETS + 1];
+  size_t target_count = count_targets(sl->cases, cluster->first,
+                                      cluster->last, targets);
+  long lo = sl->cases[cluster->first].val;
+  int index = write_range_check(mf, lo, sl->cases[cluster->last].val, miss);
+  mir_mov_imm(mf, 1, 8, ADDRESS_REG, 1);
+  mir_rrr(mf, MIR_LSL, 1, ADDRESS_REG, ADDRESS_REG, index);
+  for(size_t t = 0; t < target_count; t++) {
+    unsigned long mask = 0;
+    for(size_t i = cluster->first; i <= cluster->last; i++) {
+      if(sl->cases[i].tag == targets[t]) {
+        mask |= 1UL << (sl->cases[i].val - lo);
+      }
+    }
+    mir_mov_imm(mf, 1, 8, INDEX_REG, mask);
+    mir_rrr(mf, MIR_AND, 1, INDEX_REG, ADDRESS_REG, INDEX_REG);
+    mir_cbz(mf, MIR_CBNZ, 1, INDEX_REG, targets[t]);
+  }
+  mir_branch(mf, MIR_B, A64_AL, sl->default_tag);
+}
+
+// A table of count entries under a new label, the entries still unset
+JumpTable* add_table(SwitchTables* tables, size_t count, int* tag_counter)
+{
+  if(tables->count == tables->capacity) {
+    tables->capacity = tables->capacity ? 2 * tables->capacity : 4;
+    tables->tables = realloc(tables->tables,
+                             sizeof(JumpTable) * tables->capacity);
+    if(!tables->tables) {
+      perror("Error");
+      exit(1);
+    }
+  }
+  JumpTable* table = &tables->tables[tables->count++];
+  table->tag = (*tag_counter)++;
+  table->targets = NULL;
+  table->values = NULL;
+  table->count = count;
+  return table;
+}
+
+int compare_cases(const void* a, const void* b)
+{
+  const CaseLabel* x = a;
+  const CaseLabel* y = b;
+  return x->val < y->val ? -1 : x->val > y->val;
+}
+
+int compare_values(const void* a, const void* b)
+{
+  const CaseValue* x = a;
+  const CaseValue* y = b;
+  return x->val < y->val ? -1 : x->val > y->val;
+}
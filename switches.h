@@ -0,0 +1,46 @@
+#ifndef SWITCHES_H_
+#define SWITCHES_H_
+
+#include "mir.h"
+#include "summary.h"
+
+// Targets for the case values lo, lo + 1, ..., placed after the function
+// since the jump to them is an offset from the table's label. A lookup
+// table has the values a switch picks between instead.
+typedef struct JumpTable_s {
+  size_t tag;
+  size_t* targets; // NULL for a lookup table
+  uint32_t* values;
+  size_t count;
+} JumpTable;
+
+typedef struct SwitchTables_s {
+  JumpTable* tables;
+  size_t count;
+  size_t capacity;
+} SwitchTables;
+
+// A case of a switch that only picks a constant, and the register bits
+// of that constant
+typedef struct CaseValue_s {
+  long val;
+  uint32_t bits;
+} CaseValue;
+
+typedef struct SwitchStats_s {
+  size_t switches;
+  size_t lookups;   // Switches replaced by a load from a table of values
+  size_t tables;    // Dense clusters dispatched through a jump table
+  size_t bit_tests; // Clusters of few targets tested against a mask
+  size_t trees;     // Switches with a binary search over their clusters
+} SwitchStats;
+
+void lower_switch(MirFunction*, CaseLabel*, size_t, size_t, int*,
+                  SwitchTables*, SwitchStats*);
+int plan_lookup(CaseValue*, size_t, int);
+void lower_switch_lookup(MirFunction*, CaseValue*, size_t, uint32_t, size_t,
+                         int*, SwitchTables*, SwitchStats*);
+void append_switch_tables(MirFunction*, SwitchTables*);
+void print_switch_stats(SwitchStats*);
+
+#endif
@@ -0,0 +1,18 @@
+int main() {
+  int a = 3; int b = 5; int c = 0; long d = 7; int s = 0; int z = 0;
+  if(a < b && c == 0) s += 1;
+  if(a > b || d == 7) s += 2;
+  if(a > b && d == 7) s += 100;
+  if(a > b || c != 0) s += 200;
+  if(!(a < b && b < 4)) s += 4;
+  if(a < b && b < 9 && c <= 0 && d >= 7) s += 8;
+  if(a < b && b < 9 && c <= 0 && d >= 7 && a == 3) s += 16;
+  if(c != 0 && a / c > 1) s += 300;
+  if(c == 0 || a / c > 1) s += 32;
+  if((a < b || c) && (d > 100 || b == 5)) s += 64;
+  while(a < 10 && b) { a++; z++; }
+  do { z++; } while(!(z > 12) || a < 3);
+  for(int i = 0; i < 3 || i == 3; i++) s += 128;
+  if(s++ && z--) s += 1000;
+  return s % 256 + z;
+}
@@ -0,0 +1,30 @@
+int main()
+{
+  int a = 3;
+  int c = 5;
+  int r = 0;
+  long w = 2L;
+  for(int i = 0; i < 6; i++) {
+    if(a < 4 && c == 0) {
+      r = r + 1;
+    }
+    if(a < 4 && c == 1) {
+      r = r + 2;
+    }
+    if(c > 2 && a == 3) {
+      r = r + 4;
+    }
+    if(a == 0 || c == 2) {
+      r = r + 8;
+    }
+    if(i == 1 || i == 3 || w == 2L) {
+      r = r + 16;
+    }
+    if(i > 0 && i < 3 && a != 1) {
+      r = r + 32;
+    }
+    c = c - 1;
+    w = w + 1L;
+  }
+  return r;
+}
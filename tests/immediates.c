@@ -0,0 +1,30 @@
+int main() {
+  int a = 0;
+  int b = 0;
+  long c = 0;
+  unsigned int d = 0xff00ff;
+  int s = 0;
+  for(int i = 0; i < 10; i++) {
+    a = a + 4095;
+    b = b - 8192;
+    a &= 0xff0;
+    b = b | 0x55555555;
+    c = c ^ 0xffff;
+    c = c + 0x123456789;
+    d = d ^ 0xfffe0000u;
+    a = a << 3;
+    if(a == 7 && b > 3 && i < 100) a = 1;
+    if(a + 5) b = b >> 2;
+    if(i - 4) s += 1;
+    s += 5 < b;
+    s += i <= 3 || i >= 8;
+    s += (a & 8) != 0;
+    s += c == 65535;
+  }
+  long m = 0xff00ff00;
+  int z = 0;
+  int y = 0;
+  z = 0;
+  y = 0;
+  return (a + b + c + d + s + m + z + y) & 255;
+}
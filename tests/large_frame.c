@@ -0,0 +1,710 @@
+int main() {
+  long v0 = 0;
+  long v1 = 7;
+  long v2 = 14;
+  long v3 = 21;
+  long v4 = 28;
+  long v5 = 35;
+  long v6 = 42;
+  long v7 = 49;
+  long v8 = 56;
+  long v9 = 63;
+  long v10 = 70;
+  long v11 = 77;
+  long v12 = 84;
+  long v13 = 91;
+  long v14 = 98;
+  long v15 = 105;
+  long v16 = 112;
+  long v17 = 119;
+  long v18 = 126;
+  long v19 = 133;
+  long v20 = 140;
+  long v21 = 147;
+  long v22 = 154;
+  long v23 = 161;
+  long v24 = 168;
+  long v25 = 175;
+  long v26 = 182;
+  long v27 = 189;
+  long v28 = 196;
+  long v29 = 203;
+  long v30 = 210;
+  long v31 = 217;
+  long v32 = 224;
+  long v33 = 231;
+  long v34 = 238;
+  long v35 = 245;
+  long v36 = 252;
+  long v37 = 259;
+  long v38 = 266;
+  long v39 = 273;
+  long v40 = 280;
+  long v41 = 287;
+  long v42 = 294;
+  long v43 = 301;
+  long v44 = 308;
+  long v45 = 315;
+  long v46 = 322;
+  long v47 = 329;
+  long v48 = 336;
+  long v49 = 343;
+  long v50 = 350;
+  long v51 = 357;
+  long v52 = 364;
+  long v53 = 371;
+  long v54 = 378;
+  long v55 = 385;
+  long v56 = 392;
+  long v57 = 399;
+  long v58 = 406;
+  long v59 = 413;
+  long v60 = 420;
+  long v61 = 427;
+  long v62 = 434;
+  long v63 = 441;
+  long v64 = 448;
+  long v65 = 455;
+  long v66 = 462;
+  long v67 = 469;
+  long v68 = 476;
+  long v69 = 483;
+  long v70 = 490;
+  long v71 = 497;
+  long v72 = 504;
+  long v73 = 511;
+  long v74 = 518;
+  long v75 = 525;
+  long v76 = 532;
+  long v77 = 539;
+  long v78 = 546;
+  long v79 = 553;
+  long v80 = 560;
+  long v81 = 567;
+  long v82 = 574;
+  long v83 = 581;
+  long v84 = 588;
+  long v85 = 595;
+  long v86 = 602;
+  long v87 = 609;
+  long v88 = 616;
+  long v89 = 623;
+  long v90 = 630;
+  long v91 = 637;
+  long v92 = 644;
+  long v93 = 651;
+  long v94 = 658;
+  long v95 = 665;
+  long v96 = 672;
+  long v97 = 679;
+  long v98 = 686;
+  long v99 = 693;
+  long v100 = 700;
+  long v101 = 707;
+  long v102 = 714;
+  long v103 = 721;
+  long v104 = 728;
+  long v105 = 735;
+  long v106 = 742;
+  long v107 = 749;
+  long v108 = 756;
+  long v109 = 763;
+  long v110 = 770;
+  long v111 = 777;
+  long v112 = 784;
+  long v113 = 791;
+  long v114 = 798;
+  long v115 = 805;
+  long v116 = 812;
+  long v117 = 819;
+  long v118 = 826;
+  long v119 = 833;
+  long v120 = 840;
+  long v121 = 847;
+  long v122 = 854;
+  long v123 = 861;
+  long v124 = 868;
+  long v125 = 875;
+  long v126 = 882;
+  long v127 = 889;
+  long v128 = 896;
+  long v129 = 903;
+  long v130 = 910;
+  long v131 = 917;
+  long v132 = 924;
+  long v133 = 931;
+  long v134 = 938;
+  long v135 = 945;
+  long v136 = 952;
+  long v137 = 959;
+  long v138 = 966;
+  long v139 = 973;
+  long v140 = 980;
+  long v141 = 987;
+  long v142 = 994;
+  long v143 = 1001;
+  long v144 = 1008;
+  long v145 = 1015;
+  long v146 = 1022;
+  long v147 = 1029;
+  long v148 = 1036;
+  long v149 = 1043;
+  long v150 = 1050;
+  long v151 = 1057;
+  long v152 = 1064;
+  long v153 = 1071;
+  long v154 = 1078;
+  long v155 = 1085;
+  long v156 = 1092;
+  long v157 = 1099;
+  long v158 = 1106;
+  long v159 = 1113;
+  long v160 = 1120;
+  long v161 = 1127;
+  long v162 = 1134;
+  long v163 = 1141;
+  long v164 = 1148;
+  long v165 = 1155;
+  long v166 = 1162;
+  long v167 = 1169;
+  long v168 = 1176;
+  long v169 = 1183;
+  long v170 = 1190;
+  long v171 = 1197;
+  long v172 = 1204;
+  long v173 = 1211;
+  long v174 = 1218;
+  long v175 = 1225;
+  long v176 = 1232;
+  long v177 = 1239;
+  long v178 = 1246;
+  long v179 = 1253;
+  long v180 = 1260;
+  long v181 = 1267;
+  long v182 = 1274;
+  long v183 = 1281;
+  long v184 = 1288;
+  long v185 = 1295;
+  long v186 = 1302;
+  long v187 = 1309;
+  long v188 = 1316;
+  long v189 = 1323;
+  long v190 = 1330;
+  long v191 = 1337;
+  long v192 = 1344;
+  long v193 = 1351;
+  long v194 = 1358;
+  long v195 = 1365;
+  long v196 = 1372;
+  long v197 = 1379;
+  long v198 = 1386;
+  long v199 = 1393;
+  long v200 = 1400;
+  long v201 = 1407;
+  long v202 = 1414;
+  long v203 = 1421;
+  long v204 = 1428;
+  long v205 = 1435;
+  long v206 = 1442;
+  long v207 = 1449;
+  long v208 = 1456;
+  long v209 = 1463;
+  long v210 = 1470;
+  long v211 = 1477;
+  long v212 = 1484;
+  long v213 = 1491;
+  long v214 = 1498;
+  long v215 = 1505;
+  long v216 = 1512;
+  long v217 = 1519;
+  long v218 = 1526;
+  long v219 = 1533;
+  long v220 = 1540;
+  long v221 = 1547;
+  long v222 = 1554;
+  long v223 = 1561;
+  long v224 = 1568;
+  long v225 = 1575;
+  long v226 = 1582;
+  long v227 = 1589;
+  long v228 = 1596;
+  long v229 = 1603;
+  long v230 = 1610;
+  long v231 = 1617;
+  long v232 = 1624;
+  long v233 = 1631;
+  long v234 = 1638;
+  long v235 = 1645;
+  long v236 = 1652;
+  long v237 = 1659;
+  long v238 = 1666;
+  long v239 = 1673;
+  long v240 = 1680;
+  long v241 = 1687;
+  long v242 = 1694;
+  long v243 = 1701;
+  long v244 = 1708;
+  long v245 = 1715;
+  long v246 = 1722;
+  long v247 = 1729;
+  long v248 = 1736;
+  long v249 = 1743;
+  long v250 = 1750;
+  long v251 = 1757;
+  long v252 = 1764;
+  long v253 = 1771;
+  long v254 = 1778;
+  long v255 = 1785;
+  long v256 = 1792;
+  long v257 = 1799;
+  long v258 = 1806;
+  long v259 = 1813;
+  long v260 = 1820;
+  long v261 = 1827;
+  long v262 = 1834;
+  long v263 = 1841;
+  long v264 = 1848;
+  long v265 = 1855;
+  long v266 = 1862;
+  long v267 = 1869;
+  long v268 = 1876;
+  long v269 = 1883;
+  long v270 = 1890;
+  long v271 = 1897;
+  long v272 = 1904;
+  long v273 = 1911;
+  long v274 = 1918;
+  long v275 = 1925;
+  long v276 = 1932;
+  long v277 = 1939;
+  long v278 = 1946;
+  long v279 = 1953;
+  long v280 = 1960;
+  long v281 = 1967;
+  long v282 = 1974;
+  long v283 = 1981;
+  long v284 = 1988;
+  long v285 = 1995;
+  long v286 = 2002;
+  long v287 = 2009;
+  long v288 = 2016;
+  long v289 = 2023;
+  long v290 = 2030;
+  long v291 = 2037;
+  long v292 = 2044;
+  long v293 = 2051;
+  long v294 = 2058;
+  long v295 = 2065;
+  long v296 = 2072;
+  long v297 = 2079;
+  long v298 = 2086;
+  long v299 = 2093;
+  long v300 = 2100;
+  long v301 = 2107;
+  long v302 = 2114;
+  long v303 = 2121;
+  long v304 = 2128;
+  long v305 = 2135;
+  long v306 = 2142;
+  long v307 = 2149;
+  long v308 = 2156;
+  long v309 = 2163;
+  long v310 = 2170;
+  long v311 = 2177;
+  long v312 = 2184;
+  long v313 = 2191;
+  long v314 = 2198;
+  long v315 = 2205;
+  long v316 = 2212;
+  long v317 = 2219;
+  long v318 = 2226;
+  long v319 = 2233;
+  long v320 = 2240;
+  long v321 = 2247;
+  long v322 = 2254;
+  long v323 = 2261;
+  long v324 = 2268;
+  long v325 = 2275;
+  long v326 = 2282;
+  long v327 = 2289;
+  long v328 = 2296;
+  long v329 = 2303;
+  long v330 = 2310;
+  long v331 = 2317;
+  long v332 = 2324;
+  long v333 = 2331;
+  long v334 = 2338;
+  long v335 = 2345;
+  long v336 = 2352;
+  long v337 = 2359;
+  long v338 = 2366;
+  long v339 = 2373;
+  long v340 = 2380;
+  long v341 = 2387;
+  long v342 = 2394;
+  long v343 = 2401;
+  long v344 = 2408;
+  long v345 = 2415;
+  long v346 = 2422;
+  long v347 = 2429;
+  long v348 = 2436;
+  long v349 = 2443;
+  long v350 = 2450;
+  long v351 = 2457;
+  long v352 = 2464;
+  long v353 = 2471;
+  long v354 = 2478;
+  long v355 = 2485;
+  long v356 = 2492;
+  long v357 = 2499;
+  long v358 = 2506;
+  long v359 = 2513;
+  long v360 = 2520;
+  long v361 = 2527;
+  long v362 = 2534;
+  long v363 = 2541;
+  long v364 = 2548;
+  long v365 = 2555;
+  long v366 = 2562;
+  long v367 = 2569;
+  long v368 = 2576;
+  long v369 = 2583;
+  long v370 = 2590;
+  long v371 = 2597;
+  long v372 = 2604;
+  long v373 = 2611;
+  long v374 = 2618;
+  long v375 = 2625;
+  long v376 = 2632;
+  long v377 = 2639;
+  long v378 = 2646;
+  long v379 = 2653;
+  long v380 = 2660;
+  long v381 = 2667;
+  long v382 = 2674;
+  long v383 = 2681;
+  long v384 = 2688;
+  long v385 = 2695;
+  long v386 = 2702;
+  long v387 = 2709;
+  long v388 = 2716;
+  long v389 = 2723;
+  long v390 = 2730;
+  long v391 = 2737;
+  long v392 = 2744;
+  long v393 = 2751;
+  long v394 = 2758;
+  long v395 = 2765;
+  long v396 = 2772;
+  long v397 = 2779;
+  long v398 = 2786;
+  long v399 = 2793;
+  long v400 = 2800;
+  long v401 = 2807;
+  long v402 = 2814;
+  long v403 = 2821;
+  long v404 = 2828;
+  long v405 = 2835;
+  long v406 = 2842;
+  long v407 = 2849;
+  long v408 = 2856;
+  long v409 = 2863;
+  long v410 = 2870;
+  long v411 = 2877;
+  long v412 = 2884;
+  long v413 = 2891;
+  long v414 = 2898;
+  long v415 = 2905;
+  long v416 = 2912;
+  long v417 = 2919;
+  long v418 = 2926;
+  long v419 = 2933;
+  long v420 = 2940;
+  long v421 = 2947;
+  long v422 = 2954;
+  long v423 = 2961;
+  long v424 = 2968;
+  long v425 = 2975;
+  long v426 = 2982;
+  long v427 = 2989;
+  long v428 = 2996;
+  long v429 = 3003;
+  long v430 = 3010;
+  long v431 = 3017;
+  long v432 = 3024;
+  long v433 = 3031;
+  long v434 = 3038;
+  long v435 = 3045;
+  long v436 = 3052;
+  long v437 = 3059;
+  long v438 = 3066;
+  long v439 = 3073;
+  long v440 = 3080;
+  long v441 = 3087;
+  long v442 = 3094;
+  long v443 = 3101;
+  long v444 = 3108;
+  long v445 = 3115;
+  long v446 = 3122;
+  long v447 = 3129;
+  long v448 = 3136;
+  long v449 = 3143;
+  long v450 = 3150;
+  long v451 = 3157;
+  long v452 = 3164;
+  long v453 = 3171;
+  long v454 = 3178;
+  long v455 = 3185;
+  long v456 = 3192;
+  long v457 = 3199;
+  long v458 = 3206;
+  long v459 = 3213;
+  long v460 = 3220;
+  long v461 = 3227;
+  long v462 = 3234;
+  long v463 = 3241;
+  long v464 = 3248;
+  long v465 = 3255;
+  long v466 = 3262;
+  long v467 = 3269;
+  long v468 = 3276;
+  long v469 = 3283;
+  long v470 = 3290;
+  long v471 = 3297;
+  long v472 = 3304;
+  long v473 = 3311;
+  long v474 = 3318;
+  long v475 = 3325;
+  long v476 = 3332;
+  long v477 = 3339;
+  long v478 = 3346;
+  long v479 = 3353;
+  long v480 = 3360;
+  long v481 = 3367;
+  long v482 = 3374;
+  long v483 = 3381;
+  long v484 = 3388;
+  long v485 = 3395;
+  long v486 = 3402;
+  long v487 = 3409;
+  long v488 = 3416;
+  long v489 = 3423;
+  long v490 = 3430;
+  long v491 = 3437;
+  long v492 = 3444;
+  long v493 = 3451;
+  long v494 = 3458;
+  long v495 = 3465;
+  long v496 = 3472;
+  long v497 = 3479;
+  long v498 = 3486;
+  long v499 = 3493;
+  long v500 = 3500;
+  long v501 = 3507;
+  long v502 = 3514;
+  long v503 = 3521;
+  long v504 = 3528;
+  long v505 = 3535;
+  long v506 = 3542;
+  long v507 = 3549;
+  long v508 = 3556;
+  long v509 = 3563;
+  long v510 = 3570;
+  long v511 = 3577;
+  long v512 = 3584;
+  long v513 = 3591;
+  long v514 = 3598;
+  long v515 = 3605;
+  long v516 = 3612;
+  long v517 = 3619;
+  long v518 = 3626;
+  long v519 = 3633;
+  long v520 = 3640;
+  long v521 = 3647;
+  long v522 = 3654;
+  long v523 = 3661;
+  long v524 = 3668;
+  long v525 = 3675;
+  long v526 = 3682;
+  long v527 = 3689;
+  long v528 = 3696;
+  long v529 = 3703;
+  long v530 = 3710;
+  long v531 = 3717;
+  long v532 = 3724;
+  long v533 = 3731;
+  long v534 = 3738;
+  long v535 = 3745;
+  long v536 = 3752;
+  long v537 = 3759;
+  long v538 = 3766;
+  long v539 = 3773;
+  long v540 = 3780;
+  long v541 = 3787;
+  long v542 = 3794;
+  long v543 = 3801;
+  long v544 = 3808;
+  long v545 = 3815;
+  long v546 = 3822;
+  long v547 = 3829;
+  long v548 = 3836;
+  long v549 = 3843;
+  long v550 = 3850;
+  long v551 = 3857;
+  long v552 = 3864;
+  long v553 = 3871;
+  long v554 = 3878;
+  long v555 = 3885;
+  long v556 = 3892;
+  long v557 = 3899;
+  long v558 = 3906;
+  long v559 = 3913;
+  long v560 = 3920;
+  long v561 = 3927;
+  long v562 = 3934;
+  long v563 = 3941;
+  long v564 = 3948;
+  long v565 = 3955;
+  long v566 = 3962;
+  long v567 = 3969;
+  long v568 = 3976;
+  long v569 = 3983;
+  long v570 = 3990;
+  long v571 = 3997;
+  long v572 = 4004;
+  long v573 = 4011;
+  long v574 = 4018;
+  long v575 = 4025;
+  long v576 = 4032;
+  long v577 = 4039;
+  long v578 = 4046;
+  long v579 = 4053;
+  long v580 = 4060;
+  long v581 = 4067;
+  long v582 = 4074;
+  long v583 = 4081;
+  long v584 = 4088;
+  long v585 = 4095;
+  long v586 = 4102;
+  long v587 = 4109;
+  long v588 = 4116;
+  long v589 = 4123;
+  long v590 = 4130;
+  long v591 = 4137;
+  long v592 = 4144;
+  long v593 = 4151;
+  long v594 = 4158;
+  long v595 = 4165;
+  long v596 = 4172;
+  long v597 = 4179;
+  long v598 = 4186;
+  long v599 = 4193;
+  long v600 = 4200;
+  long v601 = 4207;
+  long v602 = 4214;
+  long v603 = 4221;
+  long v604 = 4228;
+  long v605 = 4235;
+  long v606 = 4242;
+  long v607 = 4249;
+  long v608 = 4256;
+  long v609 = 4263;
+  long v610 = 4270;
+  long v611 = 4277;
+  long v612 = 4284;
+  long v613 = 4291;
+  long v614 = 4298;
+  long v615 = 4305;
+  long v616 = 4312;
+  long v617 = 4319;
+  long v618 = 4326;
+  long v619 = 4333;
+  long v620 = 4340;
+  long v621 = 4347;
+  long v622 = 4354;
+  long v623 = 4361;
+  long v624 = 4368;
+  long v625 = 4375;
+  long v626 = 4382;
+  long v627 = 4389;
+  long v628 = 4396;
+  long v629 = 4403;
+  long v630 = 4410;
+  long v631 = 4417;
+  long v632 = 4424;
+  long v633 = 4431;
+  long v634 = 4438;
+  long v635 = 4445;
+  long v636 = 4452;
+  long v637 = 4459;
+  long v638 = 4466;
+  long v639 = 4473;
+  long v640 = 4480;
+  long v641 = 4487;
+  long v642 = 4494;
+  long v643 = 4501;
+  long v644 = 4508;
+  long v645 = 4515;
+  long v646 = 4522;
+  long v647 = 4529;
+  long v648 = 4536;
+  long v649 = 4543;
+  long v650 = 4550;
+  long v651 = 4557;
+  long v652 = 4564;
+  long v653 = 4571;
+  long v654 = 4578;
+  long v655 = 4585;
+  long v656 = 4592;
+  long v657 = 4599;
+  long v658 = 4606;
+  long v659 = 4613;
+  long v660 = 4620;
+  long v661 = 4627;
+  long v662 = 4634;
+  long v663 = 4641;
+  long v664 = 4648;
+  long v665 = 4655;
+  long v666 = 4662;
+  long v667 = 4669;
+  long v668 = 4676;
+  long v669 = 4683;
+  long v670 = 4690;
+  long v671 = 4697;
+  long v672 = 4704;
+  long v673 = 4711;
+  long v674 = 4718;
+  long v675 = 4725;
+  long v676 = 4732;
+  long v677 = 4739;
+  long v678 = 4746;
+  long v679 = 4753;
+  long v680 = 4760;
+  long v681 = 4767;
+  long v682 = 4774;
+  long v683 = 4781;
+  long v684 = 4788;
+  long v685 = 4795;
+  long v686 = 4802;
+  long v687 = 4809;
+  long v688 = 4816;
+  long v689 = 4823;
+  long v690 = 4830;
+  long v691 = 4837;
+  long v692 = 4844;
+  long v693 = 4851;
+  long v694 = 4858;
+  long v695 = 4865;
+  long v696 = 4872;
+  long v697 = 4879;
+  long v698 = 4886;
+  long v699 = 4893;
+  long s = 0;
+  for(int i = 0; i < 3; i++) {
+    v0 = v0 + v699;
+    v350 = v350 - v1;
+    v699 = v699 + i;
+    s = s + v0 + v350 + v699 + v512;
+  }
+  return s % 251;
+}
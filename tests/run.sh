@@ -0,0 +1,100 @@
+#!/bin/sh
+# Runs every tests/*.c each way this host can and checks main returns
+# what tests/<name>.expect holds:
+#   -vm                  on any host
+#   -run and -run -O1    on x86-64
+#   -static, with -O1    on AArch64, or under qemu-aarch64 or $AARCH64_RUN
+# Also checks -c encodes at -O0 and -O1, and with llvm-mc around, that
+# the -target aarch64-linux assembly assembles to the same bytes. Both
+# come from the same instructions, so that only catches encoding bugs:
+# without an AArch64 host or emulator the AArch64 code is never run.
+#
+# Usage: [AARCH64_RUN=emulator] tests/run.sh [compiler]
+
+cc=${1:-./compiler}
+dir=$(dirname "$0")
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+pass=0
+fail=0
+
+aarch64=
+if [ "$(uname -m)" = aarch64 ]; then
+  aarch64=native
+elif [ -n "$AARCH64_RUN" ]; then
+  aarch64=$AARCH64_RUN
+elif command -v qemu-aarch64 > /dev/null; then
+  aarch64=qemu-aarch64
+elif command -v qemu-aarch64-static > /dev/null; then
+  aarch64=qemu-aarch64-static
+fi
+llvm=
+if command -v llvm-mc > /dev/null && command -v llvm-objcopy > /dev/null; then
+  llvm=1
+fi
+
+# check name mode status expected
+check() {
+  if [ "$3" = "$4" ]; then
+    pass=$((pass+1))
+  else
+    echo "FAIL $1 $2: got $3, expected $4"
+    fail=$((fail+1))
+  fi
+}
+
+for src in "$dir"/*.c; do
+  name=$(basename "$src" .c)
+  expect=$(cat "$dir/$name.expect")
+  "$cc" -vm "$src" > /dev/null 2>&1
+  check "$name" -vm $? "$expect"
+  if [ "$(uname -m)" = x86_64 ]; then
+    "$cc" -run "$src" > /dev/null 2>&1
+    check "$name" -run $? "$expect"
+    "$cc" -run -O1 "$src" > /dev/null 2>&1
+    check "$name" "-run -O1" $? "$expect"
+  fi
+  for opt in -O0 -O1; do
+    obj="$tmp/$name$opt.o"
+    if ! "$cc" -c $opt -o "$obj" "$src" > /dev/null 2>&1; then
+      check "$name" "-c $opt" "no object" "an object"
+      continue
+    fi
+    if [ -n "$llvm" ]; then
+      "$cc" -target aarch64-linux $opt -o "$tmp/$name.s" "$src" > /dev/null 2>&1
+      llvm-mc -triple=aarch64-linux-gnu -filetype=obj -o "$tmp/$name.ref.o" \
+        "$tmp/$name.s" 2> /dev/null
+      llvm-objcopy -O binary -j .text "$obj" "$tmp/$name.text" 2> /dev/null
+      llvm-objcopy -O binary -j .text "$tmp/$name.ref.o" \
+        "$tmp/$name.ref.text" 2> /dev/null
+      if cmp -s "$tmp/$name.text" "$tmp/$name.ref.text"; then
+        check "$name" "-target aarch64-linux $opt" same same
+      else
+        check "$name" "-target aarch64-linux $opt" "other bytes" "-c bytes"
+      fi
+    fi
+    if [ -n "$aarch64" ]; then
+      "$cc" -static $opt -o "$tmp/$name" "$src" > /dev/null 2>&1
+      if [ "$aarch64" = native ]; then
+        "$tmp/$name"
+      else
+        $aarch64 "$tmp/$name"
+      fi
+      check "$name" "-static $opt" $? "$expect"
+    fi
+  done
+done
+
+[ -n "$llvm" ] || echo "Assembly checks skipped, no llvm-mc"
+if [ -n "$aarch64" ]; then
+  echo "$pass passed, $fail failed"
+else
+  echo
+  echo "WARNING: no AArch64 host, qemu-aarch64 or AARCH64_RUN, so none of"
+  echo "WARNING: the AArch64 code was run. Only -vm and x86-64 results and"
+  echo "WARNING: the AArch64 encoding were checked."
+  echo
+  echo "$pass passed, $fail failed, AArch64 runs SKIPPED"
+fi
+[ "$fail" = 0 ]
@@ -0,0 +1,36 @@
+int main() {
+  int a = 3; int b = 5; int c = -4; long d = 7L; long e = 0L - 9L;
+  int s = 0;
+  s += a < b ? a : b;
+  s += a > b ? a : b;
+  s += c < 0 ? -c : c;
+  s += c >= 0 ? c : -c;
+  long m = d < e ? e : d;
+  s += m;
+  s += e < 0 ? -e : e;
+  s += a == 3 ? 1 : 0;
+  s += a != 3 ? 1 : 0;
+  s += b ? 10 : 20;
+  s += !b ? 10 : 20;
+  s += a < b ? a + 1 : b;
+  s += a < b ? b : a + 1;
+  s += a > b ? b : ~a;
+  s += a > b ? -b : a;
+  s += a > b ? a - b : b - a;
+  s += c ? -1 : 0;
+  int x = 0;
+  if(a < b) x = a; else x = b;
+  s += x;
+  if(c < 0) x = -c;
+  s += x;
+  if(a > 100) { x = 1; } else { x = 2; }
+  s += x;
+  int y = 9;
+  if(b > a) y = b * 2;
+  s += y;
+  for(int i = 0; i < 10; i++) { if(i > y) y = i; s += i & 1 ? i : -i; }
+  s += (a < b ? (c < 0 ? 100 : 200) : 300);
+  int t = 1;
+  s += a < b ? t++ : t;
+  return (s + t) & 255;
+}
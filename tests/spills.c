@@ -0,0 +1,16 @@
+int main() {
+  int a = 3;
+  int b = 5;
+  long c = 7;
+  int r = a + (b * (a - (b + (a * (b - (a + (b * (a - (b + (a * (b - (a + (b * (a + (b - (a * 2))))))))))))))));
+  long q = c * (c + (c * (c - (c + (c * (c - (c + (c * (c - (c + (c * (c - 1000000))))))))))));
+  r = r + q % 251;
+  int v0 = 1; int v1 = 2; int v2 = 3; int v3 = 4; int v4 = 5; int v5 = 6;
+  int v6 = 7; int v7 = 8; int v8 = 9; int v9 = 10; int v10 = 11; int v11 = 12;
+  int v12 = 13; int v13 = 14; int v14 = 15; int v15 = 16; int v16 = 17;
+  int v17 = 18; int v18 = 19; int v19 = 20; int v20 = 21; int v21 = 22;
+  int v22 = 23; int v23 = 24;
+  int s = v0++ + (v1++ - (v2++ + (v3++ - (v4++ + (v5++ - (v6++ + (v7++ - (v8++ + (v9++ - (v10++ + (v11++ - (v12++ + (v13++ - (v14++ + (v15++ - (v16++ + (v17++ - (v18++ + (v19++ - (v20++ + (v21++ - (v22++ + v23++))))))))))))))))))))));
+  r = r + s + v0 + v12 + v23;
+  return r & 255;
+}
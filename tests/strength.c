@@ -0,0 +1,24 @@
+int main() {
+  int h = 0;
+  unsigned int u = 7;
+  long w = 0L - 123456789L;
+  int n = 0 - 1000;
+  int i = 0;
+  while(i < 50) {
+    h = h ^ (n * 3) ^ (n * 10) ^ (n * -7) ^ (n * 255);
+    h = h ^ (n / 2) ^ (n / 7) ^ (n / -16) ^ (n / 1000);
+    h = h ^ (n % 4) ^ (n % 7) ^ (n % -9) ^ (n % 641);
+    h = h ^ (u * 24) ^ (u / 3u) ^ (u / 0xffffffffu) ^ (u % 10u);
+    h = h ^ (w * 9) ^ (w / 25) ^ (w % 65537) ^ (w / -3L);
+    int t = n;
+    t *= 17;
+    t /= 5;
+    t %= 13;
+    h = (h << 1) ^ t;
+    n = n + 43;
+    u = u * 2654435761u + 12345u;
+    w = w + 9876543L;
+    i = i + 1;
+  }
+  return h & 255;
+}
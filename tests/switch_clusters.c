@@ -0,0 +1,68 @@
+int main() {
+  int t = 0;
+  int c = 90;
+  while(c < 130) {
+    switch(c) {
+    case 97:
+    case 101:
+    case 105:
+    case 111:
+    case 117:
+      t = t + 1;
+      break;
+    case 121:
+      t = t + 2;
+      break;
+    default:
+      break;
+    }
+    c = c + 1;
+  }
+  int i = 0;
+  while(i < 11) {
+    int x = 0;
+    switch(i) {
+    case 0: x = 3; break;
+    case 1: x = 70; break;
+    case 2: x = 900; break;
+    case 3: x = 5000; break;
+    case 4: x = 70000; break;
+    case 5: x = 1000000; break;
+    case 6: x = 1000003; break;
+    case 7: x = 123456789; break;
+    case 8: x = 4; break;
+    case 9: x = 0 - 5; break;
+    default: x = 1000005;
+    }
+    int r = 0;
+    switch(x) {
+    case 3: r = 1; break;
+    case 70: r = 2; break;
+    case 900: r = 3; break;
+    case 5000: r = 4; break;
+    case 70000: r = 5; break;
+    case 1000000: r = 6; break;
+    case 1000001: r = 7; break;
+    case 1000002: r = 8; break;
+    case 1000003: r = 9; break;
+    case 1000004: r = 10; break;
+    case 123456789: r = 11; break;
+    }
+    t = t + r;
+    i = i + 1;
+  }
+  i = 8;
+  while(i < 15) {
+    int r = 0;
+    switch(i) {
+    case 10: r = r + 1;
+    case 11: r = r + 2;
+    case 13: r = r + 4; break;
+    case 14:
+    default: r = r + 8;
+    }
+    t = t + r;
+    i = i + 1;
+  }
+  return t;
+}
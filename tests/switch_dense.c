@@ -0,0 +1,213 @@
+int main() {
+  int s = 5;
+  int n = 0;
+  int acc = 0;
+  while(n < 1000) {
+    switch(s) {
+    case 0: s = 3; break;
+    case 1: s = 10; break;
+    case 2: s = 17; break;
+    case 3: s = 24; break;
+    case 4: s = 31; break;
+    case 5: s = 38; break;
+    case 6: s = 45; break;
+    case 7: s = 52; break;
+    case 8: s = 59; break;
+    case 9: s = 66; break;
+    case 10: s = 73; break;
+    case 11: s = 80; break;
+    case 12: s = 87; break;
+    case 13: s = 94; break;
+    case 14: s = 101; break;
+    case 15: s = 108; break;
+    case 16: s = 115; break;
+    case 17: s = 122; break;
+    case 18: s = 129; break;
+    case 19: s = 136; break;
+    case 20: s = 143; break;
+    case 21: s = 150; break;
+    case 22: s = 157; break;
+    case 23: s = 164; break;
+    case 24: s = 171; break;
+    case 25: s = 178; break;
+    case 26: s = 185; break;
+    case 27: s = 192; break;
+    case 28: s = 199; break;
+    case 29: s = 6; break;
+    case 30: s = 13; break;
+    case 31: s = 20; break;
+    case 32: s = 27; break;
+    case 33: s = 34; break;
+    case 34: s = 41; break;
+    case 35: s = 48; break;
+    case 36: s = 55; break;
+    case 37: s = 62; break;
+    case 38: s = 69; break;
+    case 39: s = 76; break;
+    case 40: s = 83; break;
+    case 41: s = 90; break;
+    case 42: s = 97; break;
+    case 43: s = 104; break;
+    case 44: s = 111; break;
+    case 45: s = 118; break;
+    case 46: s = 125; break;
+    case 47: s = 132; break;
+    case 48: s = 139; break;
+    case 49: s = 146; break;
+    case 50: s = 153; break;
+    case 51: s = 160; break;
+    case 52: s = 167; break;
+    case 53: s = 174; break;
+    case 54: s = 181; break;
+    case 55: s = 188; break;
+    case 56: s = 195; break;
+    case 57: s = 2; break;
+    case 58: s = 9; break;
+    case 59: s = 16; break;
+    case 60: s = 23; break;
+    case 61: s = 30; break;
+    case 62: s = 37; break;
+    case 63: s = 44; break;
+    case 64: s = 51; break;
+    case 65: s = 58; break;
+    case 66: s = 65; break;
+    case 67: s = 72; break;
+    case 68: s = 79; break;
+    case 69: s = 86; break;
+    case 70: s = 93; break;
+    case 71: s = 100; break;
+    case 72: s = 107; break;
+    case 73: s = 114; break;
+    case 74: s = 121; break;
+    case 75: s = 128; break;
+    case 76: s = 135; break;
+    case 77: s = 142; break;
+    case 78: s = 149; break;
+    case 79: s = 156; break;
+    case 80: s = 163; break;
+    case 81: s = 170; break;
+    case 82: s = 177; break;
+    case 83: s = 184; break;
+    case 84: s = 191; break;
+    case 85: s = 198; break;
+    case 86: s = 5; break;
+    case 87: s = 12; break;
+    case 88: s = 19; break;
+    case 89: s = 26; break;
+    case 90: s = 33; break;
+    case 91: s = 40; break;
+    case 92: s = 47; break;
+    case 93: s = 54; break;
+    case 94: s = 61; break;
+    case 95: s = 68; break;
+    case 96: s = 75; break;
+    case 97: s = 82; break;
+    case 98: s = 89; break;
+    case 99: s = 96; break;
+    case 100: s = 103; break;
+    case 101: s = 110; break;
+    case 102: s = 117; break;
+    case 103: s = 124; break;
+    case 104: s = 131; break;
+    case 105: s = 138; break;
+    case 106: s = 145; break;
+    case 107: s = 152; break;
+    case 108: s = 159; break;
+    case 109: s = 166; break;
+    case 110: s = 173; break;
+    case 111: s = 180; break;
+    case 112: s = 187; break;
+    case 113: s = 194; break;
+    case 114: s = 1; break;
+    case 115: s = 8; break;
+    case 116: s = 15; break;
+    case 117: s = 22; break;
+    case 118: s = 29; break;
+    case 119: s = 36; break;
+    case 120: s = 43; break;
+    case 121: s = 50; break;
+    case 122: s = 57; break;
+    case 123: s = 64; break;
+    case 124: s = 71; break;
+    case 125: s = 78; break;
+    case 126: s = 85; break;
+    case 127: s = 92; break;
+    case 128: s = 99; break;
+    case 129: s = 106; break;
+    case 130: s = 113; break;
+    case 131: s = 120; break;
+    case 132: s = 127; break;
+    case 133: s = 134; break;
+    case 134: s = 141; break;
+    case 135: s = 148; break;
+    case 136: s = 155; break;
+    case 137: s = 162; break;
+    case 138: s = 169; break;
+    case 139: s = 176; break;
+    case 140: s = 183; break;
+    case 141: s = 190; break;
+    case 142: s = 197; break;
+    case 143: s = 4; break;
+    case 144: s = 11; break;
+    case 145: s = 18; break;
+    case 146: s = 25; break;
+    case 147: s = 32; break;
+    case 148: s = 39; break;
+    case 149: s = 46; break;
+    case 150: s = 53; break;
+    case 151: s = 60; break;
+    case 152: s = 67; break;
+    case 153: s = 74; break;
+    case 154: s = 81; break;
+    case 155: s = 88; break;
+    case 156: s = 95; break;
+    case 157: s = 102; break;
+    case 158: s = 109; break;
+    case 159: s = 116; break;
+    case 160: s = 123; break;
+    case 161: s = 130; break;
+    case 162: s = 137; break;
+    case 163: s = 144; break;
+    case 164: s = 151; break;
+    case 165: s = 158; break;
+    case 166: s = 165; break;
+    case 167: s = 172; break;
+    case 168: s = 179; break;
+    case 169: s = 186; break;
+    case 170: s = 193; break;
+    case 171: s = 0; break;
+    case 172: s = 7; break;
+    case 173: s = 14; break;
+    case 174: s = 21; break;
+    case 175: s = 28; break;
+    case 176: s = 35; break;
+    case 177: s = 42; break;
+    case 178: s = 49; break;
+    case 179: s = 56; break;
+    case 180: s = 63; break;
+    case 181: s = 70; break;
+    case 182: s = 77; break;
+    case 183: s = 84; break;
+    case 184: s = 91; break;
+    case 185: s = 98; break;
+    case 186: s = 105; break;
+    case 187: s = 112; break;
+    case 188: s = 119; break;
+    case 189: s = 126; break;
+    case 190: s = 133; break;
+    case 191: s = 140; break;
+    case 192: s = 147; break;
+    case 193: s = 154; break;
+    case 194: s = 161; break;
+    case 195: s = 168; break;
+    case 196: s = 175; break;
+    case 197: s = 182; break;
+    case 198: s = 189; break;
+    case 199: s = 196; break;
+    default: s = 0;
+    }
+    acc = acc + s;
+    n = n + 1;
+  }
+  return acc % 256;
+}
@@ -0,0 +1,43 @@
+int main() {
+  int t = 0;
+  int i = 0;
+  while(i < 12) {
+    int v = 100;
+    switch(i) {
+    case 1: v = 10; break;
+    case 2:
+    case 3: v = 0 - 7; break;
+    default: v = 3; break;
+    case 5: v = 55; break;
+    case 6: v = 66; break;
+    case 8: v = 88;
+    }
+    char c = 1;
+    switch(i) {
+    case 0: c = 100; break;
+    case 1: c = 2; break;
+    case 2: c = 3; break;
+    case 3: c = 4; break;
+    case 4: c = 5; break;
+    }
+    int w = 9;
+    switch(i) {
+    case 2: w = 1; break;
+    case 4: w = 2; break;
+    case 6: w = 3; break;
+    case 8: w = 4; break;
+    case 10: w = 5; break;
+    }
+    t = t + v + c + w;
+    i = i + 1;
+  }
+  int k = t % 7;
+  switch(k) {
+  case 0: return 11;
+  case 1: return 12;
+  case 2: return 13;
+  case 3: return 14;
+  case 4: return 15;
+  default: return 16;
+  }
+}
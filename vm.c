@@ -0,0 +1,358 @@
+#include "vm.h"
+#include "bytecode.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// GCC and Clang jump straight from one handler to the next through a
+// table of label addresses. Anything else goes round a switch. Both are
+// extensions -Wpedantic flags, so only those two spots are exempt.
+#if defined(__GNUC__)
+#define VM_THREADED 1
+#define VM_OP(name) do_##name:
+#define VM_NEXT() { \
+    executed++; \
+    _Pragma("GCC diagnostic push") \
+    _Pragma("GCC diagnostic ignored \"-Wpedantic\"") \
+    goto *dispatch[pc->op]; \
+    _Pragma("GCC diagnostic pop") \
+  }
+#define VM_HANDLER(name) [name] = __extension__ &&do_##name
+#else
+#define VM_THREADED 0
+#define VM_OP(name) case name:
+#define VM_NEXT() { executed++; continue; }
+#endif
+
+int32_t vm_sdiv32(int32_t, int32_t);
+int64_t vm_sdiv64(int64_t, int64_t);
+
+// Runs a function to its return and gives back w0. Division by zero
+// gives zero, as sdiv and udiv do.
+int vm_run(BcFunction* bf, VmStats* stats)
+{
+  uint64_t* r = calloc(bf->reg_count, sizeof(uint64_t));
+  uint8_t* frame = calloc(bf->frame_size + 1, 1);
+  if(!r || !frame) {
+    perror("Error");
+    exit(1);
+  }
+  const BcInsn* code = bf->code;
+  const BcInsn* pc = code;
+  size_t executed = 0;
+  uint8_t u8;
+  uint16_t u16;
+  uint32_t u32;
+#if VM_THREADED
+  static const void* const dispatch[BC_OP_COUNT] = {
+    VM_HANDLER(BC_MOV_W), VM_HANDLER(BC_MOV_X), VM_HANDLER(BC_CONST),
+    VM_HANDLER(BC_NEG_W), VM_HANDLER(BC_NEG_X), VM_HANDLER(BC_NOT_W),
+    VM_HANDLER(BC_NOT_X), VM_HANDLER(BC_ISZERO_W), VM_HANDLER(BC_ISZERO_X),
+    VM_HANDLER(BC_ADD_W), VM_HANDLER(BC_ADD_X), VM_HANDLER(BC_SUB_W),
+    VM_HANDLER(BC_SUB_X), VM_HANDLER(BC_MUL_W), VM_HANDLER(BC_MUL_X),
+    VM_HANDLER(BC_SDIV_W), VM_HANDLER(BC_SDIV_X), VM_HANDLER(BC_UDIV_W),
+    VM_HANDLER(BC_UDIV_X), VM_HANDLER(BC_AND_W), VM_HANDLER(BC_AND_X),
+    VM_HANDLER(BC_OR_W), VM_HANDLER(BC_OR_X), VM_HANDLER(BC_XOR_W),
+    VM_HANDLER(BC_XOR_X), VM_HANDLER(BC_SHL_W), VM_HANDLER(BC_SHL_X),
+    VM_HANDLER(BC_SAR_W), VM_HANDLER(BC_SAR_X), VM_HANDLER(BC_EQ_W),
+    VM_HANDLER(BC_EQ_X), VM_HANDLER(BC_NE_W), VM_HANDLER(BC_NE_X),
+    VM_HANDLER(BC_GT_W), VM_HANDLER(BC_GT_X), VM_HANDLER(BC_GE_W),
+    VM_HANDLER(BC_GE_X), VM_HANDLER(BC_LT_W), VM_HANDLER(BC_LT_X),
+    VM_HANDLER(BC_LE_W), VM_HANDLER(BC_LE_X), VM_HANDLER(BC_MSUB_W),
+    VM_HANDLER(BC_MSUB_X), VM_HANDLER(BC_ADDI_W), VM_HANDLER(BC_ADDI_X),
+    VM_HANDLER(BC_LOAD8), VM_HANDLER(BC_LOAD16), VM_HANDLER(BC_LOAD32),
+    VM_HANDLER(BC_LOAD64), VM_HANDLER(BC_STORE8), VM_HANDLER(BC_STORE16),
+    VM_HANDLER(BC_STORE32), VM_HANDLER(BC_STORE64), VM_HANDLER(BC_JMP),
+    VM_HANDLER(BC_JZ_W), VM_HANDLER(BC_JZ_X), VM_HANDLER(BC_JNZ_W),
+    VM_HANDLER(BC_JNZ_X), VM_HANDLER(BC_SWITCH), VM_HANDLER(BC_RET)
+  };
+  VM_NEXT();
+#else
+  for(;;) {
+  switch(pc->op) {
+#endif
+  VM_OP(BC_MOV_W)
+    r[pc->a] = (uint32_t)pc->imm;
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_MOV_X)
+    r[pc->a] = (int64_t)pc->imm;
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_CONST)
+    r[pc->a] = bf->consts[pc->imm];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_NEG_W)
+    r[pc->a] = (uint32_t)(0 - r[pc->b]);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_NEG_X)
+    r[pc->a] = 0 - r[pc->b];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_NOT_W)
+    r[pc->a] = (uint32_t)~r[pc->b];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_NOT_X)
+    r[pc->a] = ~r[pc->b];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_ISZERO_W)
+    r[pc->a] = (uint32_t)r[pc->b] == 0;
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_ISZERO_X)
+    r[pc->a] = r[pc->b] == 0;
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_ADD_W)
+    r[pc->a] = (uint32_t)(r[pc->b] + r[pc->c]);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_ADD_X)
+    r[pc->a] = r[pc->b] + r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_SUB_W)
+    r[pc->a] = (uint32_t)(r[pc->b] - r[pc->c]);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_SUB_X)
+    r[pc->a] = r[pc->b] - r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_MUL_W)
+    r[pc->a] = (uint32_t)(r[pc->b] * r[pc->c]);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_MUL_X)
+    r[pc->a] = r[pc->b] * r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_SDIV_W)
+    r[pc->a] = (uint32_t)vm_sdiv32(r[pc->b], r[pc->c]);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_SDIV_X)
+    r[pc->a] = vm_sdiv64(r[pc->b], r[pc->c]);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_UDIV_W)
+    u32 = r[pc->c];
+    r[pc->a] = u32 ? (uint32_t)r[pc->b] / u32 : 0;
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_UDIV_X)
+    r[pc->a] = r[pc->c] ? r[pc->b] / r[pc->c] : 0;
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_AND_W)
+    r[pc->a] = (uint32_t)(r[pc->b] & r[pc->c]);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_AND_X)
+    r[pc->a] = r[pc->b] & r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_OR_W)
+    r[pc->a] = (uint32_t)(r[pc->b] | r[pc->c]);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_OR_X)
+    r[pc->a] = r[pc->b] | r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_XOR_W)
+    r[pc->a] = (uint32_t)(r[pc->b] ^ r[pc->c]);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_XOR_X)
+    r[pc->a] = r[pc->b] ^ r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_SHL_W)
+    r[pc->a] = (uint32_t)(r[pc->b] << (r[pc->c] & 31));
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_SHL_X)
+    r[pc->a] = r[pc->b] << (r[pc->c] & 63);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_SAR_W)
+    r[pc->a] = (uint32_t)((int32_t)r[pc->b] >> (r[pc->c] & 31));
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_SAR_X)
+    r[pc->a] = (int64_t)r[pc->b] >> (r[pc->c] & 63);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_EQ_W)
+    r[pc->a] = (uint32_t)r[pc->b] == (uint32_t)r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_EQ_X)
+    r[pc->a] = r[pc->b] == r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_NE_W)
+    r[pc->a] = (uint32_t)r[pc->b] != (uint32_t)r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_NE_X)
+    r[pc->a] = r[pc->b] != r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_GT_W)
+    r[pc->a] = (int32_t)r[pc->b] > (int32_t)r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_GT_X)
+    r[pc->a] = (int64_t)r[pc->b] > (int64_t)r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_GE_W)
+    r[pc->a] = (int32_t)r[pc->b] >= (int32_t)r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_GE_X)
+    r[pc->a] = (int64_t)r[pc->b] >= (int64_t)r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_LT_W)
+    r[pc->a] = (int32_t)r[pc->b] < (int32_t)r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_LT_X)
+    r[pc->a] = (int64_t)r[pc->b] < (int64_t)r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_LE_W)
+    r[pc->a] = (int32_t)r[pc->b] <= (int32_t)r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_LE_X)
+    r[pc->a] = (int64_t)r[pc->b] <= (int64_t)r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_MSUB_W)
+    r[pc->a] = (uint32_t)(r[pc->a] - r[pc->b] * r[pc->c]);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_MSUB_X)
+    r[pc->a] = r[pc->a] - r[pc->b] * r[pc->c];
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_ADDI_W)
+    r[pc->a] = (uint32_t)(r[pc->b] + pc->imm);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_ADDI_X)
+    r[pc->a] = r[pc->b] + pc->imm;
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_LOAD8)
+    memcpy(&u8, frame + pc->imm, 1);
+    r[pc->a] = u8;
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_LOAD16)
+    memcpy(&u16, frame + pc->imm, 2);
+    r[pc->a] = u16;
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_LOAD32)
+    memcpy(&u32, frame + pc->imm, 4);
+    r[pc->a] = u32;
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_LOAD64)
+    memcpy(&r[pc->a], frame + pc->imm, 8);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_STORE8)
+    u8 = r[pc->a];
+    memcpy(frame + pc->imm, &u8, 1);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_STORE16)
+    u16 = r[pc->a];
+    memcpy(frame + pc->imm, &u16, 2);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_STORE32)
+    u32 = r[pc->a];
+    memcpy(frame + pc->imm, &u32, 4);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_STORE64)
+    memcpy(frame + pc->imm, &r[pc->a], 8);
+    pc++;
+    VM_NEXT();
+  VM_OP(BC_JMP)
+    pc = code + pc->imm;
+    VM_NEXT();
+  VM_OP(BC_JZ_W)
+    pc = (uint32_t)r[pc->a] ? pc + 1 : code + pc->imm;
+    VM_NEXT();
+  VM_OP(BC_JZ_X)
+    pc = r[pc->a] ? pc + 1 : code + pc->imm;
+    VM_NEXT();
+  VM_OP(BC_JNZ_W)
+    pc = (uint32_t)r[pc->a] ? code + pc->imm : pc + 1;
+    VM_NEXT();
+  VM_OP(BC_JNZ_X)
+    pc = r[pc->a] ? code + pc->imm : pc + 1;
+    VM_NEXT();
+  VM_OP(BC_SWITCH)
+    {
+      BcSwitch* table = &bf->switches[pc->imm];
+      size_t i = 0;
+      while(i < table->count && (long)r[pc->a] != table->vals[i]) {
+        i++;
+      }
+      pc = code + (i < table->count ? table->targets[i]
+                                    : table->default_target);
+    }
+    VM_NEXT();
+  VM_OP(BC_RET)
+    goto done;
+#if !VM_THREADED
+  default:
+    goto done;
+  }
+  }
+#endif
+done:
+  u32 = r[0];
+  free(r);
+  free(frame);
+  stats->executed += executed;
+  return (int32_t)u32;
+}
+
+// INT_MIN / -1 wraps instead of trapping
+int32_t vm_sdiv32(int32_t n, int32_t d)
+{
+  if(!d) {
+    return 0;
+  }
+  if(d == -1) {
+    return (uint32_t)0 - (uint32_t)n;
+  }
+  return n / d;
+}
+
+int64_t vm_sdiv64(int64_t n, int64_t d)
+{
+  if(!d) {
+    return 0;
+  }
+  if(d == -1) {
+    return (uint64_t)0 - (uint64_t)n;
+  }
+  return n / d;
+}
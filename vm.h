@@ -0,0 +1,14 @@
+#ifndef VM_H_
+#define VM_H_
+
+#include "bytecode.h"
+
+#include <stddef.h>
+
+typedef struct VmStats_s {
+  size_t executed; // Instructions dispatched
+} VmStats;
+
+int vm_run(BcFunction*, VmStats*);
+
+#endif
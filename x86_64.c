@@ -0,0 +1,723 @@
+#include "x86_64.h"
+#include "mir.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// MIR registers 0-10 live in these, the rest in the red zone under %rsp,
+// which a function that makes no calls may use without moving %rsp.
+// %rax, %rcx and %rdx stay free for division, shift counts and operands
+// that have to be in a register.
+#define MAPPED_REGS 11
+#define FIRST_CALLEE_SAVED 6
+
+typedef enum X86Op_e {
+  X86_MOV, X86_MOVABS, X86_MOVZB, X86_MOVZW, X86_ADD, X86_OR, X86_AND,
+  X86_SUB, X86_XOR, X86_CMP, X86_IMUL, X86_SHL, X86_SAR, X86_NEG, X86_NOT,
+  X86_IDIV, X86_DIV, X86_PUSH, X86_POP
+} X86Op;
+
+// Lowered instructions go out as text when em is set, machine code
+// otherwise. Both come from the same x86_lower.
+typedef struct X86Out_s {
+  Emitter* em;
+  X86Code* code;
+} X86Out;
+
+void x86_body(MirFunction*, int, X86Out*);
+void x86_lower(MirInsn*, int, X86Out*);
+void x86_binary(MirInsn*, X86Operand, X86Out*);
+void x86_result(int, int, X86Out*);
+void x86_op1(X86Op, int, X86Operand, X86Out*);
+void x86_op2(X86Op, int, X86Operand, X86Operand, X86Out*);
+void x86_setcc(A64Cond, X86Out*);
+void x86_jump(A64Cond, size_t, X86Out*);
+void x86_label(size_t, X86Out*);
+void x86_bare(const char*, int, X86Out*);
+void x86_print_operand(X86Operand, Emitter*);
+char x86_suffix(int);
+void x86_encode_op1(X86Op, int, X86Operand, X86Code*);
+void x86_encode_op2(X86Op, int, X86Operand, X86Operand, X86Code*);
+void x86_encode_modrm(X86Code*, int, const uint8_t*, int, int, X86Operand);
+void x86_emit(X86Code*, uint8_t);
+void x86_emit32(X86Code*, uint32_t);
+X86Operand x86_phys(X86Reg, int);
+X86Operand x86_imm(long);
+X86Operand x86_stack(long);
+X86Operand x86_mir_operand(int, int);
+int callee_saved_count(MirFunction*);
+int fits_int32(long);
+
+const X86Reg x86_mir_regs[MAPPED_REGS] = {
+  X86_RSI, X86_RDI, X86_R8,  X86_R9,  X86_R10, X86_R11,
+  X86_RBX, X86_R12, X86_R13, X86_R14, X86_R15
+};
+
+// 8, 4, 2 and 1 byte names
+const char* x86_reg_names[][4] = {
+  [X86_RAX] = {"rax", "eax", "ax", "al"},
+  [X86_RCX] = {"rcx", "ecx", "cx", "cl"},
+  [X86_RDX] = {"rdx", "edx", "dx", "dl"},
+  [X86_RBX] = {"rbx", "ebx", "bx", "bl"},
+  [X86_RSP] = {"rsp", "esp", "sp", "spl"},
+  [X86_RBP] = {"rbp", "ebp", "bp", "bpl"},
+  [X86_RSI] = {"rsi", "esi", "si", "sil"},
+  [X86_RDI] = {"rdi", "edi", "di", "dil"},
+  [X86_R8]  = {"r8", "r8d", "r8w", "r8b"},
+  [X86_R9]  = {"r9", "r9d", "r9w", "r9b"},
+  [X86_R10] = {"r10", "r10d", "r10w", "r10b"},
+  [X86_R11] = {"r11", "r11d", "r11w", "r11b"},
+  [X86_R12] = {"r12", "r12d", "r12w", "r12b"},
+  [X86_R13] = {"r13", "r13d", "r13w", "r13b"},
+  [X86_R14] = {"r14", "r14d", "r14w", "r14b"},
+  [X86_R15] = {"r15", "r15d", "r15w", "r15b"}
+};
+
+const char* x86_op_names[] = {
+  [X86_MOV] = "mov", [X86_MOVABS] = "movabs", [X86_MOVZB] = "movzb",
+  [X86_MOVZW] = "movzw", [X86_ADD] = "add", [X86_OR] = "or",
+  [X86_AND] = "and", [X86_SUB] = "sub", [X86_XOR] = "xor",
+  [X86_CMP] = "cmp", [X86_IMUL] = "imul", [X86_SHL] = "shl",
+  [X86_SAR] = "sar", [X86_NEG] = "neg", [X86_NOT] = "not",
+  [X86_IDIV] = "idiv", [X86_DIV] = "div", [X86_PUSH] = "push",
+  [X86_POP] = "pop"
+};
+
+// jcc and setcc with the same meaning after a cmp, as a suffix and as
+// the low bits of the opcode
+const char* x86_conds[] = {
+  [A64_EQ] = "e", [A64_NE] = "ne", [A64_HS] = "ae", [A64_LO] = "b",
+  [A64_MI] = "s", [A64_PL] = "ns", [A64_VS] = "o", [A64_VC] = "no",
+  [A64_HI] = "a", [A64_LS] = "be", [A64_GE] = "ge", [A64_LT] = "l",
+  [A64_GT] = "g", [A64_LE] = "le", [A64_AL] = "mp"
+};
+
+const uint8_t x86_cond_codes[] = {
+  [A64_EQ] = 0x4, [A64_NE] = 0x5, [A64_HS] = 0x3, [A64_LO] = 0x2,
+  [A64_MI] = 0x8, [A64_PL] = 0x9, [A64_VS] = 0x0, [A64_VC] = 0x1,
+  [A64_HI] = 0x7, [A64_LS] = 0x6, [A64_GE] = 0xD, [A64_LT] = 0xC,
+  [A64_GT] = 0xF, [A64_LE] = 0xE
+};
+
+const X86Op x86_ops[] = {
+  [MIR_NEG] = X86_NEG, [MIR_MVN] = X86_NOT, [MIR_ADD] = X86_ADD,
+  [MIR_SUB] = X86_SUB, [MIR_MUL] = X86_IMUL, [MIR_SDIV] = X86_IDIV,
+  [MIR_UDIV] = X86_DIV, [MIR_AND] = X86_AND, [MIR_ORR] = X86_OR,
+  [MIR_EOR] = X86_XOR, [MIR_LSL] = X86_SHL, [MIR_ASR] = X86_SAR,
+  [MIR_ADD_IMM] = X86_ADD, [MIR_SUB_IMM] = X86_SUB
+};
+
+// ModRM digits of the ALU group, whose opcodes are 8 apart
+const uint8_t x86_alu_digits[] = {
+  [X86_ADD] = 0, [X86_OR] = 1, [X86_AND] = 4, [X86_SUB] = 5,
+  [X86_XOR] = 6, [X86_CMP] = 7
+};
+
+// Group 3 digits under opcode F7
+const uint8_t x86_f7_digits[] = {
+  [X86_NOT] = 2, [X86_NEG] = 3, [X86_DIV] = 6, [X86_IDIV] = 7
+};
+
+// Prints the function as GNU as AT&T syntax for x86-64 SysV
+void x86_print(MirFunction* mf, Emitter* em)
+{
+  X86Out out = {em, NULL};
+  emit_str(em, ".globl ");
+  emit_str(em, mf->name);
+  emit_str(em, "\n.type ");
+  emit_str(em, mf->name);
+  emit_str(em, ", @function\n");
+  emit_str(em, mf->name);
+  emit_bytes(em, ":\n", 2);
+  x86_body(mf, callee_saved_count(mf), &out);
+  emit_str(em, ".size ");
+  emit_str(em, mf->name);
+  emit_str(em, ", .-");
+  emit_str(em, mf->name);
+  emit_char(em, '\n');
+}
+
+// Appends the machine code for the function. Labels are bound in code
+// and still need x86_resolve_labels.
+void x86_encode(MirFunction* mf, X86Code* code)
+{
+  X86Out out = {NULL, code};
+  x86_body(mf, callee_saved_count(mf), &out);
+}
+
+// Saves the callee saved registers in use, then lowers every instruction
+void x86_body(MirFunction* mf, int saved, X86Out* out)
+{
+  for(int i = 0; i < saved; i++) {
+    x86_op1(X86_PUSH, 8, x86_phys(x86_mir_regs[FIRST_CALLEE_SAVED + i], 8),
+            out);
+  }
+  for(size_t i = 0; i < mf->count; i++) {
+    x86_lower(&mf->insns[i], saved, out);
+  }
+}
+
+void x86_lower(MirInsn* insn, int saved, X86Out* out)
+{
+  int size = insn->sf ? 8 : 4;
+  X86Operand rax = x86_phys(X86_RAX, size);
+  X86Operand rdx = x86_phys(X86_RDX, size);
+  X86Operand d = x86_mir_operand(insn->rd, size);
+  X86Operand n = x86_mir_operand(insn->rn, size);
+  X86Operand m = x86_mir_operand(insn->rm, size);
+  X86Operand dst;
+  switch(insn->op) {
+  case MIR_LABEL:
+    x86_label(insn->imm, out);
+    break;
+  case MIR_MOV_IMM:
+    if(!insn->sf || fits_int32(insn->imm)) {
+      x86_op2(X86_MOV, size,
+              x86_imm(insn->sf ? insn->imm : (int32_t)insn->imm), d, out);
+    } else if(d.kind == X86_REG) {
+      x86_op2(X86_MOVABS, 8, x86_imm(insn->imm), d, out);
+    } else {
+      x86_op2(X86_MOVABS, 8, x86_imm(insn->imm), rax, out);
+      x86_result(insn->rd, size, out);
+    }
+    break;
+  case MIR_NEG:
+  case MIR_MVN:
+    if(insn->rd != insn->rn || d.kind != X86_REG) {
+      x86_op2(X86_MOV, size, n, rax, out);
+      x86_op1(x86_ops[insn->op], size, rax, out);
+      x86_result(insn->rd, size, out);
+    } else {
+      x86_op1(x86_ops[insn->op], size, d, out);
+    }
+    break;
+  case MIR_ADD:
+  case MIR_SUB:
+  case MIR_MUL:
+  case MIR_AND:
+  case MIR_ORR:
+  case MIR_EOR:
+    x86_binary(insn, m, out);
+    break;
+  case MIR_ADD_IMM:
+  case MIR_SUB_IMM:
+    x86_binary(insn, x86_imm(insn->imm), out);
+    break;
+  case MIR_LSL:
+  case MIR_ASR:
+    // Counts wrap at the register width on both machines
+    x86_op2(X86_MOV, 4, x86_mir_operand(insn->rm, 4), x86_phys(X86_RCX, 4),
+            out);
+    x86_binary(insn, x86_phys(X86_RCX, 1), out);
+    break;
+  case MIR_SDIV:
+  case MIR_UDIV:
+    x86_op2(X86_MOV, size, n, rax, out);
+    if(insn->op == MIR_SDIV) {
+      x86_bare(insn->sf ? "cqto" : "cltd", size, out);
+    } else {
+      x86_op2(X86_XOR, 4, x86_phys(X86_RDX, 4), x86_phys(X86_RDX, 4), out);
+    }
+    x86_op1(x86_ops[insn->op], size, m, out);
+    x86_result(insn->rd, size, out);
+    break;
+  case MIR_MSUB:
+    x86_op2(X86_MOV, size, n, rax, out);
+    x86_op2(X86_IMUL, size, m, rax, out);
+    x86_op1(X86_NEG, size, rax, out);
+    x86_op2(X86_ADD, size, x86_mir_operand(insn->ra, size), rax, out);
+    x86_result(insn->rd, size, out);
+    break;
+  case MIR_CMP:
+    if(n.kind == X86_MEM && m.kind == X86_MEM) {
+      x86_op2(X86_MOV, size, n, rax, out);
+      n = rax;
+    }
+    x86_op2(X86_CMP, size, m, n, out);
+    break;
+  case MIR_CMP_IMM:
+    if(!insn->sf || fits_int32(insn->imm)) {
+      x86_op2(X86_CMP, size,
+              x86_imm(insn->sf ? insn->imm : (int32_t)insn->imm), n, out);
+    } else {
+      x86_op2(X86_MOVABS, 8, x86_imm(insn->imm), rdx, out);
+      x86_op2(X86_CMP, 8, rdx, n, out);
+    }
+    break;
+  case MIR_CMN:
+    x86_op2(X86_MOV, size, n, rax, out);
+    x86_op2(X86_ADD, size, m, rax, out);
+    break;
+  case MIR_CSET:
+    x86_setcc(insn->cond, out);
+    x86_op2(X86_MOVZB, 4, x86_phys(X86_RAX, 1), x86_phys(X86_RAX, 4), out);
+    x86_result(insn->rd, size, out);
+    break;
+  case MIR_LDR:
+    // Narrow loads zero extend, like ldrb and ldrh
+    dst = x86_phys(d.kind == X86_REG ? d.reg : X86_RAX,
+                   insn->size < 4 ? 4 : insn->size);
+    if(insn->size < 4) {
+      x86_op2(insn->size == 1 ? X86_MOVZB : X86_MOVZW, 4,
+              x86_stack(insn->imm), dst, out);
+    } else {
+      x86_op2(X86_MOV, insn->size, x86_stack(insn->imm), dst, out);
+    }
+    if(d.kind != X86_REG) {
+      x86_result(insn->rd, size, out);
+    }
+    break;
+  case MIR_STR:
+    if(d.kind != X86_REG) {
+      x86_op2(X86_MOV, 8, x86_mir_operand(insn->rd, 8),
+              x86_phys(X86_RAX, 8), out);
+      d.reg = X86_RAX;
+    }
+    x86_op2(X86_MOV, insn->size, x86_phys(d.reg, insn->size),
+            x86_stack(insn->imm), out);
+    break;
+  case MIR_B:
+    x86_jump(A64_AL, insn->imm, out);
+    break;
+  case MIR_BCOND:
+    x86_jump(insn->cond, insn->imm, out);
+    break;
+  case MIR_CBZ:
+  case MIR_CBNZ:
+    x86_op2(X86_CMP, size, x86_imm(0), n, out);
+    x86_jump(insn->op == MIR_CBZ ? A64_EQ : A64_NE, insn->imm, out);
+    break;
+  case MIR_RET:
+    x86_op2(X86_MOV, 8, x86_mir_operand(0, 8), x86_phys(X86_RAX, 8), out);
+    for(int i = saved - 1; i >= 0; i--) {
+      x86_op1(X86_POP, 8, x86_phys(x86_mir_regs[FIRST_CALLEE_SAVED + i], 8),
+              out);
+    }
+    x86_bare("ret", 0, out);
+    break;
+  case MIR_NOP:
+    break;
+  }
+}
+
+// rd = rn op src. Two operand form in place when rd is rn and a register,
+// otherwise through %rax.
+void x86_binary(MirInsn* insn, X86Operand src, X86Out* out)
+{
+  int size = insn->sf ? 8 : 4;
+  X86Operand d = x86_mir_operand(insn->rd, size);
+  if(insn->rd == insn->rn && d.kind == X86_REG) {
+    x86_op2(x86_ops[insn->op], size, src, d, out);
+    return;
+  }
+  X86Operand rax = x86_phys(X86_RAX, size);
+  x86_op2(X86_MOV, size, x86_mir_operand(insn->rn, size), rax, out);
+  x86_op2(x86_ops[insn->op], size, src, rax, out);
+  x86_result(insn->rd, size, out);
+}
+
+// Moves %rax into MIR register reg. Red zone slots always get all 8
+// bytes, so a later 64 bit read sees the upper half zeroed as it would
+// be in a w register.
+void x86_result(int reg, int size, X86Out* out)
+{
+  X86Operand d = x86_mir_operand(reg, size);
+  if(d.kind == X86_MEM) {
+    x86_op2(X86_MOV, 8, x86_phys(X86_RAX, 8), d, out);
+  } else {
+    x86_op2(X86_MOV, size, x86_phys(X86_RAX, size), d, out);
+  }
+}
+
+X86Operand x86_phys(X86Reg reg, int size)
+{
+  return (X86Operand){X86_REG, reg, size, 0};
+}
+
+X86Operand x86_imm(long value)
+{
+  return (X86Operand){X86_IMM, X86_RAX, 8, value};
+}
+
+X86Operand x86_stack(long offset)
+{
+  return (X86Operand){X86_MEM, X86_RSP, 8, offset};
+}
+
+// Register 31 is the stack pointer, as it is for AArch64
+X86Operand x86_mir_operand(int reg, int size)
+{
+  if(reg == 31) {
+    return x86_phys(X86_RSP, size);
+  }
+  if(reg < MAPPED_REGS) {
+    return x86_phys(x86_mir_regs[reg], size);
+  }
+  return x86_stack(-8 * (reg - MAPPED_REGS + 1));
+}
+
+void x86_op1(X86Op op, int size, X86Operand dst, X86Out* out)
+{
+  if(!out->em) {
+    x86_encode_op1(op, size, dst, out->code);
+    return;
+  }
+  emit_bytes(out->em, "  ", 2);
+  emit_str(out->em, x86_op_names[op]);
+  emit_char(out->em, x86_suffix(size));
+  emit_char(out->em, ' ');
+  x86_print_operand(dst, out->em);
+  emit_char(out->em, '\n');
+}
+
+void x86_op2(X86Op op, int size, X86Operand src, X86Operand dst, X86Out* out)
+{
+  // A 4 byte move to itself still clears the upper half
+  if(op == X86_MOV && size == 8 && src.kind == X86_REG
+     && dst.kind == X86_REG && src.reg == dst.reg) {
+    return;
+  }
+  if(!out->em) {
+    x86_encode_op2(op, size, src, dst, out->code);
+    return;
+  }
+  emit_bytes(out->em, "  ", 2);
+  emit_str(out->em, x86_op_names[op]);
+  emit_char(out->em, x86_suffix(size));
+  emit_char(out->em, ' ');
+  x86_print_operand(src, out->em);
+  emit_bytes(out->em, ", ", 2);
+  x86_print_operand(dst, out->em);
+  emit_char(out->em, '\n');
+}
+
+// set<cc> %al
+void x86_setcc(A64Cond cond, X86Out* out)
+{
+  if(!out->em) {
+    x86_emit(out->code, 0x0F);
+    x86_emit(out->code, 0x90 | x86_cond_codes[cond]);
+    x86_emit(out->code, 0xC0);
+    return;
+  }
+  emit_str(out->em, "  set");
+  emit_str(out->em, x86_conds[cond]);
+  emit_str(out->em, " %al\n");
+}
+
+// jmp for A64_AL. Always rel32, so nothing moves once labels resolve.
+void x86_jump(A64Cond cond, size_t tag, X86Out* out)
+{
+  if(out->em) {
+    emit_str(out->em, "  j");
+    emit_str(out->em, x86_conds[cond]);
+    emit_char(out->em, ' ');
+    emit_label_ref(out->em, tag);
+    emit_char(out->em, '\n');
+    return;
+  }
+  X86Code* code = out->code;
+  if(cond == A64_AL) {
+    x86_emit(code, 0xE9);
+  } else {
+    x86_emit(code, 0x0F);
+    x86_emit(code, 0x80 | x86_cond_codes[cond]);
+  }
+  if(code->fixup_count == code->fixup_capacity) {
+    code->fixup_capacity *= 2;
+    code->fixups = realloc(code->fixups,
+                           sizeof(X86Fixup) * code->fixup_capacity);
+    if(!code->fixups) {
+      perror("Error");
+      exit(1);
+    }
+  }
+  code->fixups[code->fixup_count++] = (X86Fixup){code->count, tag};
+  x86_emit32(code, 0);
+}
+
+void x86_label(size_t tag, X86Out* out)
+{
+  if(out->em) {
+    emit_label_ref(out->em, tag);
+    emit_bytes(out->em, ":\n", 2);
+    return;
+  }
+  X86Code* code = out->code;
+  if(tag >= code->label_capacity) {
+    size_t new_capacity = code->label_capacity ? code->label_capacity : 64;
+    while(tag >= new_capacity) {
+      new_capacity *= 2;
+    }
+    code->label_pos = realloc(code->label_pos, sizeof(long) * new_capacity);
+    if(!code->label_pos) {
+      perror("Error");
+      exit(1);
+    }
+    for(size_t i = code->label_capacity; i < new_capacity; i++) {
+      code->label_pos[i] = -1;
+    }
+    code->label_capacity = new_capacity;
+  }
+  code->label_pos[tag] = code->count;
+}
+
+// Instructions without operands: cqto, cltd and ret
+void x86_bare(const char* name, int size, X86Out* out)
+{
+  if(out->em) {
+    emit_bytes(out->em, "  ", 2);
+    emit_str(out->em, name);
+    emit_char(out->em, '\n');
+    return;
+  }
+  if(!strcmp(name, "ret")) {
+    x86_emit(out->code, 0xC3);
+    return;
+  }
+  if(size == 8) {
+    x86_emit(out->code, 0x48);
+  }
+  x86_emit(out->code, 0x99);
+}
+
+void x86_print_operand(X86Operand op, Emitter* em)
+{
+  int width = op.size == 8 ? 0 : op.size == 4 ? 1 : op.size == 2 ? 2 : 3;
+  switch(op.kind) {
+  case X86_REG:
+    emit_char(em, '%');
+    emit_str(em, x86_reg_names[op.reg][width]);
+    break;
+  case X86_MEM:
+    if(op.value) {
+      emit_long(em, op.value);
+    }
+    emit_bytes(em, "(%", 2);
+    emit_str(em, x86_reg_names[op.reg][0]);
+    emit_char(em, ')');
+    break;
+  case X86_IMM:
+    emit_char(em, '$');
+    emit_long(em, op.value);
+    break;
+  }
+}
+
+char x86_suffix(int size)
+{
+  return size == 8 ? 'q' : size == 4 ? 'l' : size == 2 ? 'w' : 'b';
+}
+
+void x86_encode_op1(X86Op op, int size, X86Operand dst, X86Code* code)
+{
+  const uint8_t opcode = 0xF7;
+  if(op == X86_PUSH || op == X86_POP) {
+    if(dst.reg >= 8) {
+      x86_emit(code, 0x41);
+    }
+    x86_emit(code, (op == X86_PUSH ? 0x50 : 0x58) | (dst.reg & 7));
+    return;
+  }
+  x86_encode_modrm(code, size, &opcode, 1, x86_f7_digits[op], dst);
+}
+
+// op src, dst in AT&T order
+void x86_encode_op2(X86Op op, int size, X86Operand src, X86Operand dst,
+                    X86Code* code)
+{
+  uint8_t opcode[2];
+  switch(op) {
+  case X86_ADD:
+  case X86_OR:
+  case X86_AND:
+  case X86_SUB:
+  case X86_XOR:
+  case X86_CMP:
+    if(src.kind == X86_IMM) {
+      int imm8 = src.value >= -128 && src.value < 128;
+      opcode[0] = imm8 ? 0x83 : 0x81;
+      x86_encode_modrm(code, size, opcode, 1, x86_alu_digits[op], dst);
+      if(imm8) {
+        x86_emit(code, src.value);
+      } else {
+        x86_emit32(code, src.value);
+      }
+    } else if(src.kind == X86_REG) {
+      opcode[0] = x86_alu_digits[op] * 8 + 1;
+      x86_encode_modrm(code, size, opcode, 1, src.reg, dst);
+    } else {
+      opcode[0] = x86_alu_digits[op] * 8 + 3;
+      x86_encode_modrm(code, size, opcode, 1, dst.reg, src);
+    }
+    break;
+  case X86_MOV:
+    if(src.kind == X86_IMM && dst.kind == X86_REG && size == 4) {
+      if(dst.reg >= 8) {
+        x86_emit(code, 0x41);
+      }
+      x86_emit(code, 0xB8 | (dst.reg & 7));
+      x86_emit32(code, src.value);
+    } else if(src.kind == X86_IMM) {
+      opcode[0] = 0xC7;
+      x86_encode_modrm(code, size, opcode, 1, 0, dst);
+      x86_emit32(code, src.value);
+    } else if(src.kind == X86_REG) {
+      opcode[0] = size == 1 ? 0x88 : 0x89;
+      x86_encode_modrm(code, size, opcode, 1, src.reg, dst);
+    } else {
+      opcode[0] = 0x8B;
+      x86_encode_modrm(code, size, opcode, 1, dst.reg, src);
+    }
+    break;
+  case X86_MOVABS:
+    x86_emit(code, 0x48 | (dst.reg >= 8));
+    x86_emit(code, 0xB8 | (dst.reg & 7));
+    x86_emit32(code, src.value);
+    x86_emit32(code, (uint64_t)src.value >> 32);
+    break;
+  case X86_MOVZB:
+  case X86_MOVZW:
+  case X86_IMUL:
+    opcode[0] = 0x0F;
+    opcode[1] = op == X86_MOVZB ? 0xB6 : op == X86_MOVZW ? 0xB7 : 0xAF;
+    x86_encode_modrm(code, size, opcode, 2, dst.reg, src);
+    break;
+  case X86_SHL:
+  case X86_SAR:
+    // The count is always %cl
+    opcode[0] = 0xD3;
+    x86_encode_modrm(code, size, opcode, 1, op == X86_SHL ? 4 : 7, dst);
+    break;
+  default:
+    break;
+  }
+}
+
+// Operand size prefix, REX, opcode, then ModRM for reg (a register or an
+// opcode digit) and rm. Memory operands are always off %rsp, which takes
+// a SIB byte.
+void x86_encode_modrm(X86Code* code, int size, const uint8_t* opcode,
+                      int opcode_len, int reg, X86Operand rm)
+{
+  if(size == 2) {
+    x86_emit(code, 0x66);
+  }
+  int rm_reg = rm.kind == X86_REG ? (int)rm.reg : 0;
+  uint8_t rex = 0x40 | (size == 8) << 3 | (reg >= 8) << 2 | (rm_reg >= 8);
+  // %spl, %bpl, %sil and %dil only exist with a REX prefix
+  int byte_rex = size == 1 && ((reg >= 4 && reg < 8)
+                               || (rm_reg >= 4 && rm_reg < 8));
+  if(rex != 0x40 || byte_rex) {
+    x86_emit(code, rex);
+  }
+  for(int i = 0; i < opcode_len; i++) {
+    x86_emit(code, opcode[i]);
+  }
+  if(rm.kind == X86_REG) {
+    x86_emit(code, 0xC0 | (reg & 7) << 3 | (rm_reg & 7));
+  } else if(!rm.value) {
+    x86_emit(code, (reg & 7) << 3 | 4);
+    x86_emit(code, 0x24);
+  } else if(rm.value >= -128 && rm.value < 128) {
+    x86_emit(code, 0x40 | (reg & 7) << 3 | 4);
+    x86_emit(code, 0x24);
+    x86_emit(code, rm.value);
+  } else {
+    x86_emit(code, 0x80 | (reg & 7) << 3 | 4);
+    x86_emit(code, 0x24);
+    x86_emit32(code, rm.value);
+  }
+}
+
+void x86_init(X86Code* code)
+{
+  code->count = 0;
+  code->capacity = 4096;
+  code->bytes = malloc(code->capacity);
+  code->label_capacity = 0;
+  code->label_pos = NULL;
+  code->fixup_count = 0;
+  code->fixup_capacity = 64;
+  code->fixups = malloc(sizeof(X86Fixup) * code->fixup_capacity);
+  if(!code->bytes || !code->fixups) {
+    perror("Error");
+    exit(1);
+  }
+}
+
+void x86_emit(X86Code* code, uint8_t byte)
+{
+  if(code->count == code->capacity) {
+    code->capacity *= 2;
+    code->bytes = realloc(code->bytes, code->capacity);
+    if(!code->bytes) {
+      perror("Error");
+      exit(1);
+    }
+  }
+  code->bytes[code->count++] = byte;
+}
+
+// Little endian
+void x86_emit32(X86Code* code, uint32_t value)
+{
+  for(int i = 0; i < 4; i++) {
+    x86_emit(code, value >> (8 * i));
+  }
+}
+
+// Returns 0 on success, -1 if a label is missing.
+int x86_resolve_labels(X86Code* code)
+{
+  for(size_t i = 0; i < code->fixup_count; i++) {
+    X86Fixup* fixup = &code->fixups[i];
+    if(fixup->tag >= code->label_capacity
+       || code->label_pos[fixup->tag] < 0) {
+      printf("Error: undefined label .L%zu\n", fixup->tag);
+      return -1;
+    }
+    // Relative to the end of the rel32 field
+    uint32_t delta = code->label_pos[fixup->tag] - (long)fixup->offset - 4;
+    for(int b = 0; b < 4; b++) {
+      code->bytes[fixup->offset + b] = delta >> (8 * b);
+    }
+  }
+  return 0;
+}
+
+void x86_free(X86Code* code)
+{
+  free(code->bytes);
+  free(code->label_pos);
+  free(code->fixups);
+  memset(code, 0, sizeof(X86Code));
+}
+
+// Callee saved registers the function touches, pushed on entry
+int callee_saved_count(MirFunction* mf)
+{
+  int highest = 0;
+  for(size_t i = 0; i < mf->count; i++) {
+    MirInsn* insn = &mf->insns[i];
+    if(insn->op == MIR_LABEL || insn->op == MIR_B || insn->op == MIR_BCOND
+       || insn->op == MIR_RET || insn->op == MIR_NOP) {
+      continue;
+    }
+    int regs[] = {insn->rd, insn->rn, insn->rm, insn->ra};
+    for(int r = 0; r < 4; r++) {
+      if(regs[r] != 31 && regs[r] > highest) {
+        highest = regs[r];
+      }
+    }
+  }
+  int used = highest + 1 < MAPPED_REGS ? highest + 1 : MAPPED_REGS;
+  return used > FIRST_CALLEE_SAVED ? used - FIRST_CALLEE_SAVED : 0;
+}
+
+int fits_int32(long value)
+{
+  return value >= INT32_MIN && value <= INT32_MAX;
+}
@@ -0,0 +1,54 @@
+#ifndef X86_64_H_
+#define X86_64_H_
+
+#include "mir.h"
+#include "emitter.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Physical registers, in encoding order
+typedef enum X86Reg_e {
+  X86_RAX, X86_RCX, X86_RDX, X86_RBX, X86_RSP, X86_RBP, X86_RSI, X86_RDI,
+  X86_R8,  X86_R9,  X86_R10, X86_R11, X86_R12, X86_R13, X86_R14, X86_R15
+} X86Reg;
+
+typedef enum X86OperandKind_e {
+  X86_REG,
+  X86_MEM, // value(%reg)
+  X86_IMM
+} X86OperandKind;
+
+typedef struct X86Operand_s {
+  X86OperandKind kind;
+  X86Reg reg;
+  int size;   // Bytes, picks the register name
+  long value; // Displacement or immediate
+} X86Operand;
+
+typedef struct X86Fixup_s {
+  size_t offset; // Of the rel32 field
+  size_t tag;
+} X86Fixup;
+
+// Machine code for -run. Jumps are rel32 to the generator's numeric tags
+// and get patched in x86_resolve_labels.
+typedef struct X86Code_s {
+  uint8_t* bytes;
+  size_t count;
+  size_t capacity;
+  long* label_pos;
+  size_t label_capacity;
+  X86Fixup* fixups;
+  size_t fixup_count;
+  size_t fixup_capacity;
+} X86Code;
+
+void x86_print(MirFunction*, Emitter*);
+void x86_encode(MirFunction*, X86Code*);
+
+void x86_init(X86Code*);
+int x86_resolve_labels(X86Code*);
+void x86_free(X86Code*);
+
+#endif